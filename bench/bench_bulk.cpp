@@ -0,0 +1,110 @@
+﻿// Throughput of the bulk date-range engine against one get_prayer_times call per day.
+//
+// usage: bench_bulk [locations] [days]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "prayertimes.hpp"
+#include "ephemeris.hpp"
+#include "trig.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    int num_locations = argc > 1 ? atoi(argv[1]) : 1000;
+    int num_days = argc > 2 ? atoi(argv[2]) : 365;
+    const double total_days = (double) num_locations * num_days;
+
+    PrayerTimes prayer_times(Parameters::MWL, Parameters::Shafii, Parameters::AngleBased);
+    double checksum_single = 0, checksum_bulk = 0;
+
+    Clock::time_point start = Clock::now();
+    for (int l = 0; l < num_locations; ++l)
+    {
+        double latitude = -60.0 + 120.0 * l / num_locations;
+        double longitude = -180.0 + 360.0 * l / num_locations;
+        double times[Parameters::TimesCount];
+        for (int d = 0; d < num_days; ++d)
+        {
+            prayer_times.get_prayer_times(2024, 1, 1 + d, latitude, longitude, 0, times);
+            for (int i = 0; i < Parameters::TimesCount; ++i)
+                if (!std::isnan(times[i]))
+                    checksum_single += times[i];
+        }
+    }
+    double single_seconds = seconds_since(start);
+
+    Timetable table;
+    start = Clock::now();
+    for (int l = 0; l < num_locations; ++l)
+    {
+        double latitude = -60.0 + 120.0 * l / num_locations;
+        double longitude = -180.0 + 360.0 * l / num_locations;
+        prayer_times.get_prayer_times_range(2024, 1, 1, num_days, latitude, longitude, 0, table);
+        for (size_t k = 0; k < table.data.size(); ++k)
+            if (!std::isnan(table.data[k]))
+                checksum_bulk += table.data[k];
+    }
+    double bulk_seconds = seconds_since(start);
+
+    // same bulk run with sun positions from the shared ephemeris cache
+    double checksum_cached = 0;
+    PrayerTimes cached_times(Parameters::MWL, Parameters::Shafii, Parameters::AngleBased);
+    cached_times.set_ephemeris_cache(true);
+    start = Clock::now();
+    for (int l = 0; l < num_locations; ++l)
+    {
+        double latitude = -60.0 + 120.0 * l / num_locations;
+        double longitude = -180.0 + 360.0 * l / num_locations;
+        cached_times.get_prayer_times_range(2024, 1, 1, num_days, latitude, longitude, 0, table);
+        for (size_t k = 0; k < table.data.size(); ++k)
+            if (!std::isnan(table.data[k]))
+                checksum_cached += table.data[k];
+    }
+    double cached_seconds = seconds_since(start);
+    SolarEphemeris::Stats stats = SolarEphemeris::shared().stats();
+
+    // largest difference between both paths, in seconds
+    double max_diff = 0, max_cached_diff = 0;
+    Timetable cached_table;
+    for (int l = 0; l < num_locations; l += std::max(1, num_locations / 50))
+    {
+        double latitude = -60.0 + 120.0 * l / num_locations;
+        double longitude = -180.0 + 360.0 * l / num_locations;
+        double times[Parameters::TimesCount];
+        prayer_times.get_prayer_times_range(2024, 1, 1, num_days, latitude, longitude, 0, table);
+        cached_times.get_prayer_times_range(2024, 1, 1, num_days, latitude, longitude, 0, cached_table);
+        for (int d = 0; d < num_days; ++d)
+        {
+            prayer_times.get_prayer_times(2024, 1, 1 + d, latitude, longitude, 0, times);
+            for (int i = 0; i < Parameters::TimesCount; ++i)
+                if (!std::isnan(times[i]))
+                {
+                    max_diff = std::max(max_diff, fabs(times[i] - table.at(d, i)) * 3600.0);
+                    max_cached_diff = std::max(max_cached_diff, fabs(times[i] - cached_table.at(d, i)) * 3600.0);
+                }
+        }
+    }
+
+    printf("locations x days : %d x %d\n", num_locations, num_days);
+    printf("per-day calls    : %12.0f days/s\n", total_days / single_seconds);
+    printf("bulk range       : %12.0f days/s\n", total_days / bulk_seconds);
+    printf("bulk + ephemeris : %12.0f days/s\n", total_days / cached_seconds);
+    printf("ephemeris cache  : %llu hits, %llu misses, %llu bypassed, %llu blocks\n",
+           (unsigned long long) stats.hits, (unsigned long long) stats.misses,
+           (unsigned long long) stats.bypassed, (unsigned long long) stats.blocks);
+    printf("simd level       : %s\n", TrigHelper::simd_level());
+    printf("max difference   : %g s (bulk), %g s (ephemeris)\n", max_diff, max_cached_diff);
+    printf("checksum delta   : %g (bulk), %g (ephemeris)\n", fabs(checksum_single - checksum_bulk), fabs(checksum_single - checksum_cached));
+    return 0;
+}
@@ -0,0 +1,134 @@
+﻿// ResultCache in front of compute_day_times: cost of hits and misses, hit
+// rate of a skewed workload and scaling of concurrent lookups.
+//
+// usage: bench_cache [queries per thread] [max threads]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "resultcache.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static const int NUM_CITIES = 5000;
+static const int NUM_DAYS = 30;
+
+struct Request
+{
+    int city;
+    int day;		// of March 2024
+    int calculator;
+};
+
+/* popular cities and the next days are asked for far more often than the rest */
+static std::vector<Request> make_requests(int count, unsigned seed)
+{
+    std::vector<Request> requests(count);
+    for (int i = 0; i < count; ++i)
+    {
+        seed = seed * 1103515245u + 12345u;
+        double u = ((seed >> 8) & 0xffff) / 65536.0;
+        requests[i].city = (int) (NUM_CITIES * u * u * u);
+        seed = seed * 1103515245u + 12345u;
+        double v = ((seed >> 8) & 0xffff) / 65536.0;
+        requests[i].day = 1 + (int) (NUM_DAYS * v * v);
+        requests[i].calculator = (seed >> 28) & 1;
+    }
+    return requests;
+}
+
+static Location city(int i)
+{
+    Location location;
+    location.latitude = -55.0 + 110.0 * ((i * 7919) % NUM_CITIES) / NUM_CITIES;
+    location.longitude = -180.0 + 360.0 * ((i * 104729) % NUM_CITIES) / NUM_CITIES;
+    location.timezone = floor(location.longitude / 15.0 + 0.5);
+    return location;
+}
+
+/* ns per query of every thread running the requests, through the cache when given */
+static double run(const Calculator* calculators, ResultCache* cache, const std::vector<Request>& requests, unsigned threads, bool& same)
+{
+    std::vector<std::thread> workers;
+    std::vector<int> mismatches(threads, 0);
+    Clock::time_point start = Clock::now();
+    for (unsigned t = 0; t < threads; ++t)
+        workers.push_back(std::thread([&, t]()
+        {
+            double times[Parameters::TimesCount];
+            double direct[Parameters::TimesCount];
+            for (std::size_t i = t; i < requests.size(); i += threads)
+            {
+                const Request& r = requests[i];
+                const Location location = city(r.city);
+                const Calculator& calculator = calculators[r.calculator];
+                if (!cache)
+                {
+                    calculator.compute_day_times(Query::make(2024, 3, r.day, location), times);
+                    continue;
+                }
+                cache->day_times(calculator, 2024, 3, r.day, location.latitude, location.longitude, location.timezone, times);
+                if (i % 97 == 0)
+                {
+                    calculator.compute_day_times(Query::make(2024, 3, r.day, location), direct);
+                    mismatches[t] += memcmp(times, direct, sizeof(times)) != 0;
+                }
+            }
+        }));
+    for (unsigned t = 0; t < threads; ++t)
+        workers[t].join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (unsigned t = 0; t < threads; ++t)
+        same = same && mismatches[t] == 0;
+    return seconds * 1e9 / requests.size();
+}
+
+int main(int argc, char* argv[])
+{
+    int queries = argc > 1 ? atoi(argv[1]) : 400000;
+    unsigned max_threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+    if (max_threads == 0)
+        max_threads = 1;
+
+    CalcConfig mwl;
+    mwl.method = BUILTIN_METHODS[Parameters::MWL];
+    CalcConfig hanafi;
+    hanafi.asr_juristic = Parameters::Hanafi;
+    const Calculator calculators[2] = { Calculator(mwl), Calculator(hanafi) };
+    bool same = true;
+
+    printf("%d cities x %d days x 2 settings, skewed requests\n\n", NUM_CITIES, NUM_DAYS);
+    printf("capacity  threads  direct ns/q  cached ns/q  hit rate  evictions  memory KiB  rerun ns/q\n");
+    const std::size_t capacities[] = { 1 << 12, 1 << 18 };
+    for (std::size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c)
+        for (unsigned threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2)
+        {
+            std::vector<Request> requests = make_requests(queries * threads, 12345u);
+            ResultCache cache(capacities[c]);
+            double direct = run(calculators, NULL, requests, threads, same);
+            double cached = run(calculators, &cache, requests, threads, same);
+            ResultCache::Stats stats = cache.stats();
+            double rerun = run(calculators, &cache, requests, threads, same);		// warm cache
+            printf("%8zu %8u %12.1f %12.1f %8.1f%% %10llu %11zu %11.1f\n", stats.capacity, threads, direct, cached,
+                   100 * stats.hit_rate(), (unsigned long long) stats.evictions, stats.memory_bytes / 1024, rerun);
+            if (stats.hits + stats.misses != requests.size())
+            {
+                fprintf(stderr, "counted %llu lookups of %zu\n", (unsigned long long) (stats.hits + stats.misses), requests.size());
+                same = false;
+            }
+            if (threads == max_threads)
+                break;
+        }
+
+    if (!same)
+    {
+        fprintf(stderr, "cached times differ from direct computation\n");
+        return 1;
+    }
+    return 0;
+}
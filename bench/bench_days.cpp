@@ -0,0 +1,119 @@
+﻿// Cost of iterating days with DayRange against one get_prayer_times call per
+// day, for a whole year and for a consumer that stops after a few days.
+// Generated days are checked against get_prayer_times, with a fixed offset
+// and with a tz database zone; exits with status 1 on any mismatch.
+//
+// usage: bench_days [locations]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "prayertimes.hpp"
+#include "timezone.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static const int YEAR = 2024;
+static const int DAYS = 365;
+static const int FEW_DAYS = 3;		// what a next-event scheduler typically needs
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool same_times(const double a[], const double b[])
+{
+    for (int p = 0; p < Parameters::TimesCount; ++p)
+        if (std::isnan(a[p]) != std::isnan(b[p]) || fabs(a[p] - b[p]) > 1e-6)
+            return false;
+    return true;
+}
+
+/* compare every generated day with get_prayer_times, using the offset of each day from zone when given */
+static bool check(const PrayerTimes& prayer_times, const Location& location, const TimeZone* zone)
+{
+    int64_t first = CivilCalendar::days_from_civil(YEAR, 1, 1);
+    int d = 0;
+    for (const DayTimes& day : DayRange::days(prayer_times.calculator(), location, YEAR, 1, 1, 2 * DAYS, zone))
+    {
+        int year, month, mday;
+        CivilCalendar::civil_from_days(first + d, year, month, mday);
+        double timezone = zone ? PrayerTimes::get_effective_timezone(*zone, year, month, mday) : location.timezone;
+        double times[Parameters::TimesCount];
+        prayer_times.get_prayer_times(year, month, mday, location.latitude, location.longitude, timezone, times);
+        if (day.year != year || day.month != month || day.day != mday || day.timezone != timezone || !same_times(day.times, times))
+        {
+            fprintf(stderr, "mismatch on %04d-%02d-%02d at %.2f,%.2f\n", year, month, mday, location.latitude, location.longitude);
+            return false;
+        }
+        ++d;
+    }
+    if (d != 2 * DAYS)
+    {
+        fprintf(stderr, "%d days generated instead of %d\n", d, 2 * DAYS);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int num_locations = argc > 1 ? atoi(argv[1]) : 200;
+    PrayerTimes prayer_times(Parameters::MWL, Parameters::Shafii, Parameters::AngleBased);
+
+    bool ok = true;
+    const Location checked[] = { { 51.51, -0.13, 0.0 }, { -33.87, 151.21, 10.0 }, { 69.65, 18.96, 1.0 } };
+    for (const Location& location : checked)
+        ok = check(prayer_times, location, NULL) && ok;
+    const char* zones[] = { "Europe/London", "Australia/Sydney", "Europe/Oslo" };
+    for (int i = 0; i < 3; ++i)
+        if (const TimeZone* zone = TimeZoneDb::system().find(zones[i]))
+            ok = check(prayer_times, checked[i], zone) && ok;
+        else
+            printf("zone %s not found, not checked\n", zones[i]);
+
+    for (int span = DAYS; span >= FEW_DAYS; span = span == DAYS ? FEW_DAYS : 0)
+    {
+        double checksum_single = 0, checksum_days = 0;
+        Clock::time_point start = Clock::now();
+        for (int l = 0; l < num_locations; ++l)
+        {
+            double latitude = -60.0 + 120.0 * l / num_locations;
+            double longitude = -180.0 + 360.0 * l / num_locations;
+            for (int d = 0; d < span; ++d)
+            {
+                double times[Parameters::TimesCount];
+                prayer_times.get_prayer_times(YEAR, 1, 1 + d, latitude, longitude, 0, times);
+                checksum_single += times[Parameters::Dhuhr];
+            }
+        }
+        double single_seconds = seconds_since(start);
+
+        // open-ended ranges, left when enough days were seen
+        start = Clock::now();
+        for (int l = 0; l < num_locations; ++l)
+        {
+            double latitude = -60.0 + 120.0 * l / num_locations;
+            double longitude = -180.0 + 360.0 * l / num_locations;
+            int d = 0;
+            for (const DayTimes& day : prayer_times.get_prayer_times_days(YEAR, 1, 1, latitude, longitude, 0))
+            {
+                checksum_days += day.times[Parameters::Dhuhr];
+                if (++d == span)
+                    break;
+            }
+        }
+        double days_seconds = seconds_since(start);
+
+        double total = (double) num_locations * span;
+        printf("%3d days: get_prayer_times %8.1f ns/day   DayRange %8.1f ns/day   %.2fx   (checksums %.3f %.3f)\n",
+               span, single_seconds * 1e9 / total, days_seconds * 1e9 / total, single_seconds / days_seconds,
+               checksum_single, checksum_days);
+        if (fabs(checksum_single - checksum_days) > 1e-6 * total)
+            ok = false;
+    }
+    return ok ? 0 : 1;
+}
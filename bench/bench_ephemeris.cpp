@@ -0,0 +1,78 @@
+﻿// Accuracy and throughput of the sun position sources against the exact
+// formula over the whole range of the ephemerides. Exits with status 1 when
+// the fitted ephemeris exceeds its documented bound.
+//
+// usage: bench_ephemeris [n]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "ephemeris.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static const double MAX_DECLINATION_ERROR = 1e-9;		// bounds promised in ephemeris.hpp
+static const double MAX_EQ_T_ERROR = 1e-10;
+
+/* equation of time difference, ignoring whole days */
+static double eq_t_error(double a, double b)
+{
+    double d = a - b;
+    return fabs(d - 24.0 * floor(d / 24.0 + 0.5));
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    double first = Calculator::julian_date(FittedEphemeris::FIRST_YEAR, 1, 1);
+    double last = Calculator::julian_date(FittedEphemeris::FIRST_YEAR + FittedEphemeris::YEARS, 1, 1);
+    std::vector<double> jd(n), dec(n), eqt(n), exact_dec(n), exact_eqt(n);
+    srand(1);
+    for (int i = 0; i < n; ++i)
+        jd[i] = first + (last - first) * rand() / ((double) RAND_MAX + 1);
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < n; ++i)
+    {
+        Calculator::DoublePair position = Calculator::exact_sun_position(jd[i]);
+        exact_dec[i] = position.first;
+        exact_eqt[i] = position.second;
+    }
+    double exact_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("%-8s %10.1f ns/op\n", "exact", exact_seconds * 1e9 / n);
+
+    bool ok = true;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const char* name = pass == 0 ? "cached" : "fitted";
+        // the first pass over the range fills the tables, the second one is timed
+        for (int round = 0; round < 2; ++round)
+        {
+            start = Clock::now();
+            for (int i = 0; i < n; ++i)
+            {
+                Calculator::DoublePair position = pass == 0 ? SolarEphemeris::shared().sun_position(jd[i])
+                                                            : FittedEphemeris::shared().sun_position(jd[i]);
+                dec[i] = position.first;
+                eqt[i] = position.second;
+            }
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        double worst_dec = 0, worst_eqt = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            worst_dec = std::max(worst_dec, fabs(dec[i] - exact_dec[i]));
+            worst_eqt = std::max(worst_eqt, eq_t_error(eqt[i], exact_eqt[i]));
+        }
+        printf("%-8s %10.1f ns/op  declination error %9.3g deg  equation of time error %9.3g h (%.3g s)\n",
+               name, seconds * 1e9 / n, worst_dec, worst_eqt, worst_eqt * 3600);
+        if (pass == 1)
+            ok = worst_dec <= MAX_DECLINATION_ERROR && worst_eqt <= MAX_EQ_T_ERROR;
+    }
+    printf("fitted years: %llu\n", (unsigned long long) FittedEphemeris::shared().fitted_years());
+    return ok ? 0 : 1;
+}
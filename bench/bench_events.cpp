@@ -0,0 +1,145 @@
+﻿// EventIndex over many locations: build and rollover time, memory, and the
+// cost of "which locations have a prayer in the next minutes" queries
+// against scanning the times of every location.
+//
+// usage: bench_events [locations] [window minutes]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "eventindex.hpp"
+#include "timezone.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double ms_since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::vector<Location> make_locations(int count)
+{
+    std::vector<Location> locations(count);
+    for (int i = 0; i < count; ++i)
+    {
+        locations[i].latitude = -55.0 + 115.0 * ((i * 7919LL) % count) / count;
+        locations[i].longitude = -180.0 + 360.0 * ((i * 104729LL) % count) / count;
+        locations[i].timezone = floor(locations[i].longitude / 15.0 + 0.5);
+    }
+    return locations;
+}
+
+/* the same events found by computing every indexed day of every location */
+static std::vector<EventIndex::Event> scan(const Calculator& calculator, const std::vector<Location>& locations,
+                                           int64_t first_day, int64_t from, int64_t to, unsigned mask)
+{
+    std::vector<EventIndex::Event> events;
+    for (int k = 0; k < EventIndex::DAYS; ++k)
+    {
+        int year, month, day;
+        CivilCalendar::civil_from_days(first_day + k, year, month, day);
+        for (std::size_t i = 0; i < locations.size(); ++i)
+        {
+            double times[Parameters::TimesCount];
+            calculator.compute_day_times(Query::make(year, month, day, locations[i]), times);
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+            {
+                if (!(mask & (1u << p)) || std::isnan(times[p]))
+                    continue;
+                int64_t utc = (first_day + k) * 86400 + llround((times[p] - locations[i].timezone) * 3600);
+                if (utc >= from && utc < to)
+                {
+                    EventIndex::Event event = { (uint32_t) i, (Parameters::TimeID) p, utc };
+                    events.push_back(event);
+                }
+            }
+        }
+    }
+    return events;
+}
+
+static bool same_events(std::vector<EventIndex::Event> a, std::vector<EventIndex::Event> b)
+{
+    auto less = [](const EventIndex::Event& x, const EventIndex::Event& y)
+    {
+        return x.utc != y.utc ? x.utc < y.utc : x.location != y.location ? x.location < y.location : x.prayer < y.prayer;
+    };
+    std::sort(a.begin(), a.end(), less);
+    std::sort(b.begin(), b.end(), less);
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t i = 0; i < a.size(); ++i)
+        if (a[i].utc != b[i].utc || a[i].location != b[i].location || a[i].prayer != b[i].prayer)
+            return false;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    int window = argc > 2 ? atoi(argv[2]) : 5;
+
+    const std::vector<Location> locations = make_locations(count);
+    const Calculator calculator;
+    EventIndex index(calculator, locations);
+
+    Clock::time_point start = Clock::now();
+    index.build(2024, 3, 10);
+    double build_ms = ms_since(start);
+    printf("%d locations, %zu events, %.1f MiB, build %.0f ms\n", count, index.size(), index.memory_bytes() / 1048576.0, build_ms);
+
+    // every minute of a day and a half from noon UTC of the first day, rolling over as it goes
+    const int MINUTES = 36 * 60;
+    const int64_t noon = index.first_day() * 86400 + 12 * 3600;
+    std::vector<EventIndex::Event> events;
+    const unsigned masks[] = { 1u << Parameters::Maghrib, EventIndex::DEFAULT_MASK };
+    const char* const names[] = { "maghrib", "all" };
+    double rollover_ms = 0;
+    int rollovers = 0;
+    for (int m = 0; m < 2; ++m)
+    {
+        std::size_t found = 0;
+        double query_ns = 0;
+        for (int minute = 0; minute < MINUTES; ++minute)
+        {
+            const int64_t now = noon + minute * 60;
+            if (m == 0)
+            {
+                start = Clock::now();
+                int days = index.roll_over(now);
+                if (days)
+                {
+                    rollover_ms += ms_since(start);
+                    rollovers += days;
+                }
+            }
+            events.clear();
+            start = Clock::now();
+            found += index.query(now, now + window * 60, events, masks[m]);
+            query_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        }
+        printf("%-8s %d minute windows: %8.1f events/query %10.0f ns/query %6.1f ns/event\n", names[m], window,
+               found / (double) MINUTES, query_ns / MINUTES, found ? query_ns / found : 0.0);
+    }
+    if (rollovers)
+        printf("rollover %.0f ms per day (%d)\n", rollover_ms / rollovers, rollovers);
+
+    // against computing every location, for one query after the rollover
+    const int64_t now = noon + MINUTES * 60;
+    events.clear();
+    index.query(now, now + window * 60, events, EventIndex::DEFAULT_MASK);
+    start = Clock::now();
+    std::vector<EventIndex::Event> expected = scan(calculator, locations, index.first_day(), now, now + window * 60,
+                                                   EventIndex::DEFAULT_MASK);
+    printf("scan of every location %.0f ms for %zu events\n", ms_since(start), expected.size());
+    if (!same_events(events, expected))
+    {
+        fprintf(stderr, "index found %zu events, scanning %zu\n", events.size(), expected.size());
+        return 1;
+    }
+    return 0;
+}
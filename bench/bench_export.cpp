@@ -0,0 +1,226 @@
+﻿// Text timetable export: throughput of every format against a plain write of
+// as many bytes, and equality of the output for any number of threads.
+//
+// usage: bench_export [locations] [days] [output file] [max threads]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "exporter.hpp"
+#include "timeformat.hpp"
+#include "timezone.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static std::vector<Location> make_locations(int count)
+{
+    std::vector<Location> locations(count);
+    for (int i = 0; i < count; ++i)
+    {
+        locations[i].latitude = -55.0 + 110.0 * ((i * 7919) % count) / count;
+        locations[i].longitude = -180.0 + 360.0 * ((i * 104729) % count) / count;
+        locations[i].timezone = floor(locations[i].longitude / 15.0 + 0.5);
+    }
+    return locations;
+}
+
+static std::string read_file(const char* path)
+{
+    std::string text;
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return text;
+    char buffer[1 << 16];
+    for (std::size_t n; (n = fread(buffer, 1, sizeof(buffer), f)) > 0; )
+        text.append(buffer, n);
+    fclose(f);
+    return text;
+}
+
+/* MiB/s of writing bytes in 1 MiB blocks to path */
+static double plain_write(const char* path, uint64_t bytes)
+{
+    std::vector<char> block(1 << 20, 'x');
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return 0;
+    Clock::time_point start = Clock::now();
+    for (uint64_t done = 0; done < bytes; done += block.size())
+        if (write(fd, &block[0], std::min<uint64_t>(block.size(), bytes - done)) < 0)
+            break;
+    fsync(fd);
+    close(fd);
+    return bytes / 1048576.0 / std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* the CSV rows of a location written the straightforward way */
+static std::string reference_csv(const Calculator& calculator, const Location& location, std::size_t index, int days)
+{
+    Timetable table(days);
+    calculator.compute_range_times(Query::make(2024, 1, 1, location), table);
+    std::string text;
+    for (int d = 0; d < days; ++d)
+    {
+        int64_t day = CivilCalendar::days_from_civil(2024, 1, 1) + d;
+        int year, month, mday;
+        CivilCalendar::civil_from_days(day, year, month, mday);
+        char row[256];
+        int n = snprintf(row, sizeof(row), "%zu,%.5lf,%.5lf,%04d-%02d-%02d", index, location.latitude, location.longitude, year, month, mday);
+        for (int p = 0; p < Parameters::TimesCount; ++p)
+        {
+            row[n++] = ',';
+            n = TimeFormat::time24(table.at(d, p), row + n) - row;
+        }
+        row[n++] = '\n';
+        text.append(row, n);
+    }
+    return text;
+}
+
+/* check the iCalendar events of a location against its CSV times: every
+   DTSTART shows the CSV minute in local time and follows the previous prayer
+   of its day, also when Isha is past midnight */
+static bool check_ical(const CalcConfig& config, const Location& location, const std::string& path, int days)
+{
+    TimetableExporter exporter(config, TimetableExporter::ICal, 1);
+    exporter.set_stamp(1704067200);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !exporter.write(fd, &location, 1, 2024, 1, 1, days))
+    {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    close(fd);
+    const std::string text = read_file(path.c_str());
+
+    Timetable table(days);
+    Calculator(config).compute_range_times(Query::make(2024, 1, 1, location), table);
+    const int64_t first_day = CivilCalendar::days_from_civil(2024, 1, 1);
+    int64_t previous = 0;
+    int previous_day = -1;
+    std::size_t events = 0;
+    for (std::size_t at = text.find("UID:0-"); at != std::string::npos; at = text.find("UID:0-", at + 1))
+    {
+        int year, month, mday, prayer, hour, minute, second;
+        int uid_year, uid_month, uid_day;
+        std::size_t start = text.find("DTSTART:", at);
+        if (sscanf(text.c_str() + at, "UID:0-%4d%2d%2d-%d", &uid_year, &uid_month, &uid_day, &prayer) != 4
+            || start == std::string::npos
+            || sscanf(text.c_str() + start, "DTSTART:%4d%2d%2dT%2d%2d%2dZ", &year, &month, &mday, &hour, &minute, &second) != 6)
+            return false;
+        const int d = (int) (CivilCalendar::days_from_civil(uid_year, uid_month, uid_day) - first_day);
+        const int64_t utc = CivilCalendar::days_from_civil(year, month, mday) * 86400 + hour * 3600 + minute * 60 + second;
+
+        char shown[TimeFormat::TIME24_SIZE], expected[TimeFormat::TIME24_SIZE];
+        int64_t local = (utc + llround(location.timezone * 3600)) % 86400;
+        TimeFormat::time24(local / 3600.0, shown);
+        TimeFormat::time24(table.at(d, prayer), expected);
+        if (d < 0 || d >= days || memcmp(shown, expected, sizeof(shown)) != 0 || (d == previous_day && utc < previous))
+        {
+            fprintf(stderr, "ics: %04d-%02d-%02d prayer %d starts %04d%02d%02dT%02d%02d%02dZ\n",
+                    uid_year, uid_month, uid_day, prayer, year, month, mday, hour, minute, second);
+            return false;
+        }
+        previous = utc;
+        previous_day = d;
+        ++events;
+    }
+    // Isha of 2024-06-21 is 00:19 local on the next day
+    return events > 0 && text.find("UID:0-20240621-6@qt-salat\r\nDTSTAMP:20240101T000000Z\r\nDTSTART:20240621T221900Z") != std::string::npos;
+}
+
+int main(int argc, char* argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 2000;
+    int days = argc > 2 ? atoi(argv[2]) : 365;
+    std::string path = argc > 3 ? argv[3] : "/tmp/bench_export." + std::to_string(getpid());
+    unsigned max_threads = argc > 4 ? atoi(argv[4]) : std::thread::hardware_concurrency();
+    if (max_threads == 0)
+        max_threads = 1;
+
+    const std::vector<Location> locations = make_locations(count);
+    const CalcConfig config;
+    bool ok = true;
+
+    printf("%d locations x %d days to %s\n", count, days, path.c_str());
+    printf("format  threads        MiB  seconds    MiB/s  plain write MiB/s\n");
+    const TimetableExporter::Format formats[] = { TimetableExporter::Csv, TimetableExporter::Json, TimetableExporter::ICal };
+    for (int f = 0; f < 3; ++f)
+    {
+        std::string first_output;
+        for (unsigned threads = 1; ; threads = threads * 2 > max_threads ? max_threads : threads * 2)
+        {
+            TimetableExporter exporter(config, formats[f], threads);
+            exporter.set_stamp(1704067200);
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            bool written = fd >= 0 && exporter.write(fd, &locations[0], locations.size(), 2024, 1, 1, days);
+            if (fd >= 0)
+            {
+                fsync(fd);
+                close(fd);
+            }
+            const TimetableExporter::Stats& stats = exporter.stats();
+            printf("%-6s %8u %10.1f %8.3f %8.0f %18.0f\n", TimetableExporter::extension(formats[f]), threads,
+                   stats.bytes / 1048576.0, stats.seconds, stats.bytes / 1048576.0 / stats.seconds,
+                   plain_write(path.c_str(), stats.bytes));
+            if (!written)
+            {
+                fprintf(stderr, "%s: write failed\n", TimetableExporter::extension(formats[f]));
+                ok = false;
+            }
+
+            // recomputed after plain_write overwrote it
+            if (written)
+            {
+                fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                exporter.write(fd, &locations[0], locations.size(), 2024, 1, 1, days);
+                close(fd);
+                std::string output = read_file(path.c_str());
+                if (threads == 1)
+                    first_output = output;
+                else if (output != first_output)
+                {
+                    fprintf(stderr, "%s: output of %u threads differs\n", TimetableExporter::extension(formats[f]), threads);
+                    ok = false;
+                }
+            }
+            if (threads >= max_threads)
+                break;
+        }
+
+        if (formats[f] == TimetableExporter::Csv)
+        {
+            const Calculator calculator(config);
+            std::string expected = "location,latitude,longitude,date,fajr,sunrise,dhuhr,asr,sunset,maghrib,isha\n";
+            for (int i = 0; i < count; ++i)
+                expected += reference_csv(calculator, locations[i], i, days);
+            if (expected != first_output)
+            {
+                fprintf(stderr, "csv: output differs from the reference rows\n");
+                ok = false;
+            }
+        }
+    }
+
+    Location late_isha;
+    late_isha.latitude = 42.24;
+    late_isha.longitude = -8.72;
+    late_isha.timezone = 2.0;
+    if (!check_ical(config, late_isha, path, 366))
+    {
+        fprintf(stderr, "ics: events differ from the csv times\n");
+        ok = false;
+    }
+    unlink(path.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+﻿// Throughput of the TimeFormat buffer functions against the std::string
+// formatting of PrayerTimes and the sprintf based formatting it used to have.
+// Exits with status 1 when the outputs differ.
+//
+// usage: bench_format [days]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "prayertimes.hpp"
+#include "timeformat.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* the former PrayerTimes::float_time_to_time24 */
+static std::string sprintf_time24(double time)
+{
+    if (std::isnan(time))
+        return std::string();
+    int hours, minutes;
+    PrayerTimes::get_float_time_parts(time, hours, minutes);
+    return PrayerTimes::two_digits_format(hours) + ':' + PrayerTimes::two_digits_format(minutes);
+}
+
+/* the former PrayerTimes::float_time_to_time12 */
+static std::string sprintf_time12(double time)
+{
+    if (std::isnan(time))
+        return std::string();
+    int hours, minutes;
+    PrayerTimes::get_float_time_parts(time, hours, minutes);
+    const char* suffix = hours >= 12 ? " PM" : " AM";
+    hours = (hours + 12 - 1) % 12 + 1;
+    return PrayerTimes::int_to_string(hours) + ':' + PrayerTimes::two_digits_format(minutes) + suffix;
+}
+
+int main(int argc, char* argv[])
+{
+    int days = argc > 1 ? atoi(argv[1]) : 100000;
+    Timetable table;
+    PrayerTimes prayer_times(Parameters::MWL);
+    prayer_times.get_prayer_times_range(2024, 1, 1, days, 64.1, -21.9, 0.0, table);		// Reykjavik, some NaN times
+    size_t n = table.data.size();
+    bool ok = true;
+
+    // correctness: every path must produce the same text
+    char buf[TimeFormat::TIME12_SIZE];
+    for (size_t i = 0; i < n; ++i)
+    {
+        double t = table.data[i];
+        ok &= sprintf_time24(t) == std::string(buf, TimeFormat::time24(t, buf));
+        ok &= sprintf_time12(t) == std::string(buf, TimeFormat::time12(t, buf));
+        ok &= sprintf_time24(t) == PrayerTimes::float_time_to_time24(t);
+        ok &= sprintf_time12(t) == PrayerTimes::float_time_to_time12(t);
+    }
+
+    size_t bytes = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; ++i)
+        bytes += sprintf_time24(table.data[i]).size();
+    double sprintf_seconds = seconds_since(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i)
+        bytes += PrayerTimes::float_time_to_time24(table.data[i]).size();
+    double string_seconds = seconds_since(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i)
+        bytes += TimeFormat::time24(table.data[i], buf) - buf;
+    double buffer_seconds = seconds_since(start);
+
+    std::vector<char> text(TimeFormat::timetable_size(table, true));
+    start = Clock::now();
+    char* end = TimeFormat::timetable(table, 2024, 1, 1, &text[0]);
+    double table_seconds = seconds_since(start);
+    bytes += end - &text[0];
+    ok &= (size_t) (end - &text[0]) == text.size();
+
+    printf("%d days, %zu times (checksum %zu)\n", days, n, bytes);
+    printf("sprintf     %8.1f Mtimes/s\n", n / sprintf_seconds / 1e6);
+    printf("std::string %8.1f Mtimes/s\n", n / string_seconds / 1e6);
+    printf("buffer      %8.1f Mtimes/s\n", n / buffer_seconds / 1e6);
+    printf("timetable   %8.1f Mtimes/s  %.1f MB/s\n", n / table_seconds / 1e6, text.size() / table_seconds / 1e6);
+    printf("first line: %.*s", (int) TimeFormat::DATED_ROW_SIZE, &text[0]);
+    if (!ok)
+        printf("MISMATCH between formatting paths\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+﻿// Generation time, lookup rate and accuracy of GridTile against exact
+// computation at random points. Exits with status 1 when an interpolated
+// time is off by more than the tile's error bound.
+//
+// usage: bench_grid [queries] [max error seconds] [step degrees]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "gridtile.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    int num_queries = argc > 1 ? atoi(argv[1]) : 1000000;
+    double max_error = argc > 2 ? atof(argv[2]) : 10.0;
+    double step = argc > 3 ? atof(argv[3]) : 1.0;
+    const char* path = "bench_grid.tile";
+
+    CalcConfig config;
+    config.adjust_high_lats = Parameters::AngleBased;
+    GridSpec spec;
+    spec.south = -60.0;
+    spec.west = -30.0;
+    spec.lat_step = step;
+    spec.lon_step = step;
+    spec.rows = (int) (130.0 / step) + 1;		// up to 70 north, past the arctic circle
+    spec.cols = (int) (90.0 / step) + 1;
+    spec.year = 2024;
+    spec.month = 6;
+    spec.day = 1;
+    spec.days = 30;
+    spec.max_error = max_error;
+
+    Clock::time_point start = Clock::now();
+    if (!GridTile::generate(path, config, spec))
+    {
+        fprintf(stderr, "Error: Cannot write '%s'\n", path);
+        return 2;
+    }
+    double generate_seconds = seconds_since(start);
+
+    GridTile tile;
+    if (!tile.open(path))
+    {
+        fprintf(stderr, "Error: Cannot read '%s'\n", path);
+        return 2;
+    }
+    printf("grid %dx%d, %d days, bound %.1f s: generated in %.2f s, %.1f%% cells exact, measured %.2f s\n",
+           spec.rows, spec.cols, spec.days, max_error, generate_seconds, 100.0 * tile.exact_share(), tile.measured_error());
+
+    struct Point { double latitude, longitude; int day; };
+    std::vector<Point> points(num_queries);
+    srand(1);
+    for (int i = 0; i < num_queries; ++i)
+    {
+        points[i].latitude = spec.south + (spec.rows - 1) * step * rand() / RAND_MAX;
+        points[i].longitude = spec.west + (spec.cols - 1) * step * rand() / RAND_MAX;
+        points[i].day = rand() % spec.days;
+    }
+
+    double checksum = 0;
+    int interpolated = 0;
+    start = Clock::now();
+    for (int i = 0; i < num_queries; ++i)
+    {
+        double times[Parameters::TimesCount];
+        interpolated += tile.times(points[i].latitude, points[i].longitude, points[i].day, 0.0, times) == GridTile::Interpolated;
+        checksum += times[Parameters::Dhuhr];
+    }
+    double tile_seconds = seconds_since(start);
+
+    const Calculator calculator(config);
+    int exact_queries = std::min(num_queries, 200000);
+    double worst = 0;
+    start = Clock::now();
+    for (int i = 0; i < exact_queries; ++i)
+    {
+        double times[Parameters::TimesCount];
+        calculator.compute_day_times(Query::make(spec.year, spec.month, spec.day + points[i].day, points[i].latitude, points[i].longitude, 0.0), times);
+        checksum += times[Parameters::Dhuhr];
+    }
+    double exact_seconds = seconds_since(start);
+
+    for (int i = 0; i < exact_queries; ++i)
+    {
+        double expected[Parameters::TimesCount], actual[Parameters::TimesCount];
+        calculator.compute_day_times(Query::make(spec.year, spec.month, spec.day + points[i].day, points[i].latitude, points[i].longitude, 0.0), expected);
+        if (tile.times(points[i].latitude, points[i].longitude, points[i].day, 0.0, actual) != GridTile::Interpolated)
+            continue;
+        for (int k = 0; k < Parameters::TimesCount; ++k)
+            worst = std::max(worst, fabs(expected[k] - actual[k]) * 3600.0);
+    }
+
+    printf("tile  %10.0f queries/s (%.1f%% interpolated)\n", num_queries / tile_seconds, 100.0 * interpolated / num_queries);
+    printf("exact %10.0f queries/s\n", exact_queries / exact_seconds);
+    printf("worst interpolation error %.3f s (checksum %.1f)\n", worst, checksum);
+    remove(path);
+    return worst <= max_error ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+﻿// Per-instance size and construction time of the calculator classes.
+//
+// usage: bench_instance [instances]
+//
+// Built a second time as bench_instance_qt with QPrayerTimes when Qt5Core is
+// available.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "prayertimes.hpp"
+#ifdef WITH_QT
+#include "qprayertimes.hpp"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+template <class T>
+static void measure(const char* name, int n)
+{
+    std::vector<std::unique_ptr<T> > instances(n);
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < n; ++i)
+        instances[i].reset(new T);
+    double construct = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+
+    start = Clock::now();
+    instances.clear();
+    double destroy = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+
+    printf("%-14s %6zu bytes  construct %8.1f ns  destroy %8.1f ns\n", name, sizeof(T), construct, destroy);
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    printf("%d heap instances each\n", n);
+    measure<PrayerTimes>("PrayerTimes", n);
+    measure<Calculator>("Calculator", n);
+#ifdef WITH_QT
+    measure<QPrayerTimes>("QPrayerTimes", n);
+#endif
+    return 0;
+}
@@ -0,0 +1,98 @@
+﻿// Several profiles for the same place and day: ProfileSet against one
+// compute_day_times per profile, and the cost of every additional profile.
+//
+// usage: bench_multi [locations]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "profileset.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+/* conventions shown side by side, in the order they are added */
+static std::vector<CalcProfile> conventions()
+{
+    static const Parameters::CalculationMethod methods[] =
+        { Parameters::MWL, Parameters::ISNA, Parameters::Egypt, Parameters::Karachi, Parameters::Makkah, Parameters::Jafari };
+    std::vector<CalcProfile> profiles;
+    for (int j = 0; j < 2; ++j)
+        for (int m = 0; m < 6; ++m)
+            profiles.push_back(CalcProfile::make(methods[m], (Parameters::JuristicMethod) j,
+                                                 m % 2 ? Parameters::AngleBased : Parameters::MidNight));
+    profiles.push_back(CalcProfile::custom(Parameters::MethodConfig(17.7, false, 4.5, true, 75.0)));
+    profiles.push_back(CalcProfile::make(Parameters::MWL, Parameters::Shafii, Parameters::OneSeventh, 2.0));
+    profiles.back().ephemeris = Parameters::FittedEphemeris;
+    profiles.push_back(CalcProfile::make(Parameters::ISNA));
+    profiles.back().precision = Parameters::PreciseTier;		// computed on its own
+    return profiles;
+}
+
+static std::vector<Query> make_queries(int count)
+{
+    std::vector<Query> queries(count);
+    for (int i = 0; i < count; ++i)
+    {
+        double latitude = -60.0 + 125.0 * ((i * 7919) % count) / count;
+        double longitude = -180.0 + 360.0 * ((i * 104729) % count) / count;
+        queries[i] = Query::make(2024, 1 + i % 12, 1 + i % 28, latitude, longitude, floor(longitude / 15.0 + 0.5));
+    }
+    return queries;
+}
+
+int main(int argc, char* argv[])
+{
+    int locations = argc > 1 ? atoi(argv[1]) : 20000;
+    const std::vector<CalcProfile> all = conventions();
+    const std::vector<Query> queries = make_queries(locations);
+    std::vector<double> separate(all.size() * Parameters::TimesCount);
+    std::vector<double> shared(all.size() * Parameters::TimesCount);
+    int mismatches = 0;
+
+    printf("%d locations\n", locations);
+    printf("profiles  separate ns  shared ns  speedup  per extra profile ns\n");
+    double shared_one = 0;
+    for (std::size_t n = 1; n <= all.size(); ++n)
+    {
+        std::vector<CalcProfile> profiles(all.begin(), all.begin() + n);
+        ProfileSet set(profiles);
+        std::vector<Calculator> calculators(profiles.begin(), profiles.end());
+
+        Clock::time_point start = Clock::now();
+        for (int q = 0; q < locations; ++q)
+            for (std::size_t i = 0; i < n; ++i)
+                calculators[i].compute_day_times(queries[q], &separate[i * Parameters::TimesCount]);
+        double separate_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / locations;
+
+        start = Clock::now();
+        for (int q = 0; q < locations; ++q)
+            set.compute_day_times(queries[q], &shared[0]);
+        double shared_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / locations;
+
+        for (int q = 0; q < locations; q += 7)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+                calculators[i].compute_day_times(queries[q], &separate[i * Parameters::TimesCount]);
+            set.compute_day_times(queries[q], &shared[0]);
+            mismatches += memcmp(&separate[0], &shared[0], n * Parameters::TimesCount * sizeof(double)) != 0;
+        }
+
+        if (n == 1)
+            shared_one = shared_ns;
+        printf("%8zu %12.1f %10.1f %7.2fx", n, separate_ns, shared_ns, separate_ns / shared_ns);
+        if (n > 1)
+            printf(" %21.1f", (shared_ns - shared_one) / (n - 1));
+        printf("\n");
+    }
+
+    if (mismatches)
+    {
+        fprintf(stderr, "%d days differ between ProfileSet and compute_day_times\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
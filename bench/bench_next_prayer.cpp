@@ -0,0 +1,144 @@
+﻿// Latency of PrayerIndex lookups against computing the day and scanning its
+// times, which is what a caller does without the index. Lookups are checked
+// against a brute force scan of freshly computed days; exits with status 1
+// on any mismatch.
+//
+// usage: bench_next_prayer [queries]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "prayerindex.hpp"
+#include "prayertimes.hpp"
+#include "timezone.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Place
+{
+    const char* name;
+    double latitude;
+    double longitude;
+    const char* zone;
+    Parameters::AdjustingMethod adjust;
+};
+
+static const Place places[] =
+{
+    { "london",     51.51, -0.13, "Europe/London",      Parameters::AngleBased },
+    { "new york",   40.71, -74.0, "America/New_York",   Parameters::AngleBased },
+    { "sydney",    -33.87, 151.2, "Australia/Sydney",   Parameters::AngleBased },
+    { "tromso",     69.65, 18.96, "Europe/Oslo",        Parameters::None },		// undefined times in summer
+};
+
+static const int64_t DAY = 86400;
+
+static volatile int64_t sink;		// keeps the timed loops
+
+/* first event after utc by computing the surrounding UTC days */
+static bool brute_force(const Calculator& calculator, const Place& place, int64_t utc, Parameters::TimeID& next, int64_t& next_start)
+{
+    std::vector<std::pair<int64_t, int> > events;
+    int64_t today = utc >= 0 ? utc / DAY : (utc - DAY + 1) / DAY;
+    for (int64_t d = today - 1; d <= today + 1; ++d)
+    {
+        int year, month, day;
+        CivilCalendar::civil_from_days(d, year, month, day);
+        double times[Parameters::TimesCount];
+        calculator.compute_day_times(Query::make(year, month, day, place.latitude, place.longitude, 0.0), times);
+        for (int i = 0; i < Parameters::TimesCount; ++i)
+            if ((PrayerIndex::DEFAULT_MASK & (1 << i)) && !std::isnan(times[i]))
+                events.push_back(std::make_pair(d * DAY + llround(times[i] * 3600), i));
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const std::pair<int64_t, int>& a, const std::pair<int64_t, int>& b) { return a.first < b.first; });
+    for (std::size_t i = 0; i < events.size(); ++i)
+        if (events[i].first > utc)
+        {
+            next = (Parameters::TimeID) events[i].second;
+            next_start = events[i].first;
+            return true;
+        }
+    return false;
+}
+
+/* the usual approach: compute today in local time, or tomorrow after Isha */
+static int64_t scan_next(const PrayerTimes& prayer_times, const Place& place, const TimeZone* zone, int64_t utc)
+{
+    int32_t offset = zone ? zone->utc_offset(utc) : 0;
+    int64_t local = utc + offset;
+    int64_t today = local / DAY;
+    for (int64_t d = today; d <= today + 1; ++d)
+    {
+        int year, month, day;
+        CivilCalendar::civil_from_days(d, year, month, day);
+        double times[Parameters::TimesCount];
+        prayer_times.get_prayer_times(year, month, day, place.latitude, place.longitude, offset / 3600.0, times);
+        double now = (local - d * DAY) / 3600.0;
+        for (int i = 0; i < Parameters::TimesCount; ++i)
+            if (i != Parameters::Sunset && times[i] > now)
+                return (int64_t) ((times[i] - now) * 3600);
+    }
+    return -1;
+}
+
+int main(int argc, char* argv[])
+{
+    int num_queries = argc > 1 ? atoi(argv[1]) : 1000000;
+    const int num_days = 366;
+    bool ok = true;
+
+    printf("%-10s %8s %12s %12s %10s\n", "place", "events", "index ns", "scan ns", "mismatches");
+    for (const Place& place : places)
+    {
+        PrayerTimes prayer_times(Parameters::MWL, Parameters::Shafii, place.adjust);
+        Calculator calculator = prayer_times.calculator();
+        PrayerIndex index = PrayerIndex::make(calculator, 2024, 1, 1, num_days, place.latitude, place.longitude);
+        const TimeZone* zone = TimeZoneDb::system().find(place.zone);
+
+        std::vector<int64_t> instants(num_queries);
+        srand(1);
+        int64_t span = index.last_event() - index.first_event();
+        for (int i = 0; i < num_queries; ++i)
+            instants[i] = index.first_event() + (int64_t) ((double) rand() / ((double) RAND_MAX + 1) * span);
+
+        int64_t checksum = 0;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < num_queries; ++i)
+        {
+            PrayerIndex::Position position;
+            if (index.lookup(instants[i], position))
+                checksum += position.seconds_until;
+        }
+        double index_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / num_queries;
+
+        int scan_queries = std::min(num_queries, 100000);
+        start = Clock::now();
+        for (int i = 0; i < scan_queries; ++i)
+            checksum += scan_next(prayer_times, place, zone, instants[i]);
+        double scan_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / scan_queries;
+
+        // correctness, away from the ends of the indexed range
+        int mismatches = 0;
+        for (int i = 0; i < std::min(num_queries, 20000); ++i)
+        {
+            int64_t utc = instants[i];
+            if (utc < index.first_event() + 2 * DAY || utc > index.last_event() - 2 * DAY)
+                continue;
+            PrayerIndex::Position position;
+            Parameters::TimeID next;
+            int64_t next_start;
+            if (!index.lookup(utc, position) || !brute_force(calculator, place, utc, next, next_start)
+                || position.next != next || llabs(position.next_start - next_start) > 1)
+                ++mismatches;
+        }
+        ok &= mismatches == 0;
+        printf("%-10s %8zu %12.1f %12.1f %10d\n", place.name, index.size(), index_ns, scan_ns, mismatches);
+        sink = checksum;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+﻿// Speed and accuracy of the precision tiers.
+//
+// Every tier computes every day of a year at latitudes from the equator to
+// the polar circle, once per day and once as a timetable. Errors are taken
+// against times refined by REFERENCE_PASSES passes of compute_times, without
+// high latitude adjustment, so they show how far each tier is from the
+// converged astronomical times. A time that is
+// undefined in one tier but not in the other is counted apart. Exits with
+// status 1 when the default tier no longer matches its range version or a
+// tier exceeds its bound.
+//
+// usage: bench_precision [year]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "calculator.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* const TIER_NAMES[] = { "fast", "default", "precise" };
+static const char* const TIME_NAMES[] = { "fajr", "sunrise", "dhuhr", "asr", "sunset", "maghrib", "isha" };
+static const double MAX_ERROR[] = { 60.0, 15.0, 0.01 };		// seconds, bound of each tier up to BOUND_LATITUDE
+static const double BOUND_LATITUDE = 45.0;		// beyond, twilight angles barely reached make every tier diverge
+static const int REFERENCE_PASSES = 20;
+
+static const double LATITUDES[] = { 0.0, 21.4, 35.7, 48.9, 55.8, 60.2, 64.1 };
+static const int NUM_LATITUDES = sizeof(LATITUDES) / sizeof(LATITUDES[0]);
+static const int DAYS = 365;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    int year = argc > 1 ? atoi(argv[1]) : 2024;
+
+    CalcConfig config;
+    config.adjust_high_lats = Parameters::None;
+    config.method = Parameters::MethodConfig(18.0, false, 4.0, false, 17.0);		// every time from an angle
+
+    // converged times, from many more passes than the precise tier may take
+    Timetable reference[NUM_LATITUDES];
+    {
+        const Calculator calculator(config);
+        for (int l = 0; l < NUM_LATITUDES; ++l)
+        {
+            reference[l].resize(DAYS);
+            for (int d = 0; d < DAYS; ++d)
+            {
+                Query query = Query::make(year, 1, 1 + d, LATITUDES[l], 0, 0);
+                double times[] = { 5, 6, 12, 13, 18, 18, 18 };
+                for (int i = 0; i < REFERENCE_PASSES; ++i)
+                    calculator.compute_times(query, times);
+                calculator.adjust_times(query, times);
+                for (int p = 0; p < Parameters::TimesCount; ++p)
+                    reference[l].times(p)[d] = times[p];
+            }
+        }
+    }
+
+    bool ok = true;
+    printf("%-8s %12s %12s\n", "tier", "ns/day", "ns/day range");
+    double worst[3][Parameters::TimesCount][NUM_LATITUDES];
+    int undefined[3][NUM_LATITUDES];
+    for (int tier = 0; tier < 3; ++tier)
+    {
+        CalcConfig tier_config = config;
+        tier_config.precision = (Parameters::PrecisionTier) tier;
+        const Calculator calculator(tier_config);
+        double checksum = 0;
+
+        Clock::time_point start = Clock::now();
+        Timetable single(DAYS);
+        for (int l = 0; l < NUM_LATITUDES; ++l)
+            for (int d = 0; d < DAYS; ++d)
+            {
+                double times[Parameters::TimesCount];
+                calculator.compute_day_times(Query::make(year, 1, 1 + d, LATITUDES[l], 0, 0), times);
+                checksum += times[Parameters::Dhuhr];
+                if (l == NUM_LATITUDES - 1)
+                    for (int p = 0; p < Parameters::TimesCount; ++p)
+                        single.times(p)[d] = times[p];
+            }
+        double single_seconds = seconds_since(start);
+
+        Timetable table(DAYS);
+        start = Clock::now();
+        for (int l = 0; l < NUM_LATITUDES; ++l)
+        {
+            calculator.compute_range_times(Query::make(year, 1, 1, LATITUDES[l], 0, 0), table);
+            checksum += table.at(0, Parameters::Dhuhr);
+
+            undefined[tier][l] = 0;
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+            {
+                worst[tier][p][l] = 0;
+                for (int d = 0; d < DAYS; ++d)
+                {
+                    double a = table.at(d, p), b = reference[l].at(d, p);
+                    if (std::isnan(a) != std::isnan(b))
+                        ++undefined[tier][l];
+                    else if (!std::isnan(a))
+                        worst[tier][p][l] = std::max(worst[tier][p][l], fabs(a - b) * 3600);
+                }
+                if (LATITUDES[l] <= BOUND_LATITUDE && worst[tier][p][l] > MAX_ERROR[tier])
+                    ok = false;
+            }
+        }
+        double range_seconds = seconds_since(start);
+
+        // the day by day and range versions of a tier must agree
+        for (int d = 0; d < DAYS; ++d)
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+            {
+                double a = single.at(d, p), b = table.at(d, p);
+                if (std::isnan(a) != std::isnan(b) || fabs(a - b) > 1e-6)
+                    ok = false;
+            }
+
+        printf("%-8s %12.1f %12.1f   (checksum %.3f)\n", TIER_NAMES[tier],
+               single_seconds * 1e9 / (NUM_LATITUDES * DAYS), range_seconds * 1e9 / (NUM_LATITUDES * DAYS), checksum);
+    }
+
+    for (int tier = 0; tier < 3; ++tier)
+    {
+        printf("\n%s tier, largest error in seconds over %d against converged times\n", TIER_NAMES[tier], year);
+        printf("%-9s", "latitude");
+        for (int p = 0; p < Parameters::TimesCount; ++p)
+            printf(" %9s", TIME_NAMES[p]);
+        printf(" %9s\n", "undefined");
+        for (int l = 0; l < NUM_LATITUDES; ++l)
+        {
+            printf("%-9.1f", LATITUDES[l]);
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+                printf(" %9.3f", worst[tier][p][l]);
+            printf(" %9d\n", undefined[tier][l]);
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+﻿// Memory of one calculation profile per user for many users, and cost of
+// computing a day of times from a CalcProfile passed by value.
+//
+// usage: bench_profiles [profiles]
+//
+// The baseline row mirrors the members of PrayerTimes before the calculation
+// core was split out: a QObject, a copy of every method's settings and the
+// location of the last query.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "prayertimes.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+struct BaselinePrayerTimes
+{
+    void* qobject[2];		// vtable and d-pointer of QObject
+    Parameters params;
+    Parameters::MethodConfig method_params[Parameters::CalculationMethodsCount];
+    Parameters::CalculationMethod calc_method;
+    Parameters::JuristicMethod asr_juristic;
+    Parameters::AdjustingMethod adjust_high_lats;
+    double dhuhr_minutes;
+    double latitude;
+    double longitude;
+    double timezone;
+    double julian_date;
+};
+
+static std::size_t resident_bytes()
+{
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return (std::size_t) resident * sysconf(_SC_PAGESIZE);
+}
+
+/* resident memory of n instances in one array and as n heap objects, measured
+   in a child process so that no row reuses heap freed by an earlier one */
+template <class T>
+static void measure(const char* name, int n)
+{
+    fflush(stdout);
+    pid_t child = fork();
+    if (child != 0)
+    {
+        if (child > 0)
+            waitpid(child, NULL, 0);
+        return;
+    }
+
+    std::size_t before = resident_bytes();
+    unsigned char* array = (unsigned char*) malloc(sizeof(T) * n);
+    memset(array, 1, sizeof(T) * n);		// touch every page
+    double array_mib = (resident_bytes() - before) / 1048576.0;
+
+    before = resident_bytes();
+    std::vector<unsigned char*> objects(n);
+    for (int i = 0; i < n; ++i)
+    {
+        objects[i] = (unsigned char*) malloc(sizeof(T));
+        memset(objects[i], 1, sizeof(T));
+    }
+    double heap_mib = (resident_bytes() - before) / 1048576.0;
+
+    printf("%-20s %6zu %12.1f %12.1f\n", name, sizeof(T), array_mib, heap_mib);
+    fflush(stdout);
+    _exit(0);
+}
+
+/* a random profile: mostly built-in methods, some custom angles */
+static CalcProfile make_profile(unsigned& seed)
+{
+    seed = seed * 1103515245u + 12345u;
+    CalcProfile profile = CalcProfile::make((Parameters::CalculationMethod) ((seed >> 8) % Parameters::CalculationMethodsCount),
+                                            (Parameters::JuristicMethod) ((seed >> 12) & 1),
+                                            (Parameters::AdjustingMethod) ((seed >> 13) & 3),
+                                            (seed >> 15) % 4 == 0 ? 1.5 : 0.0);
+    if (profile.method == Parameters::Custom)
+        profile.set_overrides(Parameters::MethodConfig(15.0 + (seed >> 17) % 50 * 0.1, (seed >> 24) & 1, 4.5,
+                                                       (seed >> 25) & 1, (seed >> 25) & 1 ? 90.0 : 17.7));
+    return profile;
+}
+
+static bool same_config(const CalcConfig& a, const CalcConfig& b)
+{
+    return a.method.fajr_angle == b.method.fajr_angle && a.method.maghrib_is_minutes == b.method.maghrib_is_minutes
+        && a.method.maghrib_value == b.method.maghrib_value && a.method.isha_is_minutes == b.method.isha_is_minutes
+        && a.method.isha_value == b.method.isha_value && a.asr_juristic == b.asr_juristic
+        && a.adjust_high_lats == b.adjust_high_lats && a.dhuhr_minutes == b.dhuhr_minutes
+        && a.ephemeris == b.ephemeris && a.precision == b.precision;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    printf("%d profiles\n", n);
+    printf("layout                bytes    array MiB     heap MiB\n");
+    measure<BaselinePrayerTimes>("PrayerTimes baseline", n);
+    measure<PrayerTimes>("PrayerTimes", n);
+    measure<CalcConfig>("CalcConfig", n);
+    measure<CalcProfile>("CalcProfile", n);
+
+    std::vector<CalcProfile> profiles(n);
+    unsigned seed = 12345u;
+    for (int i = 0; i < n; ++i)
+        profiles[i] = make_profile(seed);
+
+    // a day of times per profile, through the profile and through PrayerTimes
+    const Query query = Query::make(2024, 3, 20, 52.5, 13.4, 1.0);
+    double times[Parameters::TimesCount];
+    double expected[Parameters::TimesCount];
+    double checksum = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < n; ++i)
+    {
+        Calculator(profiles[i]).compute_day_times(query, times);
+        checksum += times[Parameters::Isha];
+    }
+    double by_profile = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+
+    int mismatches = 0;
+    PrayerTimes settings;
+    start = Clock::now();
+    for (int i = 0; i < n; ++i)
+    {
+        settings.set_profile(profiles[i]);
+        settings.get_prayer_times(2024, 3, 20, 52.5, 13.4, 1.0, expected);
+        Calculator(profiles[i]).compute_day_times(query, times);
+        mismatches += memcmp(times, expected, sizeof(times)) != 0;
+        mismatches += !same_config(settings.profile().config(), settings.config());
+    }
+    double checked = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+
+    printf("\nday times from a profile %8.1f ns  (checked against PrayerTimes %8.1f ns)  checksum %.3f\n",
+           by_profile, checked, checksum);
+    if (mismatches)
+    {
+        fprintf(stderr, "%d profiles differ from the PrayerTimes settings they came from\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
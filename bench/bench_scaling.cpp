@@ -0,0 +1,54 @@
+﻿// Scaling of BulkExecutor from one thread to all hardware threads.
+//
+// usage: bench_scaling [locations] [days] [max threads]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "executor.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char* argv[])
+{
+    int num_locations = argc > 1 ? atoi(argv[1]) : 2000;
+    int num_days = argc > 2 ? atoi(argv[2]) : 365;
+    unsigned max_threads = argc > 3 ? atoi(argv[3]) : std::thread::hardware_concurrency();
+    if (max_threads == 0)
+        max_threads = 1;
+
+    std::vector<Location> locations(num_locations);
+    for (int i = 0; i < num_locations; ++i)
+    {
+        locations[i].latitude = -65.0 + 130.0 * i / num_locations;
+        locations[i].longitude = -180.0 + 360.0 * ((i * 7919) % num_locations) / num_locations;
+        locations[i].timezone = (int) (locations[i].longitude / 15.0);
+    }
+
+    CalcConfig config;
+    config.adjust_high_lats = Parameters::AngleBased;
+    const Calculator calculator(config);
+    std::vector<Timetable> tables(num_locations);
+    const double total_days = (double) num_locations * num_days;
+
+    printf("%d locations x %d days\n", num_locations, num_days);
+    printf("threads      days/s   speedup\n");
+    double base_rate = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2)
+    {
+        BulkExecutor executor(threads);
+        Clock::time_point start = Clock::now();
+        executor.run(calculator, &locations[0], locations.size(), 2024, 1, 1, num_days, &tables[0]);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double rate = total_days / seconds;
+        if (threads == 1)
+            base_rate = rate;
+        printf("%7u %11.0f %8.2fx\n", threads, rate, rate / base_rate);
+        if (threads == max_threads)
+            break;
+    }
+    return 0;
+}
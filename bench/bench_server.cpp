@@ -0,0 +1,257 @@
+﻿// Load generator of the query server: closed-loop clients, one request in
+// flight per connection, reporting throughput and latency percentiles of the
+// binary and the JSON protocol.
+//
+// usage: bench_server [address] [connections] [requests per connection]
+//
+// Without an address (or with "-") a server is started in-process on a Unix
+// socket and every answer is checked against direct computation.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Request
+{
+    BinaryQuery query;
+    std::string line;		// the same query as JSON
+};
+
+struct ClientResult
+{
+    std::vector<double> latencies;		// microseconds
+    uint64_t mismatches;
+    bool failed;
+};
+
+static int connect_to(const std::string& address)
+{
+    int fd;
+    if (address.find('/') != std::string::npos)
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*) &addr, sizeof(addr)) == 0)
+            return fd;
+    }
+    else
+    {
+        std::size_t colon = address.rfind(':');
+        std::string host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t) atoi(address.c_str() + (colon == std::string::npos ? 0 : colon + 1)));
+        inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if (fd >= 0 && connect(fd, (sockaddr*) &addr, sizeof(addr)) == 0)
+            return fd;
+    }
+    perror("connect");
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+static bool send_all(int fd, const void* data, std::size_t size)
+{
+    for (std::size_t done = 0; done < size; )
+    {
+        ssize_t n = send(fd, (const char*) data + done, size - done, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+/* the query of request i of a client, and its expected answers when checked */
+static Request make_request(unsigned seed, int i)
+{
+    Request request;
+    memset(&request.query, 0, sizeof(request.query));
+    unsigned h = seed * 2654435761u + i * 40503u;
+    request.query.magic = QueryServer::QUERY_MAGIC;
+    request.query.id = i;
+    request.query.latitude = -60.0 + (h % 12000) * 0.01;
+    request.query.longitude = -180.0 + ((h / 12000) % 36000) * 0.01;
+    request.query.timezone = floor(request.query.longitude / 15.0 + 0.5);
+    request.query.year = 2024;
+    request.query.month = 1 + (h >> 7) % 12;
+    request.query.day = 1 + (h >> 11) % 28;
+    request.query.method = (int8_t) ((h >> 3) % Parameters::CalculationMethodsCount);
+    request.query.asr = -1;
+    request.query.high_lats = -1;
+
+    static const char* const methods[] = { "jafari", "karachi", "isna", "mwl", "makkah", "egypt", "custom" };
+    char line[256];
+    snprintf(line, sizeof(line), "{\"lat\":%.2f,\"lon\":%.2f,\"date\":\"%04d-%02d-%02d\",\"tz\":%g,\"method\":\"%s\"}\n",
+             request.query.latitude, request.query.longitude, request.query.year, request.query.month, request.query.day,
+             request.query.timezone, methods[request.query.method]);
+    request.line = line;
+    return request;
+}
+
+static void expected_times(const PrayerTimes& defaults, const BinaryQuery& query, double times[])
+{
+    PrayerTimes settings(defaults);
+    settings.set_calc_method((Parameters::CalculationMethod) query.method);
+    settings.calculator().compute_day_times(Query::make(query.year, query.month, query.day, query.latitude,
+                                                        query.longitude, query.timezone), times);
+}
+
+static void run_client(const std::string& address, bool binary, int requests, unsigned seed,
+                       const PrayerTimes* check, ClientResult& result)
+{
+    result.mismatches = 0;
+    result.failed = true;
+    result.latencies.reserve(requests);
+    int fd = connect_to(address);
+    if (fd < 0)
+        return;
+
+    std::string pending;
+    char buffer[4096];
+    for (int i = 0; i < requests; ++i)
+    {
+        Request request = make_request(seed, i);
+        Clock::time_point start = Clock::now();
+        if (!(binary ? send_all(fd, &request.query, sizeof(request.query)) : send_all(fd, request.line.data(), request.line.size())))
+            break;
+
+        std::string answer;
+        for (;;)
+        {
+            std::size_t end = binary ? (pending.size() >= sizeof(BinaryResult) ? sizeof(BinaryResult) : std::string::npos)
+                                     : pending.find('\n');
+            if (end != std::string::npos)
+            {
+                answer = pending.substr(0, end);
+                pending.erase(0, binary ? end : end + 1);
+                break;
+            }
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0)
+            {
+                close(fd);
+                return;
+            }
+            pending.append(buffer, n);
+        }
+        result.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+
+        if (!check)
+            continue;
+        double times[Parameters::TimesCount];
+        expected_times(*check, request.query, times);
+        if (binary)
+        {
+            BinaryResult got;
+            memcpy(&got, answer.data(), sizeof(got));
+            bool same = got.magic == QueryServer::RESULT_MAGIC && got.id == request.query.id && got.status == QueryServer::Ok;
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+                same = same && (got.times[p] == times[p] || (std::isnan(got.times[p]) && std::isnan(times[p])));
+            result.mismatches += !same;
+        }
+        else
+        {
+            char line[RecordParser::MAX_ROW_SIZE];
+            char* end = RecordParser::format_day(RecordParser::NdJson, i + 1, request.query.year, request.query.month,
+                                                 request.query.day, times, line);
+            result.mismatches += answer != std::string(line, end);
+        }
+    }
+    close(fd);
+    result.failed = (int) result.latencies.size() != requests;
+}
+
+static bool run_load(const std::string& address, bool binary, int connections, int requests, const PrayerTimes* check)
+{
+    std::vector<ClientResult> results(connections);
+    std::vector<std::thread> clients;
+    Clock::time_point start = Clock::now();
+    for (int c = 0; c < connections; ++c)
+        clients.push_back(std::thread(run_client, address, binary, requests, (unsigned) c + 1, check, std::ref(results[c])));
+    for (std::size_t c = 0; c < clients.size(); ++c)
+        clients[c].join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latencies;
+    uint64_t mismatches = 0;
+    bool failed = false;
+    for (int c = 0; c < connections; ++c)
+    {
+        latencies.insert(latencies.end(), results[c].latencies.begin(), results[c].latencies.end());
+        mismatches += results[c].mismatches;
+        failed = failed || results[c].failed;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    if (latencies.empty())
+    {
+        fprintf(stderr, "%s: no answers\n", binary ? "binary" : "json");
+        return false;
+    }
+    const std::size_t n = latencies.size();
+    printf("%-6s %9zu %12.0f %9.1f %9.1f %9.1f %9.1f\n", binary ? "binary" : "json", n, n / seconds,
+           latencies[n / 2], latencies[std::min(n - 1, n * 99 / 100)], latencies[std::min(n - 1, n * 999 / 1000)], latencies.back());
+    if (mismatches)
+        fprintf(stderr, "%s: %llu answers differ from direct computation\n", binary ? "binary" : "json", (unsigned long long) mismatches);
+    if (failed)
+        fprintf(stderr, "%s: connection failed\n", binary ? "binary" : "json");
+    return !mismatches && !failed;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string address = argc > 1 ? argv[1] : "-";
+    int connections = argc > 2 ? atoi(argv[2]) : 4;
+    int requests = argc > 3 ? atoi(argv[3]) : 20000;
+
+    PrayerTimes defaults;
+    QueryServer* server = NULL;
+    std::thread server_thread;
+    if (address == "-")
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/bench_server.%d.sock", (int) getpid());
+        address = path;
+        server = new QueryServer(defaults, NAN, NULL);
+        if (!server->listen(address))
+            return 1;
+        server_thread = std::thread(&QueryServer::run, server, false);
+    }
+
+    printf("%d connections x %d requests%s\n", connections, requests, server ? ", in-process server" : "");
+    printf("proto   requests   requests/s    p50 us    p99 us   p999 us    max us\n");
+    bool ok = run_load(address, true, connections, requests, server ? &defaults : NULL);
+    ok = run_load(address, false, connections, requests, server ? &defaults : NULL) && ok;
+
+    if (server)
+    {
+        server->stop();
+        server_thread.join();
+        delete server;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+﻿// Accuracy and throughput of the TrigHelper array variants against the
+// scalar functions. Exits with status 1 when any kernel exceeds the bound.
+//
+// usage: bench_trig [n]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "trig.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static const double MAX_ERROR = 1e-12;		// bound promised in trig.hpp
+
+typedef double (*ScalarFn)(double);
+typedef void (*ArrayFn)(const double*, double*, std::size_t);
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double max_error(const std::vector<double>& expected, const std::vector<double>& actual)
+{
+    double worst = 0;
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        if (std::isnan(expected[i]) != std::isnan(actual[i]))
+            return INFINITY;
+        if (!std::isnan(expected[i]))
+            worst = std::max(worst, fabs(expected[i] - actual[i]));
+    }
+    return worst;
+}
+
+static bool check(const char* name, ScalarFn scalar, ArrayFn array, const std::vector<double>& in)
+{
+    size_t n = in.size();
+    std::vector<double> expected(n), actual(n);
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; ++i)
+        expected[i] = scalar(in[i]);
+    double scalar_seconds = seconds_since(start);
+
+    start = Clock::now();
+    array(&in[0], &actual[0], n);
+    double array_seconds = seconds_since(start);
+
+    double error = max_error(expected, actual);
+    printf("%-10s max error %9.3g  scalar %7.1f Mop/s  array %7.1f Mop/s\n",
+           name, error, n / scalar_seconds / 1e6, n / array_seconds / 1e6);
+    return error <= MAX_ERROR;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? atol(argv[1]) : 1000000;
+    std::vector<double> angles(n), ratios(n), hours(n), ys(n), xs(n);
+    srand(1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        angles[i] = -720.0 + 1440.0 * rand() / RAND_MAX;
+        ratios[i] = -1.05 + 2.1 * rand() / RAND_MAX;		// a few out of range for NaN
+        hours[i] = -48.0 + 96.0 * rand() / RAND_MAX;
+        ys[i] = -1.0 + 2.0 * rand() / RAND_MAX;
+        xs[i] = -1.0 + 2.0 * rand() / RAND_MAX;
+    }
+
+    printf("simd level: %s, bound %g\n", TrigHelper::simd_level(), MAX_ERROR);
+    bool ok = true;
+    ok &= check("dsin", TrigHelper::dsin, TrigHelper::dsin, angles);
+    ok &= check("dcos", TrigHelper::dcos, TrigHelper::dcos, angles);
+    ok &= check("darcsin", TrigHelper::darcsin, TrigHelper::darcsin, ratios);
+    ok &= check("darccos", TrigHelper::darccos, TrigHelper::darccos, ratios);
+    ok &= check("darccot", TrigHelper::darccot, TrigHelper::darccot, ys);
+    ok &= check("fix_angle", TrigHelper::fix_angle, TrigHelper::fix_angle, angles);
+    ok &= check("fix_hour", TrigHelper::fix_hour, TrigHelper::fix_hour, hours);
+
+    // dtan is checked away from its poles where the absolute error is meaningless
+    std::vector<double> tan_angles(n);
+    for (size_t i = 0; i < n; ++i)
+        tan_angles[i] = -80.0 + 160.0 * i / n;
+    ok &= check("dtan", TrigHelper::dtan, TrigHelper::dtan, tan_angles);
+
+    std::vector<double> expected(n), actual(n);
+    for (size_t i = 0; i < n; ++i)
+        expected[i] = TrigHelper::darctan2(ys[i], xs[i]);
+    TrigHelper::darctan2(&ys[0], &xs[0], &actual[0], n);
+    double error = max_error(expected, actual);
+    printf("%-10s max error %9.3g\n", "darctan2", error);
+    ok &= error <= MAX_ERROR;
+
+    puts(ok ? "all kernels within bound" : "KERNEL ERROR ABOVE BOUND");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,408 @@
+﻿// Microbenchmarks of the calculation hot paths.
+//
+// Every stage is timed in isolation and end to end at a set of latitudes
+// from the equator to the polar circles. Results are ns/op, ops/s and heap
+// allocations per op, counted by the replaced global operator new.
+//
+// usage: prayertimes_bench [--filter text] [--min-time seconds]
+//                          [--json file] [--baseline file]
+//
+// --json writes one result per line so two builds can be compared with
+// diff, or with --baseline, which prints the change against an earlier file.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "prayertimes.hpp"
+#include "calculator.hpp"
+#include "timeformat.hpp"
+#include "timezone.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+/* ---------------------- Allocation Counting ----------------------- */
+
+static std::atomic<unsigned long long> allocations(0);
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, std::size_t) noexcept { free(p); }
+void operator delete[](void* p, std::size_t) noexcept { free(p); }
+
+/* ---------------------- Harness ----------------------- */
+
+/* keep the compiler from dropping a result */
+template <class T>
+static inline void keep(const T& value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct Result
+{
+    std::string name;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+struct Options
+{
+    const char* filter;
+    double min_time;
+};
+
+typedef std::function<void(std::size_t iterations)> Body;
+
+static Options options = { NULL, 0.2 };
+static std::vector<Result> results;
+
+/* time body, doubling the iteration count until a run takes min_time,
+   and keep the best of three such runs */
+static void run(const std::string& name, const Body& body)
+{
+    if (options.filter && name.find(options.filter) == std::string::npos)
+        return;
+
+    body(1);		// warm up caches and lazy tables
+    std::size_t iterations = 1;
+    double seconds = 0;
+    for (;;)
+    {
+        Clock::time_point start = Clock::now();
+        body(iterations);
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= options.min_time || iterations >= (std::size_t) 1 << 40)
+            break;
+        iterations *= seconds > 0 ? std::min(10.0, std::max(2.0, 1.2 * options.min_time / seconds)) : 10;
+    }
+
+    double best = seconds;
+    unsigned long long before = allocations.load();
+    for (int repeat = 0; repeat < 2; ++repeat)
+    {
+        Clock::time_point start = Clock::now();
+        body(iterations);
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    double allocs = (double) (allocations.load() - before) / (2.0 * iterations);
+
+    Result result = { name, best * 1e9 / iterations, allocs };
+    results.push_back(result);
+    printf("%-44s %12.1f ns/op %14.0f ops/s %8.2f allocs/op\n",
+           name.c_str(), result.ns_per_op, 1e9 / result.ns_per_op, result.allocs_per_op);
+    fflush(stdout);
+}
+
+static bool write_json(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f)
+        return false;
+    fputs("[\n", f);
+    for (std::size_t i = 0; i < results.size(); ++i)
+        fprintf(f, "{\"name\": \"%s\", \"ns_per_op\": %.3f, \"ops_per_s\": %.0f, \"allocs_per_op\": %.3f}%s\n",
+                results[i].name.c_str(), results[i].ns_per_op, 1e9 / results[i].ns_per_op,
+                results[i].allocs_per_op, i + 1 < results.size() ? "," : "");
+    fputs("]\n", f);
+    return fclose(f) == 0;
+}
+
+/* read the ns/op of every result in a file written by write_json */
+static bool read_json(const char* path, std::map<std::string, double>& ns_per_op)
+{
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[512], name[256];
+    double ns;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "{\"name\": \"%255[^\"]\", \"ns_per_op\": %lf", name, &ns) == 2)
+            ns_per_op[name] = ns;
+    fclose(f);
+    return true;
+}
+
+/* ---------------------- Cases ----------------------- */
+
+struct Place
+{
+    const char* name;
+    double latitude;
+    double longitude;
+    double timezone;
+};
+
+static const Place places[] =
+{
+    { "equator",   0.0,    0.0,  0.0 },
+    { "makkah",    21.42,  39.83, 3.0 },
+    { "london",    51.51,  -0.13, 0.0 },
+    { "reykjavik", 64.15, -21.94, 0.0 },
+    { "tromso",    69.65,  18.96, 1.0 },		// polar night and midnight sun
+    { "svalbard",  78.22,  15.65, 1.0 },
+};
+
+static const int YEAR = 2024;
+
+static void stage_benchmarks()
+{
+    CalcConfig config;
+    config.adjust_high_lats = Parameters::AngleBased;
+    const Calculator calculator(config);
+    CalcConfig cached_config = config;
+    cached_config.ephemeris = Parameters::CachedEphemeris;
+    const Calculator cached_calculator(cached_config);
+    CalcConfig fitted_config = config;
+    fitted_config.ephemeris = Parameters::FittedEphemeris;
+    const Calculator fitted_calculator(fitted_config);
+
+    run("julian_date", [](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double jd = PrayerTimes::get_julian_date(YEAR, 1 + i % 12, 1 + i % 28);
+            keep(jd);
+        }
+    });
+
+    run("sun_position", [&](std::size_t n) {
+        double jd = Calculator::julian_date(YEAR, 1, 1);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            Calculator::DoublePair position = calculator.sun_position(jd + (i % 8192) * 0.125);
+            keep(position);
+        }
+    });
+
+    run("sun_position/ephemeris", [&](std::size_t n) {
+        double jd = Calculator::julian_date(YEAR, 1, 1);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            Calculator::DoublePair position = cached_calculator.sun_position(jd + (i % 8192) * 0.125);
+            keep(position);
+        }
+    });
+
+    run("sun_position/fitted", [&](std::size_t n) {
+        double jd = Calculator::julian_date(YEAR, 1, 1);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            Calculator::DoublePair position = fitted_calculator.sun_position(jd + (i % 8192) * 0.125);
+            keep(position);
+        }
+    });
+
+    for (const Place& place : places)
+    {
+        std::string suffix = std::string("/") + place.name;
+
+        run("compute_day_times" + suffix, [&](std::size_t n) {
+            double times[Parameters::TimesCount];
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                calculator.compute_day_times(Query::make(YEAR, 1 + i % 12, 1 + i % 28, place.latitude, place.longitude, place.timezone), times);
+                keep(times);
+            }
+        });
+
+        for (int tier = Parameters::FastTier; tier <= Parameters::PreciseTier; tier += 2)
+        {
+            CalcConfig tier_config = config;
+            tier_config.precision = (Parameters::PrecisionTier) tier;
+            const Calculator tier_calculator(tier_config);
+            run(std::string(tier == Parameters::FastTier ? "compute_day_times/fast" : "compute_day_times/precise") + suffix, [&](std::size_t n) {
+                double times[Parameters::TimesCount];
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    tier_calculator.compute_day_times(Query::make(YEAR, 1 + i % 12, 1 + i % 28, place.latitude, place.longitude, place.timezone), times);
+                    keep(times);
+                }
+            });
+        }
+
+        // raw times of a day in each month, re-adjusted every iteration
+        double raw[12][Parameters::TimesCount];
+        for (int m = 0; m < 12; ++m)
+        {
+            Query query = Query::make(YEAR, m + 1, 15, place.latitude, place.longitude, place.timezone);
+            calculator.compute_times(query, raw[m]);
+            calculator.adjust_times(query, raw[m]);
+        }
+        run("adjust_high_lat_times" + suffix, [&](std::size_t n) {
+            double times[Parameters::TimesCount];
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                memcpy(times, raw[i % 12], sizeof(times));
+                calculator.adjust_high_lat_times(times);
+                keep(times);
+            }
+        });
+    }
+}
+
+static void timezone_benchmarks()
+{
+    run("get_effective_timezone/date", [](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double tz = PrayerTimes::get_effective_timezone(YEAR, 1 + i % 12, 1 + i % 28);
+            keep(tz);
+        }
+    });
+
+    run("get_effective_timezone/time_t", [](std::size_t n) {
+        time_t base = 1704067200;		// 2024-01-01 00:00 UTC
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double tz = PrayerTimes::get_effective_timezone(base + (time_t) (i % 8192) * 3600);
+            keep(tz);
+        }
+    });
+
+    const TimeZone* zone = TimeZoneDb::system().find("Europe/London");
+    if (zone)
+        run("get_effective_timezone/zone", [zone](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                double tz = PrayerTimes::get_effective_timezone(*zone, YEAR, 1 + i % 12, 1 + i % 28);
+                keep(tz);
+            }
+        });
+}
+
+static void format_benchmarks()
+{
+    static double times[1024];
+    for (int i = 0; i < 1024; ++i)
+        times[i] = 24.0 * i / 1024;
+
+    run("float_time_to_time24", [](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::string s = PrayerTimes::float_time_to_time24(times[i % 1024]);
+            keep(s);
+        }
+    });
+
+    run("float_time_to_time12", [](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::string s = PrayerTimes::float_time_to_time12(times[i % 1024]);
+            keep(s);
+        }
+    });
+
+    run("TimeFormat::time24", [](std::size_t n) {
+        char buf[TimeFormat::TIME24_SIZE];
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            char* end = TimeFormat::time24(times[i % 1024], buf);
+            keep(end);
+        }
+    });
+}
+
+static void end_to_end_benchmarks()
+{
+    PrayerTimes prayer_times(Parameters::MWL, Parameters::Shafii, Parameters::AngleBased);
+    for (const Place& place : places)
+    {
+        std::string suffix = std::string("/") + place.name;
+
+        // what the command line tool does for one day
+        run("get_prayer_times+format" + suffix, [&](std::size_t n) {
+            double times[Parameters::TimesCount];
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                prayer_times.get_prayer_times(YEAR, 1 + i % 12, 1 + i % 28, place.latitude, place.longitude, place.timezone, times);
+                for (int k = 0; k < Parameters::TimesCount; ++k)
+                {
+                    std::string s = PrayerTimes::float_time_to_time24(times[k]);
+                    keep(s);
+                }
+            }
+        });
+
+        Timetable table;
+        run("get_prayer_times_range(365)" + suffix, [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                prayer_times.get_prayer_times_range(YEAR, 1, 1, 365, place.latitude, place.longitude, place.timezone, table);
+                keep(table.data[0]);
+            }
+        });
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* json_path = NULL;
+    const char* baseline_path = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            options.min_time = atof(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json_path = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            baseline_path = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [--filter text] [--min-time seconds] [--json file] [--baseline file]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (baseline_path && !read_json(baseline_path, baseline))
+    {
+        fprintf(stderr, "Error: Cannot read '%s'\n", baseline_path);
+        return 2;
+    }
+
+    stage_benchmarks();
+    timezone_benchmarks();
+    format_benchmarks();
+    end_to_end_benchmarks();
+
+    if (!baseline.empty())
+    {
+        printf("\n%-44s %12s %12s %8s\n", "change against baseline", "before", "after", "ratio");
+        for (const Result& result : results)
+        {
+            std::map<std::string, double>::const_iterator it = baseline.find(result.name);
+            if (it != baseline.end())
+                printf("%-44s %12.1f %12.1f %7.2fx\n", result.name.c_str(), it->second, result.ns_per_op, it->second / result.ns_per_op);
+        }
+    }
+
+    if (json_path && !write_json(json_path))
+    {
+        fprintf(stderr, "Error: Cannot write '%s'\n", json_path);
+        return 1;
+    }
+    return 0;
+}
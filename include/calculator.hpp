@@ -0,0 +1,249 @@
+﻿#ifndef CALCULATOR_H
+#define CALCULATOR_H
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "parameters.hpp"
+
+/* -------------------- Calculation Core --------------------- */
+
+// Settings of a calculation. A Calculator keeps its own copy, so changing a
+// PrayerTimes instance never affects a computation already running.
+struct CalcConfig
+{
+    CalcConfig()
+        : method(18.0, true, 0.0, false, 17.0)
+        , asr_juristic(Parameters::Shafii)
+        , adjust_high_lats(Parameters::MidNight)
+        , dhuhr_minutes(0)
+        , ephemeris(Parameters::ExactEphemeris)
+        , precision(Parameters::DefaultTier)
+    {
+    }
+
+    Parameters::MethodConfig method;		// angles and minutes of the selected method
+    Parameters::JuristicMethod asr_juristic;		// Juristic method for Asr
+    Parameters::AdjustingMethod adjust_high_lats;	// adjusting method for higher latitudes
+    double dhuhr_minutes;		// minutes after mid-day for Dhuhr
+    Parameters::EphemerisMode ephemeris;		// source of sun positions
+    Parameters::PrecisionTier precision;		// refinement of the times
+};
+
+// Compact calculation settings, meant to be kept per user by the million.
+//
+// A built-in method is only referenced by its id, its angles being read from
+// the shared BUILTIN_METHODS table; the override fields are used by Custom
+// alone. Values are stored as integers in millionths of a degree or minute,
+// so any setting given with up to six decimals converts
+// back to the very same double. The struct is trivially copyable and is
+// passed by value.
+struct CalcProfile
+{
+    enum
+    {
+        MaghribMinutes = 1,		// maghrib_value is in minutes, else an angle
+        IshaMinutes = 2,		// isha_value is in minutes, else an angle
+    };
+
+    uint8_t method;		// Parameters::CalculationMethod
+    uint8_t asr_juristic;		// Parameters::JuristicMethod
+    uint8_t adjust_high_lats;		// Parameters::AdjustingMethod
+    uint8_t ephemeris;		// Parameters::EphemerisMode
+    uint8_t precision;		// Parameters::PrecisionTier
+    uint8_t flags;		// MaghribMinutes and IshaMinutes of the overrides
+    uint16_t reserved;
+    int32_t dhuhr_minutes;		// minutes after mid-day for Dhuhr
+    int32_t fajr_angle;		// overrides of Custom
+    int32_t maghrib_value;		// angle or minutes
+    int32_t isha_value;		// angle or minutes
+
+    /* profile of a method, with the overrides of Custom set to its defaults */
+    static CalcProfile make(Parameters::CalculationMethod method = Parameters::Jafari,
+                            Parameters::JuristicMethod asr_juristic = Parameters::Shafii,
+                            Parameters::AdjustingMethod adjust_high_lats = Parameters::MidNight,
+                            double dhuhr_minutes = 0);
+
+    /* profile of the Custom method with the given settings */
+    static CalcProfile custom(const Parameters::MethodConfig& method, Parameters::JuristicMethod asr_juristic = Parameters::Shafii,
+                              Parameters::AdjustingMethod adjust_high_lats = Parameters::MidNight, double dhuhr_minutes = 0);
+
+    /* store the settings of Custom, without selecting it */
+    void set_overrides(const Parameters::MethodConfig& method);
+
+    /* settings of the selected method */
+    Parameters::MethodConfig method_config() const;
+
+    /* full settings for a Calculator */
+    CalcConfig config() const;
+
+    static int32_t to_units(double value);
+    static double from_units(int32_t units) { return units / 1e6; }		// nearest double of the decimal value
+};
+
+static_assert(std::is_trivially_copyable<CalcProfile>::value, "CalcProfile is copied as plain bytes");
+static_assert(sizeof(CalcProfile) == 24, "CalcProfile layout changed");
+
+// A place on earth and its time-zone.
+struct Location
+{
+    double latitude;
+    double longitude;
+    double timezone;
+};
+
+// The location and day of one computation.
+struct Query
+{
+    double latitude;
+    double longitude;
+    double timezone;
+    double julian_date;		// julian date of the day, corrected for longitude
+
+    static Query make(int year, int month, int day, double latitude, double longitude, double timezone);
+    static Query make(int year, int month, int day, const Location& location);
+};
+
+// Reentrant prayer times calculator.
+//
+// Every function is const and only reads the configuration given at
+// construction and its arguments, so one instance can be shared by any
+// number of threads.
+//
+// The compute and adjust functions are compiled once per combination of
+// calculation, juristic and adjusting method, with the settings of the
+// built-in methods as constants. The constructor picks the combination of
+// its configuration, a method being recognized by its settings; any other
+// settings use the Custom version, which reads them from the configuration.
+class Calculator
+{
+public:
+    typedef std::pair<double, double> DoublePair;
+
+    explicit Calculator(const CalcConfig& config = CalcConfig());
+    explicit Calculator(CalcProfile profile);
+
+    const CalcConfig& config() const { return cfg; }
+
+    /* ---------------------- Compute Prayer Times ----------------------- */
+
+    // array parameters must be at least of size TimesCount
+
+    /* compute prayer times of the day of a query */
+    void compute_day_times(const Query& query, double times[]) const;
+
+    /* compute prayer times for every day of a timetable, starting at the day of a query;
+       an empty timetable is left as it is */
+    void compute_range_times(const Query& query, Timetable& table) const;
+
+    /* compute prayer times at given julian date */
+    void compute_times(const Query& query, double times[]) const;
+
+    /* adjust times in a prayer time array */
+    void adjust_times(const Query& query, double times[]) const;
+
+    /* adjust Fajr, Isha and Maghrib for locations in higher latitudes */
+    void adjust_high_lat_times(double times[]) const;
+
+    /* adjust all times in a timetable */
+    void adjust_range_times(const Query& query, Timetable& table) const;
+
+    /* adjust Fajr, Isha and Maghrib of every day in a timetable */
+    void adjust_high_lat_range(Timetable& table) const;
+
+    /* the night portion used for adjusting times in higher latitudes */
+    double night_portion(double angle) const;
+
+    /* convert hours to day portions  */
+    static void day_portion(double times[]);
+
+    /* ---------------------- Calculation Functions ----------------------- */
+
+    /* References: */
+    /* http://www.ummah.net/astronomy/saltime   */
+    /* http://aa.usno.navy.mil/faq/docs/SunApprox.html */
+
+    /* compute declination angle of sun and equation of time */
+    DoublePair sun_position(double jd) const;
+
+    /* compute declination angle of sun and equation of time, bypassing any ephemeris */
+    static DoublePair exact_sun_position(double jd);
+
+    /* compute equation of time */
+    double equation_of_time(double jd) const;
+
+    /* compute declination angle of sun */
+    double sun_declination(double jd) const;
+
+    /* compute mid-day (Dhuhr, Zawal) time */
+    double compute_mid_day(const Query& query, double t) const;
+
+    /* compute time for a given angle G */
+    double compute_time(const Query& query, double g, double t) const;
+
+    /* compute the time of Asr */
+    double compute_asr(const Query& query, int step, double t) const;
+
+    /* ---------------------- Batch Calculation Functions ----------------------- */
+
+    // element i is evaluated at julian date jd[i] (day plus day portion)
+    // all arrays hold n values, outputs must not alias jd
+
+    /* compute declination angle of sun and equation of time */
+    void sun_position(const double jd[], double declination[], double eq_t[], int n) const;
+
+    /* compute declination angle of sun and equation of time, bypassing any ephemeris */
+    static void exact_sun_position(const double jd[], double declination[], double eq_t[], int n);
+
+    /* compute mid-day (Dhuhr, Zawal) time */
+    void compute_mid_day(const double jd[], double times[], int n) const;
+
+    /* compute time for a given angle G */
+    void compute_time(const Query& query, double g, const double jd[], double times[], int n) const;
+
+    /* compute the time of Asr */
+    void compute_asr(const Query& query, int step, const double jd[], double times[], int n) const;
+
+    /* ---------------------- Misc Functions ----------------------- */
+
+    /* compute the difference between two times  */
+    static double time_diff(double time1, double time2);
+
+    /* calculate julian date from a calendar date */
+    static double julian_date(int year, int month, int day);
+
+private:
+    /* compute_day_times and compute_range_times of one precision tier */
+    template <Parameters::PrecisionTier Tier> void day_times(const Query& query, double times[]) const;
+    template <Parameters::PrecisionTier Tier> void range_times(const Query& query, Timetable& table) const;
+
+    // compute and adjust functions of one method combination
+    struct Kernel
+    {
+        void (*compute_times)(const Calculator& calc, const Query& query, double times[]);
+        void (*adjust_times)(const Calculator& calc, const Query& query, double times[]);
+        void (*adjust_high_lat_times)(const Calculator& calc, double times[]);
+        void (*range_pass)(const Calculator& calc, const Query& query, Timetable& table);		// compute_times over a timetable
+        void (*adjust_range_times)(const Calculator& calc, const Query& query, Timetable& table);
+        void (*adjust_high_lat_range)(const Calculator& calc, Timetable& table);
+    };
+
+    template <Parameters::CalculationMethod M, Parameters::JuristicMethod J, Parameters::AdjustingMethod A>
+    friend struct MethodKernel;
+    friend struct KernelSelector;
+
+    /* compute times for per-element angles G from a computed sun position, n <= BATCH_SIZE */
+    void time_at_angles(const Query& query, const double g[], const double declination[], const double eq_t[], double times[], int n) const;
+
+    CalcConfig cfg;
+    const Kernel* kernel;		// specialized for cfg
+
+    /* --------------------- Technical Settings -------------------- */
+
+    static const int PRECISE_MAX_PASSES = 8;		// passes of PreciseTier before giving up on convergence
+    static const double PRECISE_TOLERANCE;		// hours, PreciseTier stops once no time moves more
+    static constexpr int BATCH_SIZE = 64;		// elements per chunk of the batch functions
+};
+
+#endif
@@ -0,0 +1,52 @@
+﻿#ifndef DAYRANGE_H
+#define DAYRANGE_H
+
+#include "calculator.hpp"
+#include "generator.hpp"
+
+class TimeZone;
+
+/* -------------------- Day Ranges --------------------- */
+
+// Prayer times of one day of a DayRange.
+struct DayTimes
+{
+    int year, month, day;
+    double timezone;		// offset of the times
+    double times[Parameters::TimesCount];
+};
+
+// Lazy iteration over the prayer times of consecutive days:
+//
+//     for (const DayTimes& d : DayRange::days(calculator, location, 2024, 3, 1))
+//         if (...)
+//             break;
+//
+// Days are computed in blocks by Calculator::compute_range_times as the
+// consumer reaches them. Blocks start at FIRST_BLOCK_DAYS days and double up
+// to BLOCK_DAYS, so a consumer that only needs the next few days pays little
+// for the blocks it leaves unfinished.
+// The julian date and the calendar date advance by one day at a time instead
+// of being derived from the civil date for every day, and the calculator and
+// location are set up once for the whole range.
+class DayRange
+{
+public:
+    enum
+    {
+        FIRST_BLOCK_DAYS = 4,
+        BLOCK_DAYS = 32,
+    };
+
+    /* times of num_days days from a date on, of every following day when
+       num_days is 0. With a zone, each day is in the offset the zone has on
+       that day and location.timezone is ignored; the zone must outlive the
+       generator. */
+    static Generator<DayTimes> days(Calculator calculator, Location location, int year, int month, int day,
+                                    int num_days = 0, const TimeZone* zone = NULL);
+
+    /* move a calendar date to the next day */
+    static void next_day(int& year, int& month, int& day);
+};
+
+#endif
@@ -0,0 +1,144 @@
+﻿#ifndef EPHEMERIS_H
+#define EPHEMERIS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "calculator.hpp"
+
+/* -------------------- Shared Solar Ephemeris --------------------- */
+
+// Process-wide cache of the sun's declination and equation of time.
+//
+// Both values only depend on the julian date, so they are sampled once per
+// hour on an absolute julian date grid and shared by every Calculator
+// instance. Samples are computed a block of BLOCK_DAYS days at a time on the
+// first lookup that needs them and then published with an atomic pointer,
+// so lookups never take a lock. Values in between samples are linearly
+// interpolated; the error against Calculator::exact_sun_position is below
+// 2e-6 degrees of declination and 1e-7 hours of equation of time.
+//
+// Dates outside [FIRST_YEAR, FIRST_YEAR + YEARS) bypass the cache.
+class SolarEphemeris
+{
+public:
+    enum
+    {
+        SAMPLES_PER_DAY = 24,		// sample resolution
+        BLOCK_DAYS = 32,		// days computed together on a miss
+        BLOCK_SAMPLES = SAMPLES_PER_DAY * BLOCK_DAYS,
+        FIRST_YEAR = 1900,
+        YEARS = 300,
+    };
+
+    struct Stats
+    {
+        uint64_t hits;		// lookups answered from cached samples
+        uint64_t misses;		// lookups that had to compute a block
+        uint64_t bypassed;		// lookups outside the cached date range
+        uint64_t blocks;		// blocks computed so far
+    };
+
+    /* the instance shared by the whole process */
+    static SolarEphemeris& shared();
+
+    /* declination angle of sun and equation of time at a julian date */
+    Calculator::DoublePair sun_position(double jd);
+
+    /* batch variant, element i is evaluated at julian date jd[i] */
+    void sun_position(const double jd[], double declination[], double eq_t[], int n);
+
+    Stats stats() const;
+    void reset_stats();
+
+private:
+    SolarEphemeris();
+    ~SolarEphemeris();
+    SolarEphemeris(const SolarEphemeris&);
+    SolarEphemeris& operator=(const SolarEphemeris&);
+
+    struct Block
+    {
+        double declination[BLOCK_SAMPLES + 1];		// one extra sample to interpolate the last hour
+        double eq_t[BLOCK_SAMPLES + 1];
+    };
+
+    /* interpolate one julian date, false if it is outside the cached range */
+    bool lookup(double jd, double& declination, double& eq_t, bool& computed);
+
+    /* return a block, computing and publishing it if needed */
+    const Block* block(long index, bool& computed);
+
+    const double first_jd;
+    const long num_blocks;
+    std::unique_ptr<std::atomic<Block*>[]> blocks;
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> bypassed;
+    std::atomic<uint64_t> computed_blocks;
+};
+
+/* -------------------- Fitted Solar Ephemeris --------------------- */
+
+// Process-wide Chebyshev fits of the sun's declination and equation of time.
+//
+// Time is split into years of 365.25 days from FIRST_YEAR and every year into
+// SEGMENTS_PER_YEAR segments. On the first lookup in a year, both values are
+// fitted on every segment of it with TERMS Chebyshev coefficients, from the
+// exact formula at the Chebyshev nodes, and published with an atomic
+// pointer. A lookup is then a Clenshaw recurrence of TERMS multiply-adds per
+// value. Against Calculator::exact_sun_position the error stays below 1e-9
+// degrees of declination and 1e-10 hours of equation of time (see
+// bench/bench_ephemeris.cpp). The equation of time is returned within
+// [-12, 12) hours, so it may differ from the formula by exactly 24 hours.
+//
+// Dates outside [FIRST_YEAR, FIRST_YEAR + YEARS) use the exact formula.
+class FittedEphemeris
+{
+public:
+    enum
+    {
+        SEGMENTS_PER_YEAR = 12,
+        TERMS = 10,		// coefficients per segment and value
+        FIRST_YEAR = SolarEphemeris::FIRST_YEAR,
+        YEARS = SolarEphemeris::YEARS,
+    };
+
+    /* the instance shared by the whole process */
+    static FittedEphemeris& shared();
+
+    /* declination angle of sun and equation of time at a julian date */
+    Calculator::DoublePair sun_position(double jd);
+
+    /* batch variant, element i is evaluated at julian date jd[i] */
+    void sun_position(const double jd[], double declination[], double eq_t[], int n);
+
+    /* number of years fitted so far */
+    uint64_t fitted_years() const { return fitted.load(std::memory_order_relaxed); }
+
+private:
+    FittedEphemeris();
+    ~FittedEphemeris();
+    FittedEphemeris(const FittedEphemeris&);
+    FittedEphemeris& operator=(const FittedEphemeris&);
+
+    struct Year
+    {
+        double declination[SEGMENTS_PER_YEAR][TERMS];
+        double eq_t[SEGMENTS_PER_YEAR][TERMS];
+    };
+
+    /* evaluate the fits at one julian date, false if it is outside the fitted range */
+    bool evaluate(double jd, double& declination, double& eq_t);
+
+    /* return a year, fitting and publishing it if needed */
+    const Year* year(long index);
+
+    const double first_jd;
+    std::unique_ptr<std::atomic<Year*>[]> years;
+    std::atomic<uint64_t> fitted;
+};
+
+#endif
@@ -0,0 +1,106 @@
+﻿#ifndef EVENTINDEX_H
+#define EVENTINDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "calculator.hpp"
+
+class TimeZone;
+class WorkStealingPool;
+
+/* -------------------- Location Event Index --------------------- */
+
+// Answers "which locations have a prayer starting between two instants" for
+// a large set of locations, the reverse of PrayerIndex.
+//
+// The index holds two consecutive local days of every location, today and
+// tomorrow, as one segment per day and prayer. A segment stores the events
+// of all locations sorted by UTC second, with a table of the first event of
+// every UTC minute. A query reads one table entry per selected prayer and
+// day and then only visits the events of the range, plus those of its first
+// minute before the start.
+//
+// advance() drops the first day and computes the day after the last, so a
+// rollover only computes one day of every location; roll_over() advances
+// once every event of the first day is in the past.
+class EventIndex
+{
+public:
+    enum
+    {
+        DAYS = 2,		// local days indexed
+        BUCKET_SECONDS = 60,
+        // Sunset is left out by default, it is Maghrib for most methods
+        DEFAULT_MASK = (1 << Parameters::TimesCount) - 1 - (1 << Parameters::Sunset),
+        ALL_PRAYERS = (1 << Parameters::TimesCount) - 1,
+    };
+
+    struct Event
+    {
+        uint32_t location;		// index in the location set
+        Parameters::TimeID prayer;
+        int64_t utc;		// seconds since the epoch
+    };
+
+    /* index of the locations, none indexed until build(); locations without a
+       timezone (NAN) take the offset of zone on each day.
+       threads == 0 uses one thread per hardware thread */
+    EventIndex(const Calculator& calculator, const std::vector<Location>& locations,
+               const TimeZone* zone = NULL, unsigned threads = 0);
+    ~EventIndex();
+
+    /* index the local day year-month-day and the next one of every location */
+    void build(int year, int month, int day);
+
+    /* drop the first day and index the day after the last */
+    void advance();
+
+    /* advance while every event of the first day is before utc; the number of days advanced */
+    int roll_over(int64_t utc);
+
+    /* append the events of the prayers in mask with from <= utc < to, in time
+       order per prayer and day; the number appended */
+    std::size_t query(int64_t from, int64_t to, std::vector<Event>& events, unsigned mask = DEFAULT_MASK) const;
+
+    /* days since the epoch of the first indexed local day */
+    int64_t first_day() const { return first_day_number; }
+
+    std::size_t num_locations() const { return locations.size(); }
+
+    /* events indexed and bytes held by the segments */
+    std::size_t size() const;
+    std::size_t memory_bytes() const;
+
+private:
+    EventIndex(const EventIndex&);
+    EventIndex& operator=(const EventIndex&);
+
+    // events of one local day and prayer for every location
+    struct Segment
+    {
+        int64_t origin;		// start of bucket 0, a UTC minute
+        int64_t last;		// latest event, origin when empty
+        std::vector<uint32_t> buckets;		// first event of each minute, plus the end
+        std::vector<int32_t> offsets;		// seconds after origin, sorted
+        std::vector<uint32_t> ids;		// location of offsets[i]
+    };
+
+    /* compute the local day number for every location into the segments of a slot */
+    void index_day(int slot, int64_t day);
+
+    const Calculator calculator;
+    const std::vector<Location> locations;
+    const TimeZone* zone;
+    std::unique_ptr<WorkStealingPool> pool;
+
+    Segment segments[DAYS][Parameters::TimesCount];
+    int first_slot;		// slot of the first day, the others follow it round the ring
+    int64_t first_day_number;
+    bool built;
+
+    std::vector<double> times;		// TimesCount per location, reused by index_day
+};
+
+#endif
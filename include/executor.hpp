@@ -0,0 +1,91 @@
+﻿#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "calculator.hpp"
+
+/* -------------------- Work-Stealing Thread Pool --------------------- */
+
+// Fixed set of worker threads, each owning a deque of index ranges.
+//
+// parallel_for splits [0, n) into ranges of `grain` indices and deals them
+// round-robin to the workers. A worker takes ranges from the back of its own
+// deque and, once that is empty, steals from the front of the others, so
+// uneven ranges (polar days, bigger locations) even out on their own. The
+// calling thread steals too while it waits.
+class WorkStealingPool
+{
+public:
+    typedef std::function<void(std::size_t begin, std::size_t end)> RangeFunction;
+
+    /* threads == 0 uses one thread per hardware thread */
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+
+    unsigned size() const { return (unsigned) workers.size(); }
+
+    /* call f on every range of [0, n) and return when all are done */
+    void parallel_for(std::size_t n, std::size_t grain, const RangeFunction& f);
+
+private:
+    WorkStealingPool(const WorkStealingPool&);
+    WorkStealingPool& operator=(const WorkStealingPool&);
+
+    typedef std::pair<std::size_t, std::size_t> Range;
+
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<Range> ranges;
+        std::thread thread;
+    };
+
+    void worker_loop(unsigned index);
+
+    /* run ranges until none is left anywhere; self is the worker index or size() for the caller */
+    void drain(unsigned self);
+    bool take(unsigned self, Range& range);
+
+    std::vector<std::unique_ptr<Worker> > workers;
+
+    std::mutex job_lock;		// serializes parallel_for calls
+    std::mutex state_lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const RangeFunction* job;
+    unsigned long generation;
+    std::atomic<std::size_t> pending;		// ranges not finished yet
+    bool stopping;
+};
+
+/* -------------------- Bulk Executor --------------------- */
+
+// Computes (locations x days) timetables on all cores.
+class BulkExecutor
+{
+public:
+    /* threads == 0 uses one thread per hardware thread */
+    explicit BulkExecutor(unsigned threads = 0);
+
+    unsigned threads() const { return pool.size(); }
+
+    /* compute num_days days from the given date for every location into tables[i] */
+    void run(const Calculator& calculator, const Location locations[], std::size_t num_locations,
+             int year, int month, int day, int num_days, Timetable tables[]);
+
+    WorkStealingPool& thread_pool() { return pool; }
+
+private:
+    WorkStealingPool pool;
+};
+
+#endif
@@ -0,0 +1,106 @@
+﻿#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+#include "calculator.hpp"
+
+class TimeZone;
+
+/* -------------------- Timetable Exporter --------------------- */
+
+// Text timetables of many locations over a range of days, as CSV, JSON or
+// iCalendar, written to one stream or to one file per location.
+//
+// CSV has a header line and then one row per location and day. JSON is one
+// object per location and line, with a "days" array. iCalendar is one
+// VCALENDAR per location with an event per prayer, its start in UTC.
+// Undefined times are empty in CSV, null in JSON and have no event.
+//
+// Locations are split into chunks of about CHUNK_BYTES of output. Worker
+// threads take the next chunk, compute its timetables and format them
+// while they are still in cache. The calling thread writes the chunks in
+// order. A fixed set of chunk buffers bounds both queues: a worker waits for
+// a free buffer before it takes a chunk, and the writer frees a buffer once
+// it is written. The single stream goes out in WRITE_SIZE blocks from a
+// page-aligned buffer.
+class TimetableExporter
+{
+public:
+    enum Format
+    {
+        Csv,
+        Json,
+        ICal,
+    };
+
+    enum
+    {
+        WRITE_SIZE = 1 << 20,		// bytes per write of a single stream
+        WRITE_ALIGNMENT = 4096,		// of the write buffer
+        CHUNK_BYTES = 1 << 20,		// output aimed at per chunk
+    };
+
+    struct Stats
+    {
+        uint64_t locations;
+        uint64_t days;		// location days
+        uint64_t bytes;		// written
+        double seconds;		// wall time of the last write
+    };
+
+    /* threads == 0 uses one thread per hardware thread */
+    TimetableExporter(const CalcConfig& config, Format format, unsigned threads = 0);
+    ~TimetableExporter();
+
+    /* DTSTAMP of the iCalendar events, the time of construction by default */
+    void set_stamp(time_t stamp) { this->stamp = stamp; }
+
+    /* compute num_days days from the given date for every location and write
+       them to fd. Times are local to zone when given, else to each
+       location's timezone. False if a write fails. */
+    bool write(int fd, const Location locations[], std::size_t num_locations,
+               int year, int month, int day, int num_days, const TimeZone* zone = NULL);
+
+    /* the same, each location to <directory>/<index>.<extension> with the
+       index zero-padded to six digits; false if a file cannot be written */
+    bool write_files(const std::string& directory, const Location locations[], std::size_t num_locations,
+                     int year, int month, int day, int num_days, const TimeZone* zone = NULL);
+
+    const Stats& stats() const { return counters; }
+
+    /* "csv", "json" or "ics" */
+    static const char* extension(Format format);
+
+private:
+    TimetableExporter(const TimetableExporter&);
+    TimetableExporter& operator=(const TimetableExporter&);
+
+    struct Chunk;
+    struct Day;
+    struct Job;
+
+    /* the days of an export and the stamp of its events */
+    void prepare(Job& job, const Location locations[], std::size_t num_locations,
+                 int year, int month, int day, int num_days, const TimeZone* zone) const;
+
+    /* run the workers and hand every chunk to the sink of the job, in order */
+    bool run(Job& job);
+
+    /* format the timetable of one location */
+    char* format_location(const Job& job, std::size_t index, const Timetable& table, char* out) const;
+
+    /* upper bound of the bytes format_location writes per day */
+    std::size_t max_day_size() const;
+
+    const Calculator calculator;
+    const Format format;
+    const unsigned threads;
+    time_t stamp;
+    Stats counters;
+};
+
+#endif
@@ -0,0 +1,109 @@
+﻿#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+
+/* -------------------- Generator --------------------- */
+
+// Lazy sequence of the values a coroutine co_yields.
+//
+// The coroutine runs up to its next co_yield whenever the iterator advances
+// and is destroyed with the generator, so a consumer may stop at any point.
+// A yielded value stays valid until the coroutine is resumed. Like an input
+// range, a generator can be iterated only once.
+template <class T>
+class Generator
+{
+public:
+    struct promise_type
+    {
+        const T* value;
+        std::exception_ptr error;
+
+        Generator get_return_object() { return Generator(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(const T& v) noexcept
+        {
+            value = &v;
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    class iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        iterator() : handle() {}
+        explicit iterator(Handle handle) : handle(handle) {}
+
+        const T& operator*() const { return *handle.promise().value; }
+        const T* operator->() const { return handle.promise().value; }
+
+        iterator& operator++()
+        {
+            resume(handle);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return !handle || handle.done(); }
+
+    private:
+        Handle handle;
+    };
+
+    Generator() : handle() {}
+    Generator(Generator&& other) noexcept : handle(other.handle) { other.handle = Handle(); }
+    ~Generator() { if (handle) handle.destroy(); }
+
+    Generator& operator=(Generator&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+                handle.destroy();
+            handle = other.handle;
+            other.handle = Handle();
+        }
+        return *this;
+    }
+
+    /* run the coroutine to its first value */
+    iterator begin()
+    {
+        if (handle)
+            resume(handle);
+        return iterator(handle);
+    }
+    std::default_sentinel_t end() { return std::default_sentinel; }
+
+private:
+    explicit Generator(Handle handle) : handle(handle) {}
+    Generator(const Generator&);
+    Generator& operator=(const Generator&);
+
+    /* run to the next co_yield, passing on an exception of the coroutine */
+    static void resume(Handle handle)
+    {
+        handle.resume();
+        if (handle.done() && handle.promise().error)
+            std::rethrow_exception(handle.promise().error);
+    }
+
+    Handle handle;
+};
+
+#endif
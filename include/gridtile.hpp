@@ -0,0 +1,94 @@
+﻿#ifndef GRIDTILE_H
+#define GRIDTILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "calculator.hpp"
+
+/* -------------------- Grid Tiles --------------------- */
+
+// Area and dates covered by a tile.
+struct GridSpec
+{
+    double south;		// latitude of the first grid row
+    double west;		// longitude of the first grid column
+    double lat_step;		// degrees between grid points
+    double lon_step;
+    int rows;		// grid points along latitude and longitude, at least 2 each
+    int cols;
+    int year, month, day;		// first day
+    int days;
+    double max_error;		// seconds, larger errors make a cell fall back to exact computation
+};
+
+// Prayer times precomputed on a lat/lon grid for a range of days, stored in
+// a memory-mapped file and interpolated bilinearly for any point inside.
+//
+// Every time is stored as a 16 bit count of 2 second units from the solar
+// noon of its grid point (12 - longitude / 15 UTC), which is linear in
+// longitude, so the interpolation only has to follow the smooth remainder.
+//
+// generate() checks each cell against exact computation at its center and
+// edge midpoints. A cell is interpolated on a day only when every check
+// point is within half of max_error, quantization included; otherwise, and
+// where any time is undefined (polar days, high latitude boundaries), its
+// flag makes lookups compute the day exactly.
+class GridTile
+{
+public:
+    enum Source
+    {
+        Outside,		// point or day not covered by the tile
+        Interpolated,
+        Exact,		// computed by the fallback
+    };
+
+    GridTile();
+    ~GridTile();
+
+    /* evaluate config on the grid of spec and write a tile file;
+       threads == 0 uses one thread per hardware thread */
+    static bool generate(const std::string& path, const CalcConfig& config, const GridSpec& spec, unsigned threads = 0);
+
+    /* map a tile file, false if it cannot be read or is malformed */
+    bool open(const std::string& path);
+    void close();
+
+    /* prayer times of a day (counted from the first day of the tile) at a
+       point, in hours of the given time-zone like Calculator::compute_day_times */
+    Source times(double latitude, double longitude, int day, double timezone, double times[]) const;
+
+    /* the same for a calendar date */
+    Source times(double latitude, double longitude, int year, int month, int day, double timezone, double times[]) const;
+
+    const GridSpec& spec() const { return grid; }
+    const CalcConfig& config() const { return calculator.config(); }
+
+    /* share of (day, cell) pairs computed exactly */
+    double exact_share() const;
+
+    /* largest error in seconds found at the check points of interpolated cells */
+    double measured_error() const;
+
+private:
+    GridTile(const GridTile&);
+    GridTile& operator=(const GridTile&);
+
+    struct Header;
+
+    const int16_t* point(int day, int row, int col) const;
+    bool cell_exact(int day, int row, int col) const;
+
+    void* mapping;
+    std::size_t mapping_size;
+    const Header* header;
+    const int16_t* values;		// [day][row][col][TimesCount]
+    const uint8_t* flags;		// [day][row - 1][col - 1], non-zero: compute exactly
+    int64_t first_day;		// days since the epoch
+    GridSpec grid;
+    Calculator calculator;		// exact fallback
+};
+
+#endif
@@ -0,0 +1,101 @@
+﻿#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* -------------------- Instrumentation --------------------- */
+
+// Counters of notable events.
+enum CalcCounter
+{
+    DaysComputed,		// days of compute_day_times and compute_range_times
+    SunPositions,		// sun positions evaluated, from any source
+    UndefinedTimes,		// times the sun never reaches the angle of (darccos out of range)
+    FajrAdjusted,		// Fajr replaced by the high latitude adjustment
+    IshaAdjusted,
+    MaghribAdjusted,
+
+    CalcCounterCount
+};
+
+// Timed stages, possibly nested in each other.
+enum CalcStage
+{
+    DayTimesStage,		// compute_day_times
+    RangeTimesStage,		// compute_range_times
+    ComputeTimesStage,		// one pass of compute_times, single day or timetable
+    AdjustTimesStage,		// adjust_times and adjust_range_times, high latitudes included
+    HighLatTimesStage,		// adjust_high_lat_times and adjust_high_lat_range
+
+    CalcStageCount
+};
+
+// Totals since the last reset, over all threads.
+struct CalcStats
+{
+    uint64_t counters[CalcCounterCount];
+    uint64_t calls[CalcStageCount];
+    uint64_t cycles[CalcStageCount];		// time stamp counter ticks, nanoseconds where there is none
+};
+
+// Counters, per-stage cycle timers and a Chrome trace of the calculation.
+//
+// Only compiled in when PRAYERTIMES_INSTRUMENTATION is defined (the CMake
+// option of the same name); otherwise the PT_ macros expand to nothing, the
+// stats stay zero and no trace is recorded. Every thread updates its own
+// slot without atomic read-modify-write, stats() sums the slots.
+class Instrumentation
+{
+public:
+    /* true if instrumentation was compiled in */
+    static bool enabled();
+
+    static CalcStats stats();
+    static void reset();
+
+    static const char* counter_name(CalcCounter counter);
+    static const char* stage_name(CalcStage stage);
+
+    /* record every stage from now on, at most max_events per thread */
+    static void start_trace(std::size_t max_events = 1 << 20);
+
+    /* stop recording and write the events in Chrome trace JSON format
+       (chrome://tracing, Perfetto); false if the file cannot be written.
+       Call it while no thread is computing. */
+    static bool write_trace(const std::string& path);
+
+    static void count(CalcCounter counter, uint64_t n);
+
+    /* count the NaN values of an array as UndefinedTimes */
+    static void count_undefined(const double times[], int n);
+
+    // times the scope it lives in as one call of a stage
+    class StageTimer
+    {
+    public:
+        explicit StageTimer(CalcStage stage);
+        ~StageTimer();
+
+    private:
+        StageTimer(const StageTimer&);
+        StageTimer& operator=(const StageTimer&);
+
+        CalcStage stage;
+        uint64_t start_cycles;
+        int64_t start_ns;		// -1 when not tracing
+    };
+};
+
+#ifdef PRAYERTIMES_INSTRUMENTATION
+#define PT_COUNT(counter, n) Instrumentation::count(counter, n)
+#define PT_COUNT_UNDEFINED(times, n) Instrumentation::count_undefined(times, n)
+#define PT_STAGE(stage) Instrumentation::StageTimer pt_stage_timer(stage)
+#else
+#define PT_COUNT(counter, n) ((void) 0)
+#define PT_COUNT_UNDEFINED(times, n) ((void) 0)
+#define PT_STAGE(stage) ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+﻿#ifndef PARAMETERS_H
+#define PARAMETERS_H
+
+#include <vector>
+
+/* -------------------- Calculation Parameters --------------------- */
+
+struct Parameters{
+
+    enum
+    {
+        VERSION_MAJOR = 1,
+        VERSION_MINOR = 0,
+    };
+
+    // Calculation Methods
+    enum CalculationMethod
+    {
+        Jafari, 	// Ithna Ashari
+        Karachi,	// University of Islamic Sciences, Karachi
+        ISNA,   	// Islamic Society of North America (ISNA)
+        MWL,    	// Muslim World League (MWL)
+        Makkah, 	// Umm al-Qura, Makkah
+        Egypt,  	// Egyptian General Authority of Survey
+        Custom, 	// Custom Setting
+
+        CalculationMethodsCount
+    };
+
+    // Juristic Methods
+    enum JuristicMethod
+    {
+        Shafii,    // Shafii (standard)
+        Hanafi,    // Hanafi
+    };
+
+    // Adjusting Methods for Higher Latitudes
+    enum AdjustingMethod
+    {
+        None,      	// No adjustment
+        MidNight,  	// middle of night
+        OneSeventh,	// 1/7th of night
+        AngleBased,	// angle/60th of night
+    };
+
+    // Sources of the sun's position
+    enum EphemerisMode
+    {
+        ExactEphemeris,  	// evaluate the formula every time
+        CachedEphemeris, 	// interpolate hourly samples of SolarEphemeris
+        FittedEphemeris, 	// evaluate the Chebyshev series of FittedEphemeris
+    };
+
+    // Precision tiers of Calculator::compute_day_times and compute_range_times
+    enum PrecisionTier
+    {
+        FastTier,    	// times from one sun position per day, no refinement
+        DefaultTier, 	// one pass of compute_times from fixed guesses
+        PreciseTier, 	// passes of compute_times until every time converges
+    };
+
+    // Time IDs
+    enum TimeID
+    {
+        Fajr,
+        Sunrise,
+        Dhuhr,
+        Asr,
+        Sunset,
+        Maghrib,
+        Isha,
+
+        TimesCount
+    };
+
+//private:
+    struct MethodConfig
+    {
+        MethodConfig()
+        {
+        }
+
+        constexpr MethodConfig(double fajr_angle,
+                               bool maghrib_is_minutes,
+                               double maghrib_value,
+                               bool isha_is_minutes,
+                               double isha_value)
+            : fajr_angle(fajr_angle)
+            , maghrib_is_minutes(maghrib_is_minutes)
+            , maghrib_value(maghrib_value)
+            , isha_is_minutes(isha_is_minutes)
+            , isha_value(isha_value)
+        {
+        }
+
+        double fajr_angle;
+        bool   maghrib_is_minutes;
+        double maghrib_value;		// angle or minutes
+        bool   isha_is_minutes;
+        double isha_value;		// angle or minutes
+    };
+
+
+
+};
+
+// Settings of the calculation methods, Custom starts as a copy of MWL
+inline constexpr Parameters::MethodConfig BUILTIN_METHODS[Parameters::CalculationMethodsCount] =
+{
+    Parameters::MethodConfig(16.0, false, 4.0, false, 14.0),	// Jafari
+    Parameters::MethodConfig(18.0, true,  0.0, false, 18.0),	// Karachi
+    Parameters::MethodConfig(15.0, true,  0.0, false, 15.0),	// ISNA
+    Parameters::MethodConfig(18.0, true,  0.0, false, 17.0),	// MWL
+    Parameters::MethodConfig(19.0, true,  0.0, true,  90.0),	// Makkah
+    Parameters::MethodConfig(19.5, true,  0.0, false, 17.5),	// Egypt
+    Parameters::MethodConfig(18.0, true,  0.0, false, 17.0),	// Custom
+};
+
+/* -------------------- Timetable (structure of arrays) --------------------- */
+
+// Prayer times of consecutive days stored per prayer: all Fajr values first,
+// then all Sunrise values, and so on. times(id)[day] is the time of prayer id
+// on the given day.
+struct Timetable
+{
+    Timetable()
+        : days(0)
+    {
+    }
+
+    explicit Timetable(int days)
+        : days(days)
+        , data(days * Parameters::TimesCount)
+    {
+    }
+
+    void resize(int num_days)
+    {
+        days = num_days;
+        data.resize(num_days * Parameters::TimesCount);
+    }
+
+    double* times(int time_id) { return data.data() + time_id * days; }
+    const double* times(int time_id) const { return data.data() + time_id * days; }
+    double at(int day, int time_id) const { return data[time_id * days + day]; }
+
+    /* move the times of every day d, computed at the offset timezone, to offsets[d].
+       The time-zone only offsets the times, so a range computed at the offset of
+       its first day follows the DST changes of its zone by this shift. */
+    void shift_days(const double offsets[], double timezone)
+    {
+        for (int id = 0; id < Parameters::TimesCount; ++id)
+        {
+            double* column = times(id);
+            for (int d = 0; d < days; ++d)
+                column[d] += offsets[d] - timezone;
+        }
+    }
+
+    int days;
+    std::vector<double> data;
+};
+
+#endif
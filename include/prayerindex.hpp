@@ -0,0 +1,66 @@
+﻿#ifndef PRAYERINDEX_H
+#define PRAYERINDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include "calculator.hpp"
+
+/* -------------------- Next Prayer Index --------------------- */
+
+// Answers "which prayer is it and how long until the next one" for a UTC
+// instant in constant time.
+//
+// The times of a multi-day timetable are converted once to UTC seconds and
+// sorted. A table of hourly buckets holds the first event at or after the
+// start of every hour, so a lookup is one division, one table read and a
+// scan over the few events of that hour. Since everything is kept in UTC,
+// midnight and DST changes need no special handling; the time-zone only
+// matters for presenting the answer.
+class PrayerIndex
+{
+public:
+    enum
+    {
+        BUCKET_SECONDS = 3600,
+        // Sunset is left out by default, it is Maghrib for most methods
+        DEFAULT_MASK = (1 << Parameters::TimesCount) - 1 - (1 << Parameters::Sunset),
+    };
+
+    struct Position
+    {
+        Parameters::TimeID current;		// last event at or before the instant
+        Parameters::TimeID next;		// first event after it
+        int64_t current_start;		// UTC seconds since the epoch
+        int64_t next_start;
+        int64_t seconds_until;		// next_start minus the instant
+    };
+
+    PrayerIndex();
+
+    /* index a timetable computed for timezone, starting at the given date;
+       mask selects the TimeIDs (bit 1 << id) taking part, undefined times are skipped */
+    PrayerIndex(const Timetable& table, int year, int month, int day, double timezone,
+                unsigned mask = DEFAULT_MASK);
+
+    /* compute num_days days for a location and index them */
+    static PrayerIndex make(const Calculator& calculator, int year, int month, int day, int num_days,
+                            double latitude, double longitude, unsigned mask = DEFAULT_MASK);
+
+    /* position of a UTC instant; false outside [first event, last event) */
+    bool lookup(int64_t utc, Position& position) const;
+
+    /* range of instants lookup() can answer */
+    int64_t first_event() const { return times.empty() ? 0 : times.front(); }
+    int64_t last_event() const { return times.empty() ? 0 : times.back(); }
+
+    std::size_t size() const { return times.size(); }
+
+private:
+    std::vector<int64_t> times;		// sorted UTC seconds
+    std::vector<uint8_t> ids;		// TimeID of times[i]
+    std::vector<uint32_t> buckets;		// first event at or after the start of each hour
+    int64_t bucket_origin;		// start of bucket 0
+};
+
+#endif
@@ -42,96 +42,34 @@ http://code.ebrahim.ir/prayertimes/
 
 #include <cstdio>
 #include <cmath>
+#include <ctime>
 #include <string>
-#include <QObject>
-/* -------------------- PrayerTimes Class --------------------- */
-
-struct Parameters{
-
-    enum
-    {
-        VERSION_MAJOR = 1,
-        VERSION_MINOR = 0,
-    };
-
-    // Calculation Methods
-    enum CalculationMethod
-    {
-        Jafari, 	// Ithna Ashari
-        Karachi,	// University of Islamic Sciences, Karachi
-        ISNA,   	// Islamic Society of North America (ISNA)
-        MWL,    	// Muslim World League (MWL)
-        Makkah, 	// Umm al-Qura, Makkah
-        Egypt,  	// Egyptian General Authority of Survey
-        Custom, 	// Custom Setting
-
-        CalculationMethodsCount
-    };
-
-    // Juristic Methods
-    enum JuristicMethod
-    {
-        Shafii,    // Shafii (standard)
-        Hanafi,    // Hanafi
-    };
-
-    // Adjusting Methods for Higher Latitudes
-    enum AdjustingMethod
-    {
-        None,      	// No adjustment
-        MidNight,  	// middle of night
-        OneSeventh,	// 1/7th of night
-        AngleBased,	// angle/60th of night
-    };
-
-    // Time IDs
-    enum TimeID
-    {
-        Fajr,
-        Sunrise,
-        Dhuhr,
-        Asr,
-        Sunset,
-        Maghrib,
-        Isha,
-
-        TimesCount
-    };
-
-//private:
-    struct MethodConfig
-    {
-        MethodConfig()
-        {
-        }
-
-        MethodConfig(double fajr_angle,
-                     bool maghrib_is_minutes,
-                     double maghrib_value,
-                     bool isha_is_minutes,
-                     double isha_value)
-            : fajr_angle(fajr_angle)
-            , maghrib_is_minutes(maghrib_is_minutes)
-            , maghrib_value(maghrib_value)
-            , isha_is_minutes(isha_is_minutes)
-            , isha_value(isha_value)
-        {
-        }
-
-        double fajr_angle;
-        bool   maghrib_is_minutes;
-        double maghrib_value;		// angle or minutes
-        bool   isha_is_minutes;
-        double isha_value;		// angle or minutes
-    };
 
+#include "parameters.hpp"
+#include "calculator.hpp"
+#include "dayrange.hpp"
 
+class TimeZone;
+class ResultCache;
 
-};
+/* -------------------- PrayerTimes Class --------------------- */
 
-class PrayerTimes : public QObject
+// Plain C++ class without any Qt dependency; see qprayertimes.hpp for the
+// QObject flavour.
+//
+// PrayerTimes only holds the settings. The calculation members it used to
+// expose (sun_position, equation_of_time, sun_declination, compute_mid_day,
+// compute_time, compute_asr, compute_times, compute_day_times, adjust_times,
+// adjust_high_lat_times, night_portion and day_portion) worked on the
+// location of the last get_prayer_times call and are gone; the same
+// functions are const members of Calculator and take the location and date
+// as a Query:
+//
+//     Calculator calc = prayer_times.calculator();
+//     Query query = Query::make(year, month, day, latitude, longitude, timezone);
+//     calc.compute_day_times(query, times);
+class PrayerTimes
 {
-    Q_OBJECT
 public:
     /* --------------------- User Interface ----------------------- */
     /*
@@ -169,10 +107,28 @@ public:
     ~PrayerTimes();
 
     /* return prayer times for a given date */
-    void get_prayer_times(int year, int month, int day, double _latitude, double _longitude, double _timezone, double times[]);
+    void get_prayer_times(int year, int month, int day, double _latitude, double _longitude, double _timezone, double times[]) const;
 
     /* return prayer times for a given date */
-    void get_prayer_times(time_t date, double latitude, double longitude, double timezone, double times[]);
+    void get_prayer_times(time_t date, double latitude, double longitude, double timezone, double times[]) const;
+
+    /* return prayer times for num_days consecutive days starting at a given date */
+    void get_prayer_times_range(int year, int month, int day, int num_days, double _latitude, double _longitude, double _timezone, Timetable& table) const;
+
+    /* lazily compute prayer times of consecutive days from a given date, without end when num_days is 0; see DayRange */
+    Generator<DayTimes> get_prayer_times_days(int year, int month, int day, double latitude, double longitude, double timezone, int num_days = 0) const;
+
+    /* snapshot of the current settings */
+    CalcConfig config() const;
+
+    /* reentrant calculator for the current settings, see calculator.hpp */
+    Calculator calculator() const;
+
+    /* compact copy of the current settings, see CalcProfile */
+    CalcProfile profile() const;
+
+    /* replace every setting by those of a profile */
+    void set_profile(CalcProfile profile);
 
     /* set the calculation method  */
     void set_calc_method(Parameters::CalculationMethod method_id);
@@ -201,6 +157,19 @@ public:
     /* set the minutes after Maghrib for calculating Isha */
     void set_isha_minutes(double minutes);
 
+    /* take sun positions from the process-wide SolarEphemeris cache */
+    void set_ephemeris_cache(bool enabled);
+
+    /* select the source of sun positions, see Parameters::EphemerisMode */
+    void set_ephemeris_mode(Parameters::EphemerisMode mode);
+
+    /* select the precision tier of the times, see Parameters::PrecisionTier */
+    void set_precision(Parameters::PrecisionTier tier);
+
+    /* answer get_prayer_times of a date from a shared ResultCache, NULL to compute
+       every call; the cache must outlive this instance and its copies */
+    void set_result_cache(ResultCache* cache);
+
     /* get hours and minutes parts of a float time */
     static void get_float_time_parts(double time, int& hours, int& minutes);
 
@@ -221,56 +190,11 @@ public:
     /* compute local time-zone for a specific date */
     static double get_effective_timezone(int year, int month, int day);
 
-    /* ---------------------- Calculation Functions ----------------------- */
-
-    /* References: */
-    /* http://www.ummah.net/astronomy/saltime   */
-    /* http://aa.usno.navy.mil/faq/docs/SunApprox.html */
-
-    typedef std::pair<double, double> DoublePair;
-
-    /* compute declination angle of sun and equation of time */
-    DoublePair sun_position(double jd);
-
-    /* compute equation of time */
-    double equation_of_time(double jd);
+    /* compute time-zone of a named zone for a specific instant, see timezone.hpp */
+    static double get_effective_timezone(const TimeZone& zone, time_t date);
 
-    /* compute declination angle of sun */
-    double sun_declination(double jd);
-
-    /* compute mid-day (Dhuhr, Zawal) time */
-    double compute_mid_day(double _t);
-
-    /* compute time for a given angle G */
-    double compute_time(double g, double t);
-
-    /* compute the time of Asr */
-    double compute_asr(int step, double t);
-
-    /* ---------------------- Compute Prayer Times ----------------------- */
-
-    // array parameters must be at least of size TimesCount
-
-    /* compute prayer times at given julian date */
-    void compute_times(double times[]);
-
-
-    /* compute prayer times at given julian date */
-    void compute_day_times(double times[]);
-
-
-    /* adjust times in a prayer time array */
-    void adjust_times(double times[]);
-
-    /* adjust Fajr, Isha and Maghrib for locations in higher latitudes */
-    void adjust_high_lat_times(double times[]);
-
-
-    /* the night portion used for adjusting times in higher latitudes */
-    double night_portion(double angle);
-
-    /* convert hours to day portions  */
-    void day_portion(double times[]);
+    /* compute time-zone of a named zone for a specific date */
+    static double get_effective_timezone(const TimeZone& zone, int year, int month, int day);
 
     /* ---------------------- Misc Functions ----------------------- */
 
@@ -285,31 +209,24 @@ public:
     /* ---------------------- Julian Date Functions ----------------------- */
 
     /* calculate julian date from a calendar date */
-    double get_julian_date(int year, int month, int day);
+    static double get_julian_date(int year, int month, int day);
 
     /* convert a calendar date to julian date (second method) */
-    double calc_julian_date(int year, int month, int day);
-
+    static double calc_julian_date(int year, int month, int day);
 
 private:
     /* ---------------------- Private Variables -------------------- */
     Parameters m_params;
 
-    Parameters::MethodConfig method_params[Parameters::CalculationMethodsCount];
+    Parameters::MethodConfig custom_params;		// settings of Parameters::Custom, the others are BUILTIN_METHODS
 
     Parameters::CalculationMethod calc_method;		// caculation method
     Parameters::JuristicMethod asr_juristic;		// Juristic method for Asr
     Parameters::AdjustingMethod adjust_high_lats;	// adjusting method for higher latitudes
     double dhuhr_minutes;		// minutes after mid-day for Dhuhr
-
-    double latitude;
-    double longitude;
-    double timezone;
-    double julian_date;
-
-    /* --------------------- Technical Settings -------------------- */
-
-    static const int NUM_ITERATIONS = 1;		// number of iterations needed to compute times
+    Parameters::EphemerisMode ephemeris_mode;		// source of sun positions
+    Parameters::PrecisionTier precision;		// refinement of the times
+    ResultCache* result_cache;		// not owned, may be NULL
 };
 
 #endif
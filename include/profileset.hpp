@@ -0,0 +1,43 @@
+﻿#ifndef PROFILESET_H
+#define PROFILESET_H
+
+#include <vector>
+
+#include "calculator.hpp"
+
+/* -------------------- Profile Sets --------------------- */
+
+// Prayer times of one place and day under several profiles side by side,
+// e.g. Shafii and Hanafi Asr or the Fajr and Isha angles of MWL, ISNA and
+// Egypt.
+//
+// With the default precision tier every profile evaluates the sun at the
+// same fixed guesses of compute_times, so the sun positions, mid-day,
+// latitude trig and the Sunrise, Dhuhr and Sunset times are computed once
+// per query and ephemeris mode. Each profile then only adds the hour angles
+// of its own Fajr, Maghrib and Isha angles, an Asr per juristic method and
+// its adjust_times. The times are identical to those of compute_day_times
+// of every profile; profiles of another precision tier are computed on their
+// own.
+class ProfileSet
+{
+public:
+    ProfileSet();
+    explicit ProfileSet(const std::vector<CalcProfile>& profiles);
+    ProfileSet(const CalcProfile profiles[], int count);
+
+    /* append a profile, its times come after those of the previous ones */
+    void add(CalcProfile profile);
+
+    int size() const { return (int) calculators.size(); }
+    const Calculator& calculator(int i) const { return calculators[i]; }
+
+    /* compute prayer times of the day of a query for every profile,
+       times holds TimesCount values per profile in the order they were added */
+    void compute_day_times(const Query& query, double times[]) const;
+
+private:
+    std::vector<Calculator> calculators;
+};
+
+#endif
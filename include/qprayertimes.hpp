@@ -0,0 +1,32 @@
+﻿#ifndef QPRAYERTIMES_H
+#define QPRAYERTIMES_H
+
+#include <QObject>
+
+#include "prayertimes.hpp"
+#include "qtimetablejob.hpp"
+
+/* -------------------- QPrayerTimes Class --------------------- */
+
+// PrayerTimes as a QObject, for code that wants parent ownership or
+// signals and slots. Only built when Qt5Core is found.
+// Large timetables are computed off the calling thread by a QTimetableJob.
+class QPrayerTimes : public QObject, public PrayerTimes
+{
+    Q_OBJECT
+public:
+    explicit QPrayerTimes(QObject* parent = 0,
+                          Parameters::CalculationMethod calc_method = Parameters::CalculationMethod::Jafari,
+                          Parameters::JuristicMethod asr_juristic = Parameters::JuristicMethod::Shafii,
+                          Parameters::AdjustingMethod adjust_high_lats = Parameters::AdjustingMethod::MidNight,
+                          double dhuhr_minutes = 0);
+    ~QPrayerTimes();
+
+    /* start computing timetables with the current settings on the global
+       thread pool, see QTimetableJob::start; the job is a child of this
+       object and deletes itself after finished, NULL if nothing to compute */
+    QTimetableJob* start_timetables(const QVector<Location>& locations, int year, int month, int day, int num_days,
+                                    const TimeZone* zone = NULL);
+};
+
+#endif
@@ -0,0 +1,113 @@
+﻿#ifndef QTIMETABLEJOB_H
+#define QTIMETABLEJOB_H
+
+#include <QMetaType>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "calculator.hpp"
+
+class QThreadPool;
+class TimeZone;
+
+/* -------------------- Asynchronous Timetables --------------------- */
+
+// Times of consecutive days of one location, computed by one task of a
+// QTimetableJob. times uses the Timetable layout ([prayer][day], hours, NaN
+// where undefined). The vector is implicitly shared, so queued signals
+// carry it to other threads without copying the times.
+struct QTimetableChunk
+{
+    QTimetableChunk()
+        : location(0)
+        , first_day(0)
+        , days(0)
+    {
+    }
+
+    const double* times(int time_id) const { return times_data.constData() + time_id * days; }
+    double at(int day, int time_id) const { return times_data[time_id * days + day]; }
+
+    int location;		// index into the locations of the job
+    int first_day;		// days since the first day of the job
+    int days;
+    QVector<double> times_data;
+};
+
+Q_DECLARE_METATYPE(QTimetableChunk)
+
+// Computes the timetables of many locations over a range of days on a
+// thread pool while the thread of the job keeps running its event loop.
+//
+// The work is split into one task per location and chunk of chunk_days()
+// days. Tasks hand their results to the thread the job lives in, which
+// emits chunk_ready and progress for every chunk and finished once every
+// task is done, cancelled ones included. The job needs an event loop.
+//
+//     QTimetableJob* job = new QTimetableJob(prayer_times.config(), this);
+//     connect(job, &QTimetableJob::chunk_ready, this, &Window::add_chunk);
+//     connect(job, &QTimetableJob::finished, job, &QObject::deleteLater);
+//     job->start(locations, 2024, 1, 1, 5 * 365);
+//
+// Deleting a running job cancels it without waiting for the tasks already
+// running; their results are dropped.
+class QTimetableJob : public QObject
+{
+    Q_OBJECT
+public:
+    enum
+    {
+        DEFAULT_CHUNK_DAYS = 366,
+    };
+
+    explicit QTimetableJob(const CalcConfig& config, QObject* parent = 0);
+    ~QTimetableJob();
+
+    /* days per task, DEFAULT_CHUNK_DAYS by default; takes effect on the next start */
+    void set_chunk_days(int days);
+    int chunk_days() const { return chunk_size; }
+
+    /* pool running the tasks, QThreadPool::globalInstance() by default;
+       it must outlive the tasks of the job */
+    void set_thread_pool(QThreadPool* pool);
+
+    /* schedule num_days days from a date on for every location. Times are
+       local to zone when given (which must outlive the job), else to each
+       location's timezone. False if the job is running or the range is
+       empty. */
+    bool start(const QVector<Location>& locations, int year, int month, int day, int num_days,
+               const TimeZone* zone = NULL);
+
+    bool is_running() const { return running; }
+    int total_chunks() const { return total; }
+    int completed_chunks() const { return done; }
+
+public slots:
+    /* drop the tasks not started yet and the results still to come;
+       finished(true) follows once the running tasks have returned */
+    void cancel();
+
+signals:
+    void chunk_ready(const QTimetableChunk& chunk);
+    void progress(int completed_chunks, int total_chunks);
+    void finished(bool cancelled);
+
+private slots:
+    void task_done(const QTimetableChunk& chunk, bool computed);
+
+private:
+    class Task;
+    struct Shared;
+
+    const Calculator calculator;
+    QThreadPool* pool;
+    int chunk_size;
+    QSharedPointer<Shared> shared;		// state of the current run, shared with its tasks
+    bool running;
+    bool cancelled;
+    int total;
+    int done;
+};
+
+#endif
@@ -0,0 +1,110 @@
+﻿#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+
+#include "calculator.hpp"
+
+/* -------------------- Result Cache --------------------- */
+
+// Bounded memo of day times in front of Calculator::compute_day_times.
+//
+// Entries are keyed by latitude and longitude rounded to a quantum, the
+// civil day, the time-zone in minutes and a 64 bit hash of the calculator
+// settings. Points closer than the quantum share the times of the first of
+// them computed; the default 1e-4 degree (about 11 m) moves a time by less
+// than 0.03 s.
+//
+// The cache is split into shards with a reader-writer lock each, and every
+// shard into sets of WAYS entries. Hits only take the shard lock shared and
+// set the referenced bit of the entry, so concurrent readers do not
+// serialize; a miss computes outside the lock and inserts under the
+// exclusive lock, evicting within the set by CLOCK (second chance).
+class ResultCache
+{
+public:
+    enum
+    {
+        WAYS = 8,		// entries per set
+        DEFAULT_SHARDS = 64,
+    };
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        std::size_t entries;		// in use
+        std::size_t capacity;
+        std::size_t memory_bytes;		// allocated by the cache
+
+        double hit_rate() const { return hits + misses ? (double) hits / (hits + misses) : 0.0; }
+    };
+
+    /* room for about capacity days, rounded up to whole sets;
+       shards is rounded up to a power of two */
+    explicit ResultCache(std::size_t capacity = 1 << 16, double quantum = 1e-4, unsigned shards = DEFAULT_SHARDS);
+    ~ResultCache();
+
+    /* times of a day like calculator.compute_day_times, from the cache when
+       present, else computed and stored; safe to call from any thread */
+    void day_times(const Calculator& calculator, int year, int month, int day,
+                   double latitude, double longitude, double timezone, double times[]);
+
+    /* forget every entry and reset the counters */
+    void clear();
+
+    Stats stats() const;
+
+    /* hash of every setting that changes the times */
+    static uint64_t settings_hash(const CalcConfig& config);
+
+private:
+    ResultCache(const ResultCache&);
+    ResultCache& operator=(const ResultCache&);
+
+    struct Key
+    {
+        uint64_t settings;
+        int32_t latitude;		// in quanta
+        int32_t longitude;
+        int32_t day;		// days since the epoch
+        int32_t timezone;		// minutes
+
+        bool operator==(const Key& other) const
+        {
+            return settings == other.settings && latitude == other.latitude && longitude == other.longitude
+                && day == other.day && timezone == other.timezone;
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        std::atomic<uint8_t> referenced;		// set by hits, cleared by the clock hand
+        bool used;
+        double times[Parameters::TimesCount];
+    };
+
+    struct Set
+    {
+        Entry ways[WAYS];
+        uint8_t hand;		// next eviction candidate
+    };
+
+    struct Shard;
+
+    Shard& shard_of(uint64_t hash) const;
+    Set& set_of(Shard& shard, uint64_t hash) const;
+
+    const double quantum;
+    unsigned num_shards;
+    std::size_t sets_per_shard;		// power of two
+    std::unique_ptr<Shard[]> shards;
+};
+
+#endif
@@ -0,0 +1,52 @@
+﻿#ifndef TIMEFORMAT_H
+#define TIMEFORMAT_H
+
+#include <cstddef>
+
+#include "parameters.hpp"
+
+/* -------------------- Time Formatting --------------------- */
+
+// Formatting of float hours into caller-provided buffers.
+//
+// Nothing here allocates: digits come from a table of two-digit pairs and
+// every function returns the end of what it wrote. Times are rounded to the
+// minute like PrayerTimes::get_float_time_parts.
+class TimeFormat
+{
+public:
+    enum
+    {
+        TIME24_SIZE = 5,		// "HH:MM"
+        TIME12_SIZE = 8,		// "hh:MM PM"
+        DATE_SIZE = 10,		// "YYYY-MM-DD"
+        ROW_SIZE = Parameters::TimesCount * (TIME24_SIZE + 1),		// times of one day, each followed by ' ' or '\n'
+        DATED_ROW_SIZE = DATE_SIZE + 1 + ROW_SIZE,
+    };
+
+    /* write num (0..99) as two digits */
+    static char* two_digits(int num, char* out);
+
+    /* write "HH:MM", nothing for NaN or infinity */
+    static char* time24(double time, char* out);
+
+    /* write "h:MM AM", or "h:MM" without suffix; nothing for NaN or infinity */
+    static char* time12(double time, char* out, bool no_suffix = false);
+
+    /* write "YYYY-MM-DD" */
+    static char* date(int year, int month, int day, char* out);
+
+    /* bytes written by timetable() */
+    static std::size_t timetable_size(const Timetable& table, bool with_dates);
+
+    /* format a whole timetable in one pass, one line of 24h times per day and
+       "--:--" for undefined times; with a start date every line begins with
+       its date. out must hold timetable_size() bytes; returns the end. */
+    static char* timetable(const Timetable& table, char* out);
+    static char* timetable(const Timetable& table, int year, int month, int day, char* out);
+
+private:
+    static char* timetable_rows(const Timetable& table, bool with_dates, int year, int month, int day, char* out);
+};
+
+#endif
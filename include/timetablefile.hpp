@@ -0,0 +1,86 @@
+﻿#ifndef TIMETABLEFILE_H
+#define TIMETABLEFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "calculator.hpp"
+
+class TimeZone;
+
+/* -------------------- Timetable Files --------------------- */
+
+// Compact binary timetables of many locations over a range of days.
+//
+// Times are stored as seconds since local midnight. Every location is split
+// into blocks of BLOCK_DAYS days; a block holds the int32 value of each
+// prayer on its first defined day and then one int16 day over day delta per
+// day and prayer, INT16_MIN marking an undefined time. That is about 15
+// bytes per location and day against 56 for double times[7]. The header
+// records the calculation settings and the zone the file was written for.
+//
+// A reader maps the file and decodes any (location, day) by summing at most
+// BLOCK_DAYS deltas, without copying or allocating.
+class TimetableFile
+{
+public:
+    enum
+    {
+        BLOCK_DAYS = 32,
+        ZONE_NAME_SIZE = 64,
+    };
+
+    TimetableFile();
+    ~TimetableFile();
+
+    /* compute and write num_days days from the given date for every location.
+       Times are local to zone when given (and its name is recorded), else to
+       each location's timezone. False if the file cannot be written or a day
+       over day change does not fit the format. threads == 0 uses one thread
+       per hardware thread. */
+    static bool write(const std::string& path, const CalcConfig& config,
+                      const Location locations[], std::size_t num_locations,
+                      int year, int month, int day, int num_days,
+                      const TimeZone* zone = NULL, unsigned threads = 0);
+
+    /* map a timetable file, false if it cannot be read or is malformed */
+    bool open(const std::string& path);
+    void close();
+
+    std::size_t num_locations() const;
+    int num_days() const;
+    const Location& location(std::size_t index) const;
+
+    /* settings the file was computed with */
+    CalcConfig config() const;
+
+    /* tz database zone of the times, empty when every location has its own fixed offset */
+    std::string zone_name() const;
+
+    /* calendar date of a day index */
+    void date(int day, int& year, int& month, int& mday) const;
+
+    /* times of a day in hours since local midnight, NaN where undefined;
+       false if location or day is out of range */
+    bool day_times(std::size_t location, int day, double times[]) const;
+
+    std::size_t file_size() const { return mapping_size; }
+
+private:
+    TimetableFile(const TimetableFile&);
+    TimetableFile& operator=(const TimetableFile&);
+
+    struct Header;
+    struct Block;
+
+    void* mapping;
+    std::size_t mapping_size;
+    const Header* header;
+    const Location* locations;
+    const Block* blocks;		// [location][block]
+    std::size_t blocks_per_location;
+    int64_t first_day;		// days since the epoch
+};
+
+#endif
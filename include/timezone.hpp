@@ -0,0 +1,156 @@
+﻿#ifndef TIMEZONE_H
+#define TIMEZONE_H
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* -------------------- Civil Calendar --------------------- */
+
+// Proleptic Gregorian calendar arithmetic without libc time functions.
+class CivilCalendar
+{
+public:
+    /* days since 1970-01-01 of a calendar date */
+    static int64_t days_from_civil(int year, int month, int day);
+
+    /* calendar date of a day count since 1970-01-01 */
+    static void civil_from_days(int64_t days, int& year, int& month, int& day);
+
+    /* day of week of a day count since 1970-01-01, 0 is Sunday */
+    static int weekday(int64_t days);
+
+    static bool is_leap_year(int year);
+};
+
+/* -------------------- Time Zones --------------------- */
+
+// One zone of the tz database, backed by its memory-mapped TZif file.
+//
+// Queries binary search the transition table inside the mapping and use the
+// POSIX rule of the file footer past the last transition. They never lock or
+// allocate, so a zone can be shared freely between threads.
+class TimeZone
+{
+public:
+    ~TimeZone();
+
+    const std::string& name() const { return zone_name; }
+
+    /* UTC offset in seconds at a UTC instant (seconds since the epoch) */
+    int32_t utc_offset(int64_t utc) const;
+
+    /* UTC offset in seconds in effect at a local wall clock time */
+    int32_t local_offset(int64_t local) const;
+
+    /* UTC offset in hours at local midnight of a date */
+    double timezone(int year, int month, int day) const;
+
+    /* timezone() of num_days consecutive days from a date, see Timetable::shift_days */
+    void day_offsets(int year, int month, int day, int num_days, double offsets[]) const;
+
+private:
+    friend class TimeZoneDb;
+
+    // POSIX TZ rule such as "EST5EDT,M3.2.0,M11.1.0"
+    struct Rule
+    {
+        enum DateKind { Julian1, Julian0, MonthWeekDay };
+
+        struct Date
+        {
+            DateKind kind;
+            int day;		// Jn, n or the d of Mm.w.d
+            int week;
+            int month;
+            int32_t time;		// seconds after local midnight
+        };
+
+        int32_t std_offset;		// seconds east of UTC
+        int32_t dst_offset;
+        bool has_dst;
+        Date start;
+        Date end;
+    };
+
+    TimeZone();
+    TimeZone(const TimeZone&);
+    TimeZone& operator=(const TimeZone&);
+
+    /* parse a mapped TZif file, false if it is malformed */
+    bool parse(const unsigned char* data, std::size_t size);
+    static bool parse_rule(const char* s, const char* end, Rule& rule);
+    static int64_t rule_transition(const Rule::Date& date, int year);
+    int32_t rule_offset(int64_t utc) const;
+    int64_t transition(std::size_t i) const;
+
+    std::string zone_name;
+    void* mapping;
+    std::size_t mapping_size;
+
+    const unsigned char* times;		// big-endian transition times
+    int time_size;		// 4 (version 1) or 8 bytes
+    const unsigned char* types;		// type index of every transition
+    std::size_t num_transitions;
+    int32_t type_offsets[256];		// UTC offset of every local time type
+    int32_t initial_offset;		// offset before the first transition
+
+    bool has_rule;
+    Rule rule;
+};
+
+// Loads zones by name from a tz database directory and keeps them for the
+// life of the process. Loading takes a lock; finding a zone that is already
+// loaded, and the returned zones, do not.
+class TimeZoneDb
+{
+public:
+    explicit TimeZoneDb(const std::string& root = "/usr/share/zoneinfo");
+    ~TimeZoneDb();
+
+    /* database of the system directory */
+    static TimeZoneDb& system();
+
+    /* zone by name, e.g. "Europe/London"; NULL if unknown or unreadable */
+    const TimeZone* find(const char* name);
+    const TimeZone* find(const std::string& name);
+
+    /* zone of the process: $TZ if it names a zone file, else /etc/localtime,
+       resolved on the first call */
+    const TimeZone* local();
+
+private:
+    typedef std::map<std::string, std::unique_ptr<TimeZone> > ZoneMap;
+
+    // open-addressed index of the loaded zones, read without the lock; a full
+    // index is replaced by one twice the size, the old one is kept for readers
+    struct Index
+    {
+        explicit Index(std::size_t size);
+
+        std::size_t mask;
+        std::size_t count;
+        std::unique_ptr<std::atomic<const ZoneMap::value_type*>[]> slots;
+    };
+
+    TimeZoneDb(const TimeZoneDb&);
+    TimeZoneDb& operator=(const TimeZoneDb&);
+
+    const TimeZone* load(const std::string& key, const std::string& path);
+    void publish(const ZoneMap::value_type& entry);
+
+    std::string root;
+    std::mutex lock;
+    ZoneMap zones;		// NULL entries remember failures
+    std::vector<std::unique_ptr<Index> > indexes;		// the last one is current
+    std::atomic<const Index*> index;
+    std::once_flag local_once;
+    const TimeZone* local_zone;
+};
+
+#endif
@@ -1,6 +1,7 @@
 ﻿#ifndef TRIGHELPER_H
 #define TRIGHELPER_H
 
+#include <cstddef>
 
 class TrigHelper{
 
@@ -44,6 +45,25 @@ public:
     /* range reduce hours to 0..23 */
     static double fix_hour(double a);
 
+    /* ---------------------- Array Variants ----------------------- */
+
+    // Each function maps n inputs to n outputs; out may alias the input.
+    // Vectorised with AVX2 or SSE2 when the CPU supports them, otherwise a
+    // scalar loop. Results stay within 1e-12 of the scalar functions above.
+
+    static void dsin(const double* d, double* out, std::size_t n);
+    static void dcos(const double* d, double* out, std::size_t n);
+    static void dtan(const double* d, double* out, std::size_t n);
+    static void darcsin(const double* x, double* out, std::size_t n);
+    static void darccos(const double* x, double* out, std::size_t n);
+    static void darctan2(const double* y, const double* x, double* out, std::size_t n);
+    static void darccot(const double* x, double* out, std::size_t n);
+    static void fix_angle(const double* a, double* out, std::size_t n);
+    static void fix_hour(const double* a, double* out, std::size_t n);
+
+    /* instruction set used by the array variants: "avx2", "sse2" or "scalar" */
+    static const char* simd_level();
+
 };
 
 #endif
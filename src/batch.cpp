@@ -0,0 +1,728 @@
+﻿#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include "batch.hpp"
+#include "timeformat.hpp"
+#include "timezone.hpp"
+
+/* -------------------- Option Names --------------------- */
+
+namespace {
+
+struct Name
+{
+    const char* name;
+    int value;
+};
+
+const Name calc_method_names[] =
+{
+    { "jafari",  Parameters::Jafari },
+    { "karachi", Parameters::Karachi },
+    { "isna",    Parameters::ISNA },
+    { "mwl",     Parameters::MWL },
+    { "makkah",  Parameters::Makkah },
+    { "egypt",   Parameters::Egypt },
+    { "custom",  Parameters::Custom },
+    { NULL, 0 }
+};
+
+const Name juristic_method_names[] =
+{
+    { "shafii", Parameters::Shafii },
+    { "hanafi", Parameters::Hanafi },
+    { NULL, 0 }
+};
+
+const Name adjusting_method_names[] =
+{
+    { "none",       Parameters::None },
+    { "midnight",   Parameters::MidNight },
+    { "oneseventh", Parameters::OneSeventh },
+    { "anglebased", Parameters::AngleBased },
+    { NULL, 0 }
+};
+
+const Name precision_tier_names[] =
+{
+    { "fast",    Parameters::FastTier },
+    { "default", Parameters::DefaultTier },
+    { "precise", Parameters::PreciseTier },
+    { NULL, 0 }
+};
+
+bool find_name(const Name* names, const char* name, int& value)
+{
+    for (; names->name; ++names)
+        if (strcmp(names->name, name) == 0)
+        {
+            value = names->value;
+            return true;
+        }
+    return false;
+}
+
+}
+
+bool parse_calc_method(const char* name, Parameters::CalculationMethod& method)
+{
+    int value;
+    if (!find_name(calc_method_names, name, value))
+        return false;
+    method = (Parameters::CalculationMethod) value;
+    return true;
+}
+
+bool parse_juristic_method(const char* name, Parameters::JuristicMethod& method)
+{
+    int value;
+    if (!find_name(juristic_method_names, name, value))
+        return false;
+    method = (Parameters::JuristicMethod) value;
+    return true;
+}
+
+bool parse_adjusting_method(const char* name, Parameters::AdjustingMethod& method)
+{
+    int value;
+    if (!find_name(adjusting_method_names, name, value))
+        return false;
+    method = (Parameters::AdjustingMethod) value;
+    return true;
+}
+
+bool parse_precision_tier(const char* name, Parameters::PrecisionTier& tier)
+{
+    int value;
+    if (!find_name(precision_tier_names, name, value))
+        return false;
+    tier = (Parameters::PrecisionTier) value;
+    return true;
+}
+
+/* -------------------- Batch Records --------------------- */
+
+namespace {
+
+const char* const csv_fields[] = { "lat", "lon", "date", "days", "tz", "method", "asr", "high_lats" };
+const int csv_field_count = sizeof(csv_fields) / sizeof(csv_fields[0]);
+
+const char* const json_time_names[] =
+{
+    "\"fajr\":", "\"sunrise\":", "\"dhuhr\":", "\"asr\":", "\"sunset\":", "\"maghrib\":", "\"isha\":",
+};
+
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+char* skip_space(char* p)
+{
+    while (is_space(*p))
+        ++p;
+    return p;
+}
+
+/* strip blanks around a NUL terminated field */
+char* trim(char* s)
+{
+    s = skip_space(s);
+    char* end = s + strlen(s);
+    while (end > s && is_space(end[-1]))
+        --end;
+    *end = '\0';
+    return s;
+}
+
+bool to_double(const char* s, double& value)
+{
+    char* end;
+    value = strtod(s, &end);
+    return end != s && *end == '\0' && std::isfinite(value);
+}
+
+bool to_int(const char* s, long& value)
+{
+    char* end;
+    value = strtol(s, &end, 10);
+    return end != s && *end == '\0';
+}
+
+/* YYYY-MM-DD */
+bool to_date(const char* s, int& year, int& month, int& day)
+{
+    char tail;
+    if (sscanf(s, "%d-%d-%d%c", &year, &month, &day, &tail) != 3)
+        return false;
+    if (month < 1 || month > 12 || day < 1 || day > 31)
+        return false;
+    int y, m, d;
+    CivilCalendar::civil_from_days(CivilCalendar::days_from_civil(year, month, day), y, m, d);
+    return y == year && m == month && d == day;
+}
+
+char* put_uint(uint64_t value, char* out)
+{
+    char digits[20];
+    int n = 0;
+    do
+    {
+        digits[n++] = (char) ('0' + value % 10);
+        value /= 10;
+    }
+    while (value);
+    while (n)
+        *out++ = digits[--n];
+    return out;
+}
+
+char* put_string(const char* s, char* out)
+{
+    std::size_t n = strlen(s);
+    memcpy(out, s, n);
+    return out + n;
+}
+
+}
+
+RecordParser::RecordParser(const PrayerTimes& defaults, double timezone, const TimeZone* zone)
+    : defaults(defaults)
+    , default_timezone(timezone)
+    , default_zone(zone)
+{
+}
+
+RecordParser::~RecordParser()
+{
+}
+
+bool RecordParser::parse(Format format, char* line, Record& record, const char*& error)
+{
+    return format == Csv ? parse_csv(line, record, error) : parse_json(line, record, error);
+}
+
+void RecordParser::prepare(Record& record, uint64_t line_number)
+{
+    record.line_number = line_number;
+    record.calculator = &calculator(record);
+    record.first_timezone = day_timezone(record, record.year, record.month, record.day);
+}
+
+bool RecordParser::parse_csv(char* line, Record& record, const char*& error)
+{
+    memset(&record, 0, sizeof(record));
+    record.latitude = record.longitude = record.timezone = NAN;
+    record.days = 1;
+    record.method = record.asr = record.high_lats = -1;
+
+    int field = 0;
+    for (char* p = line; p; ++field)
+    {
+        char* comma = strchr(p, ',');
+        if (comma)
+            *comma = '\0';
+        if (field >= csv_field_count)
+        {
+            error = "too many fields";
+            return false;
+        }
+        char* value = trim(p);
+        std::size_t length = strlen(value);
+        if (length >= 2 && value[0] == '"' && value[length - 1] == '"')
+        {
+            value[length - 1] = '\0';
+            ++value;
+        }
+        if (!parse_field(csv_fields[field], value, record, error))
+            return false;
+        p = comma ? comma + 1 : NULL;
+    }
+
+    if (std::isnan(record.latitude) || std::isnan(record.longitude) || record.year == 0)
+    {
+        error = "latitude, longitude and date are required";
+        return false;
+    }
+    return true;
+}
+
+bool RecordParser::parse_json(char* line, Record& record, const char*& error)
+{
+    memset(&record, 0, sizeof(record));
+    record.latitude = record.longitude = record.timezone = NAN;
+    record.days = 1;
+    record.method = record.asr = record.high_lats = -1;
+
+    // flat objects of string, number and null values
+    char* p = skip_space(line);
+    if (*p++ != '{')
+    {
+        error = "expected a JSON object";
+        return false;
+    }
+    for (;;)
+    {
+        p = skip_space(p);
+        if (*p == '}')
+            break;
+        if (*p != '"')
+        {
+            error = "expected a key";
+            return false;
+        }
+        char* key = ++p;
+        p = strchr(p, '"');
+        if (!p)
+        {
+            error = "unterminated key";
+            return false;
+        }
+        *p = '\0';
+        p = skip_space(p + 1);
+        if (*p++ != ':')
+        {
+            error = "expected ':'";
+            return false;
+        }
+        p = skip_space(p);
+
+        char* value;
+        if (*p == '"')
+        {
+            value = ++p;
+            p += strcspn(p, "\"\\");
+            if (*p != '"')
+            {
+                error = "unterminated or escaped string";
+                return false;
+            }
+            *p++ = '\0';
+            if (!parse_field(key, value, record, error))
+                return false;
+        }
+        else
+        {
+            value = p;
+            p += strcspn(p, ",} \t\r");
+            char separator = *p;
+            *p = '\0';
+            bool ok = strcmp(value, "null") == 0 || parse_field(key, value, record, error);
+            *p = separator;
+            if (!ok)
+                return false;
+        }
+
+        p = skip_space(p);
+        if (*p == ',')
+            ++p;
+        else if (*p != '}')
+        {
+            error = "expected ',' or '}'";
+            return false;
+        }
+    }
+    if (*skip_space(p + 1))
+    {
+        error = "trailing characters after object";
+        return false;
+    }
+
+    if (std::isnan(record.latitude) || std::isnan(record.longitude) || record.year == 0)
+    {
+        error = "lat, lon and date are required";
+        return false;
+    }
+    return true;
+}
+
+bool RecordParser::parse_field(const char* key, const char* value, Record& record, const char*& error)
+{
+    if (!*value)
+        return true;		// empty: keep the default
+
+    if (strcmp(key, "lat") == 0 || strcmp(key, "latitude") == 0)
+    {
+        if (!to_double(value, record.latitude) || fabs(record.latitude) > 90)
+        {
+            error = "invalid latitude";
+            return false;
+        }
+    }
+    else if (strcmp(key, "lon") == 0 || strcmp(key, "longitude") == 0)
+    {
+        if (!to_double(value, record.longitude) || fabs(record.longitude) > 180)
+        {
+            error = "invalid longitude";
+            return false;
+        }
+    }
+    else if (strcmp(key, "date") == 0)
+    {
+        if (!to_date(value, record.year, record.month, record.day))
+        {
+            error = "invalid date, expected YYYY-MM-DD";
+            return false;
+        }
+    }
+    else if (strcmp(key, "days") == 0)
+    {
+        long days;
+        if (!to_int(value, days) || days < 1 || days > MAX_DAYS)
+        {
+            error = "invalid number of days";
+            return false;
+        }
+        record.days = (int) days;
+    }
+    else if (strcmp(key, "tz") == 0 || strcmp(key, "timezone") == 0 || strcmp(key, "zone") == 0)
+        return parse_tz(value, record, error);
+    else if (strcmp(key, "method") == 0)
+    {
+        Parameters::CalculationMethod method;
+        if (!parse_calc_method(value, method))
+        {
+            error = "unknown method";
+            return false;
+        }
+        record.method = method;
+    }
+    else if (strcmp(key, "asr") == 0)
+    {
+        Parameters::JuristicMethod method;
+        if (!parse_juristic_method(value, method))
+        {
+            error = "unknown asr juristic method";
+            return false;
+        }
+        record.asr = method;
+    }
+    else if (strcmp(key, "high_lats") == 0)
+    {
+        Parameters::AdjustingMethod method;
+        if (!parse_adjusting_method(value, method))
+        {
+            error = "unknown high-lats method";
+            return false;
+        }
+        record.high_lats = method;
+    }
+    return true;		// unknown keys are ignored
+}
+
+bool RecordParser::parse_tz(const char* value, Record& record, const char*& error)
+{
+    // an offset in hours, or a zone name
+    if (to_double(value, record.timezone))
+        return true;
+    record.timezone = NAN;
+
+    record.zone = TimeZoneDb::system().find(value);
+    if (!record.zone)
+    {
+        error = "unknown zone";
+        return false;
+    }
+    return true;
+}
+
+const Calculator& RecordParser::calculator(const Record& record)
+{
+    std::unique_ptr<Calculator>& calc = calculators[record.method + 1][record.asr + 1][record.high_lats + 1];
+    if (!calc)
+    {
+        PrayerTimes settings(defaults);
+        if (record.method >= 0)
+            settings.set_calc_method((Parameters::CalculationMethod) record.method);
+        if (record.asr >= 0)
+            settings.set_asr_method((Parameters::JuristicMethod) record.asr);
+        if (record.high_lats >= 0)
+            settings.set_high_lats_adjust_method((Parameters::AdjustingMethod) record.high_lats);
+        calc.reset(new Calculator(settings.config()));
+    }
+    return *calc;
+}
+
+double RecordParser::day_timezone(const Record& record, int year, int month, int day) const
+{
+    if (!std::isnan(record.timezone))
+        return record.timezone;
+    if (record.zone)
+        return record.zone->timezone(year, month, day);
+    if (!std::isnan(default_timezone))
+        return default_timezone;
+    if (default_zone)
+        return default_zone->timezone(year, month, day);
+    return PrayerTimes::get_effective_timezone(year, month, day);
+}
+
+void RecordParser::shift_days(const Record& record, Timetable& table) const
+{
+    bool fixed_offset = !std::isnan(record.timezone) || (!record.zone && !std::isnan(default_timezone));
+    if (fixed_offset)
+        return;
+    std::vector<double> offsets(table.days);
+    const TimeZone* zone = record.zone ? record.zone : default_zone;
+    if (zone)
+        zone->day_offsets(record.year, record.month, record.day, table.days, &offsets[0]);
+    else
+    {
+        const int64_t first = CivilCalendar::days_from_civil(record.year, record.month, record.day);
+        for (int d = 0; d < table.days; ++d)
+        {
+            int year, month, day;
+            CivilCalendar::civil_from_days(first + d, year, month, day);
+            offsets[d] = PrayerTimes::get_effective_timezone(year, month, day);
+        }
+    }
+    table.shift_days(&offsets[0], record.first_timezone);
+}
+
+void RecordParser::day_times(const Record& record, const Timetable& table, int d, int& year, int& month, int& day, double times[]) const
+{
+    if (d == 0)
+    {
+        year = record.year;
+        month = record.month;
+        day = record.day;
+    }
+    else
+        CivilCalendar::civil_from_days(CivilCalendar::days_from_civil(record.year, record.month, record.day) + d, year, month, day);
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+        times[i] = table.at(d, i);
+}
+
+char* RecordParser::format_day(Format format, uint64_t line_number, int year, int month, int day, const double times[], char* p)
+{
+    if (format == Csv)
+    {
+        p = put_uint(line_number, p);
+        *p++ = ',';
+        p = TimeFormat::date(year, month, day, p);
+        for (int i = 0; i < Parameters::TimesCount; ++i)
+        {
+            *p++ = ',';
+            p = TimeFormat::time24(times[i], p);
+        }
+        return p;
+    }
+
+    p = put_string("{\"line\":", p);
+    p = put_uint(line_number, p);
+    p = put_string(",\"date\":\"", p);
+    p = TimeFormat::date(year, month, day, p);
+    *p++ = '"';
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+    {
+        *p++ = ',';
+        p = put_string(json_time_names[i], p);
+        if (std::isnan(times[i]))
+            p = put_string("null", p);
+        else
+        {
+            *p++ = '"';
+            p = TimeFormat::time24(times[i], p);
+            *p++ = '"';
+        }
+    }
+    *p++ = '}';
+    return p;
+}
+
+/* -------------------- Batch Mode --------------------- */
+
+namespace {
+
+const std::size_t READ_SIZE = 1 << 20;
+const std::size_t WRITE_SIZE = 1 << 20;
+
+}
+
+BatchRunner::BatchRunner(const PrayerTimes& defaults, Format format, double timezone, const TimeZone* zone, unsigned threads)
+    : parser(defaults, timezone, zone)
+    , format(format)
+    , tables(BLOCK_RECORDS)
+    , block_days(0)
+    , out_fd(-1)
+    , out(WRITE_SIZE)
+    , out_used(0)
+    , write_failed(false)
+{
+    memset(&counters, 0, sizeof(counters));
+    if (threads != 1)
+    {
+        pool.reset(new WorkStealingPool(threads));
+        if (pool->size() == 0)		// only the calling thread
+            pool.reset();
+    }
+    block.reserve(BLOCK_RECORDS);
+}
+
+BatchRunner::~BatchRunner()
+{
+}
+
+bool BatchRunner::run(int in_fd, int fd)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    out_fd = fd;
+    if (format == Csv)
+    {
+        static const char header[] = "line,date,fajr,sunrise,dhuhr,asr,sunset,maghrib,isha\n";
+        memcpy(&out[0], header, sizeof(header) - 1);
+        out_used = sizeof(header) - 1;
+    }
+
+    std::vector<char> in(READ_SIZE + 1);		// room for a terminating NUL
+    std::size_t filled = 0;
+    uint64_t line_number = 0;
+    bool eof = false, read_failed = false;
+    while (!eof && !write_failed)
+    {
+        ssize_t n = read(in_fd, &in[filled], in.size() - 1 - filled);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Error: read");
+            read_failed = true;
+            break;
+        }
+        eof = n == 0;
+        filled += n;
+
+        // handle every complete line, and the rest at end of input
+        char* begin = &in[0];
+        char* end = begin + filled;
+        for (;;)
+        {
+            char* newline = (char*) memchr(begin, '\n', end - begin);
+            if (!newline)
+            {
+                if (!eof || begin == end)
+                    break;
+                newline = end;
+            }
+            *newline = '\0';
+            ++line_number;
+
+            char* line = skip_space(begin);
+            bool header = line_number == 1 && format == Csv && isalpha((unsigned char) *line);
+            if (*line && *line != '#' && !header)
+            {
+                Record record;
+                const char* error = NULL;
+                if (parser.parse(format, line, record, error))
+                {
+                    parser.prepare(record, line_number);
+                    block.push_back(record);
+                    block_days += record.days;
+                    if (block.size() == BLOCK_RECORDS || block_days >= BLOCK_DAYS)
+                        process_block();
+                }
+                else
+                {
+                    fprintf(stderr, "Error: line %llu: %s\n", (unsigned long long) line_number, error);
+                    ++counters.rejected;
+                }
+            }
+            begin = newline + (newline < end);
+        }
+
+        // keep a partial line, growing the buffer for overlong ones
+        filled = end - begin;
+        memmove(&in[0], begin, filled);
+        if (filled == in.size() - 1)
+            in.resize(in.size() * 2);
+    }
+
+    process_block();
+    flush();
+    counters.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return !read_failed && !write_failed;
+}
+
+bool BatchRunner::process_block()
+{
+    std::size_t n = block.size();
+    if (pool && n > 1)
+        pool->parallel_for(n, 16, [this](std::size_t begin, std::size_t end) { compute(begin, end); });
+    else
+        compute(0, n);
+
+    for (std::size_t i = 0; i < n && !write_failed; ++i)
+        write_record(block[i], tables[i]);
+    block.clear();
+    block_days = 0;
+    return !write_failed;
+}
+
+void BatchRunner::compute(std::size_t begin, std::size_t end)
+{
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        const Record& record = block[i];
+        Timetable& table = tables[i];
+        table.resize(record.days);
+        Query query = Query::make(record.year, record.month, record.day, record.latitude, record.longitude, record.first_timezone);
+        if (record.days == 1)
+            record.calculator->compute_day_times(query, &table.data[0]);		// one day is laid out like a times array
+        else
+        {
+            record.calculator->compute_range_times(query, table);
+            parser.shift_days(record, table);
+        }
+    }
+}
+
+bool BatchRunner::write_record(const Record& record, const Timetable& table)
+{
+    for (int d = 0; d < record.days; ++d)
+    {
+        int year, month, day;
+        double times[Parameters::TimesCount];
+        parser.day_times(record, table, d, year, month, day, times);
+        if (!reserve(RecordParser::MAX_ROW_SIZE))
+            return false;
+        char* p = RecordParser::format_day(format, record.line_number, year, month, day, times, &out[out_used]);
+        *p++ = '\n';
+        out_used = p - &out[0];
+    }
+
+    ++counters.records;
+    counters.days += record.days;
+    return true;
+}
+
+bool BatchRunner::reserve(std::size_t bytes)
+{
+    if (out.size() - out_used < bytes)
+        return flush();
+    return !write_failed;
+}
+
+bool BatchRunner::flush()
+{
+    std::size_t done = 0;
+    while (done < out_used && !write_failed)
+    {
+        ssize_t n = write(out_fd, &out[done], out_used - done);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Error: write");
+            write_failed = true;
+        }
+        else
+            done += n;
+    }
+    out_used = 0;
+    return !write_failed;
+}
@@ -0,0 +1,175 @@
+﻿#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "prayertimes.hpp"
+#include "calculator.hpp"
+#include "executor.hpp"
+
+class TimeZone;
+
+/* -------------------- Option Names --------------------- */
+
+// names accepted by the command line options and by batch records,
+// false if the name is unknown
+
+bool parse_calc_method(const char* name, Parameters::CalculationMethod& method);
+bool parse_juristic_method(const char* name, Parameters::JuristicMethod& method);
+bool parse_adjusting_method(const char* name, Parameters::AdjustingMethod& method);
+bool parse_precision_tier(const char* name, Parameters::PrecisionTier& tier);
+
+/* -------------------- Batch Records --------------------- */
+
+// Parses the query records of batch mode and of the query server, either CSV
+//
+//     latitude,longitude,date[,days[,timezone[,method[,asr[,high-lats]]]]]
+//
+// or flat JSON objects with the keys lat, lon, date, days, tz, method, asr
+// and high_lats. date is YYYY-MM-DD, tz is an offset in hours or a tz
+// database zone name; empty or missing fields take the command line
+// settings. One Calculator per method combination is built on first use and
+// kept. Not thread-safe: every thread needs its own parser.
+class RecordParser
+{
+public:
+    enum Format { Csv, NdJson };
+
+    struct Record
+    {
+        double latitude;
+        double longitude;
+        int year, month, day;
+        int days;
+        double timezone;		// NAN: use zone or the defaults
+        const TimeZone* zone;
+        int method;		// -1: defaults
+        int asr;
+        int high_lats;
+
+        // filled in by prepare()
+        uint64_t line_number;
+        const Calculator* calculator;
+        double first_timezone;		// time-zone of the first day
+    };
+
+    static const int MAX_DAYS = 366 * 100;		// longest range of one record
+    static const std::size_t MAX_ROW_SIZE = 256;		// longest output line
+
+    /* defaults are the command line settings; timezone may be NAN and zone NULL */
+    RecordParser(const PrayerTimes& defaults, double timezone, const TimeZone* zone);
+    ~RecordParser();
+
+    /* parse a NUL terminated line, which is modified; error is set on failure */
+    bool parse(Format format, char* line, Record& record, const char*& error);
+
+    /* set the line number, calculator and first time-zone of a parsed record */
+    void prepare(Record& record, uint64_t line_number);
+
+    /* move the days of a record computed in its first_timezone into the time-zone of each day */
+    void shift_days(const Record& record, Timetable& table) const;
+
+    /* date and times of day d of a record after shift_days */
+    void day_times(const Record& record, const Timetable& table, int d, int& year, int& month, int& day, double times[]) const;
+
+    /* one output line of a day, tagged with the record line number and without the
+       newline; at most MAX_ROW_SIZE bytes */
+    static char* format_day(Format format, uint64_t line_number, int year, int month, int day, const double times[], char* out);
+
+private:
+    RecordParser(const RecordParser&);
+    RecordParser& operator=(const RecordParser&);
+
+    bool parse_csv(char* line, Record& record, const char*& error);
+    bool parse_json(char* line, Record& record, const char*& error);
+    bool parse_field(const char* key, const char* value, Record& record, const char*& error);
+    bool parse_tz(const char* value, Record& record, const char*& error);
+
+    const Calculator& calculator(const Record& record);
+    double day_timezone(const Record& record, int year, int month, int day) const;
+
+    const PrayerTimes& defaults;
+    double default_timezone;
+    const TimeZone* default_zone;
+
+    // lazily built calculators, indexed by method, asr and high-lats method plus one,
+    // 0 standing for the command line setting
+    std::unique_ptr<Calculator> calculators[Parameters::CalculationMethodsCount + 1][3][5];
+};
+
+/* -------------------- Batch Mode --------------------- */
+
+// Streaming batch mode of the command line tool.
+//
+// Reads one query record per line from a file descriptor, CSV or NDJSON as
+// described at RecordParser. Every day of a query gives one output line in
+// the input format, tagged with the input line number. Rejected lines are
+// reported on stderr and skipped.
+//
+// Input is read and output written in large blocks, and one Calculator per
+// method combination is kept for the whole stream. Parsed records are
+// computed in blocks on a WorkStealingPool and written in input order.
+class BatchRunner
+{
+public:
+    typedef RecordParser::Format Format;
+    static constexpr Format Csv = RecordParser::Csv;
+    static constexpr Format NdJson = RecordParser::NdJson;
+
+    struct Stats
+    {
+        uint64_t records;		// accepted queries
+        uint64_t days;		// output lines
+        uint64_t rejected;		// malformed lines
+        double seconds;		// wall time of run()
+    };
+
+    /* defaults are the command line settings; timezone may be NAN and zone NULL;
+       threads == 0 uses one thread per hardware thread */
+    BatchRunner(const PrayerTimes& defaults, Format format, double timezone, const TimeZone* zone, unsigned threads = 0);
+    ~BatchRunner();
+
+    /* process records until end of input; false on a read or write error */
+    bool run(int in_fd, int out_fd);
+
+    const Stats& stats() const { return counters; }
+
+    static const int MAX_DAYS = RecordParser::MAX_DAYS;
+    static const std::size_t BLOCK_RECORDS = 4096;		// records computed together
+    static const std::size_t BLOCK_DAYS = 1 << 16;		// days computed together
+
+private:
+    BatchRunner(const BatchRunner&);
+    BatchRunner& operator=(const BatchRunner&);
+
+    typedef RecordParser::Record Record;
+
+    /* compute and write the queued records */
+    bool process_block();
+    void compute(std::size_t begin, std::size_t end);
+    bool write_record(const Record& record, const Timetable& table);
+
+    bool reserve(std::size_t bytes);
+    bool flush();
+
+    RecordParser parser;
+    Format format;
+    std::unique_ptr<WorkStealingPool> pool;		// NULL when running on one thread
+
+    std::vector<Record> block;
+    std::vector<Timetable> tables;		// results of block[i]
+    std::size_t block_days;
+
+    int out_fd;
+    std::vector<char> out;
+    std::size_t out_used;
+    bool write_failed;
+
+    Stats counters;
+};
+
+#endif
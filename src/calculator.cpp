@@ -0,0 +1,876 @@
+﻿/*-------------------------- In the name of God ----------------------------*\
+ 
+    PrayerTimes 0.3
+    Islamic prayer times calculator
+    Based on PrayTimes 1.1 JavaScript library
+
+----------------------------- Copyright Block --------------------------------
+
+Copyright (C) 2007-2010 PrayTimes.org
+
+Developed By: Mohammad Ebrahim Mohammadi Panah <ebrahim at mohammadi dot ir>
+Based on a JavaScript Code By: Hamid Zarrabi-Zadeh
+
+License: GNU LGPL v3.0
+
+TERMS OF USE:
+    Permission is granted to use this code, with or
+    without modification, in any website or application
+    provided that credit is given to the original work
+    with a link back to PrayTimes.org.
+
+This program is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY.
+
+PLEASE DO NOT REMOVE THIS COPYRIGHT BLOCK.
+
+------------------------------------------------------------------------------
+
+User's Manual:
+http://praytimes.org/manual
+
+Calculating Formulas:
+http://praytimes.org/calculation
+
+Code Repository:
+http://code.ebrahim.ir/prayertimes/
+
+\*--------------------------------------------------------------------------*/
+
+
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include "calculator.hpp"
+#include "ephemeris.hpp"
+#include "instrumentation.hpp"
+#include "trig.hpp"
+
+const double Calculator::PRECISE_TOLERANCE = 1e-6;
+
+namespace {
+
+/* true if no time moved more than tolerance hours, undefined times must stay undefined */
+bool converged(const double previous[], const double times[], int n, double tolerance)
+{
+    for (int i = 0; i < n; ++i)
+        if (!(fabs(times[i] - previous[i]) <= tolerance) && !(std::isnan(times[i]) && std::isnan(previous[i])))
+            return false;
+    return true;
+}
+
+}
+
+CalcProfile CalcProfile::make(Parameters::CalculationMethod method, Parameters::JuristicMethod asr_juristic,
+                              Parameters::AdjustingMethod adjust_high_lats, double dhuhr_minutes)
+{
+    CalcProfile profile;
+    profile.method = (uint8_t) method;
+    profile.asr_juristic = (uint8_t) asr_juristic;
+    profile.adjust_high_lats = (uint8_t) adjust_high_lats;
+    profile.ephemeris = Parameters::ExactEphemeris;
+    profile.precision = Parameters::DefaultTier;
+    profile.reserved = 0;
+    profile.dhuhr_minutes = to_units(dhuhr_minutes);
+    profile.set_overrides(BUILTIN_METHODS[Parameters::Custom]);
+    return profile;
+}
+
+CalcProfile CalcProfile::custom(const Parameters::MethodConfig& method, Parameters::JuristicMethod asr_juristic,
+                                Parameters::AdjustingMethod adjust_high_lats, double dhuhr_minutes)
+{
+    CalcProfile profile = make(Parameters::Custom, asr_juristic, adjust_high_lats, dhuhr_minutes);
+    profile.set_overrides(method);
+    return profile;
+}
+
+void CalcProfile::set_overrides(const Parameters::MethodConfig& method)
+{
+    flags = (method.maghrib_is_minutes ? MaghribMinutes : 0) | (method.isha_is_minutes ? IshaMinutes : 0);
+    fajr_angle = to_units(method.fajr_angle);
+    maghrib_value = to_units(method.maghrib_value);
+    isha_value = to_units(method.isha_value);
+}
+
+Parameters::MethodConfig CalcProfile::method_config() const
+{
+    if (method < Parameters::Custom)
+        return BUILTIN_METHODS[method];
+    return Parameters::MethodConfig(from_units(fajr_angle), (flags & MaghribMinutes) != 0, from_units(maghrib_value),
+                                    (flags & IshaMinutes) != 0, from_units(isha_value));
+}
+
+CalcConfig CalcProfile::config() const
+{
+    CalcConfig config;
+    config.method = method_config();
+    config.asr_juristic = (Parameters::JuristicMethod) asr_juristic;
+    config.adjust_high_lats = (Parameters::AdjustingMethod) adjust_high_lats;
+    config.dhuhr_minutes = from_units(dhuhr_minutes);
+    config.ephemeris = (Parameters::EphemerisMode) ephemeris;
+    config.precision = (Parameters::PrecisionTier) precision;
+    return config;
+}
+
+int32_t CalcProfile::to_units(double value)
+{
+    return (int32_t) llround(value * 1e6);
+}
+
+Query Query::make(int year, int month, int day, double latitude, double longitude, double timezone)
+{
+    Query query;
+    query.latitude = latitude;
+    query.longitude = longitude;
+    query.timezone = timezone;
+    query.julian_date = Calculator::julian_date(year, month, day) - longitude / (double) (15 * 24);
+    return query;
+}
+
+Query Query::make(int year, int month, int day, const Location& location)
+{
+    return make(year, month, day, location.latitude, location.longitude, location.timezone);
+}
+
+/* ---------------------- Specialized Kernels ----------------------- */
+
+// The compute and adjust functions of Calculator for one combination of
+// methods. method() is a compile-time constant for the built-in methods, so
+// their angles fold into the code and the branches on the minutes settings
+// and on the adjusting method disappear.
+template <Parameters::CalculationMethod M, Parameters::JuristicMethod J, Parameters::AdjustingMethod A>
+struct MethodKernel
+{
+    static const Calculator::Kernel kernel;
+
+    static const Parameters::MethodConfig& method(const Calculator& calc)
+    {
+        if constexpr (M == Parameters::Custom)
+            return calc.cfg.method;
+        else
+            return BUILTIN_METHODS[M];
+    }
+
+    static double night_portion(double angle)
+    {
+        switch (A)
+        {
+        case Parameters::AngleBased:
+            return angle / 60.0;
+        case Parameters::MidNight:
+            return 1.0 / 2.0;
+        case Parameters::OneSeventh:
+            return 1.0 / 7.0;
+        default:
+            return 0;
+        }
+    }
+
+    static void compute_times(const Calculator& calc, const Query& query, double times[])
+    {
+        PT_STAGE(ComputeTimesStage);
+        const Parameters::MethodConfig& m = method(calc);
+        Calculator::day_portion(times);
+
+        times[Parameters::Fajr]    = calc.compute_time(query, 180.0 - m.fajr_angle, times[Parameters::Fajr]);
+        times[Parameters::Sunrise] = calc.compute_time(query, 180.0 - 0.833, times[Parameters::Sunrise]);
+        times[Parameters::Dhuhr]   = calc.compute_mid_day(query, times[Parameters::Dhuhr]);
+        times[Parameters::Asr]     = calc.compute_asr(query, 1 + J, times[Parameters::Asr]);
+        times[Parameters::Sunset]  = calc.compute_time(query, 0.833, times[Parameters::Sunset]);
+        times[Parameters::Maghrib] = calc.compute_time(query, m.maghrib_value, times[Parameters::Maghrib]);
+        times[Parameters::Isha]    = calc.compute_time(query, m.isha_value, times[Parameters::Isha]);
+    }
+
+    static void adjust_times(const Calculator& calc, const Query& query, double times[])
+    {
+        PT_STAGE(AdjustTimesStage);
+        const Parameters::MethodConfig& m = method(calc);
+        for (int i = 0; i < Parameters::TimesCount; ++i)
+            times[i] += query.timezone - query.longitude / 15.0;
+        times[Parameters::Dhuhr] += calc.cfg.dhuhr_minutes / 60.0;		// Dhuhr
+        if (m.maghrib_is_minutes)		// Maghrib
+            times[Parameters::Maghrib] = times[Parameters::Sunset] + m.maghrib_value / 60.0;
+        if (m.isha_is_minutes)		// Isha
+            times[Parameters::Isha] = times[Parameters::Maghrib] + m.isha_value / 60.0;
+
+        if (A != Parameters::None)
+            adjust_high_lat_times(calc, times);
+    }
+
+    static void adjust_high_lat_times(const Calculator& calc, double times[])
+    {
+        PT_STAGE(HighLatTimesStage);
+        const Parameters::MethodConfig& m = method(calc);
+        double night_time = Calculator::time_diff(times[Parameters::Sunset], times[Parameters::Sunrise]);		// sunset to sunrise
+
+        // Adjust Fajr
+        double fajr_diff = night_portion(m.fajr_angle) * night_time;
+        if (std::isnan(times[Parameters::Fajr]) || Calculator::time_diff(times[Parameters::Fajr], times[Parameters::Sunrise]) > fajr_diff)
+        {
+            times[Parameters::Fajr] = times[Parameters::Sunrise] - fajr_diff;
+            PT_COUNT(FajrAdjusted, 1);
+        }
+
+        // Adjust Isha
+        double isha_angle = m.isha_is_minutes ? 18.0 : m.isha_value;
+        double isha_diff = night_portion(isha_angle) * night_time;
+        if (std::isnan(times[Parameters::Isha]) || Calculator::time_diff(times[Parameters::Sunset], times[Parameters::Isha]) > isha_diff)
+        {
+            times[Parameters::Isha] = times[Parameters::Sunset] + isha_diff;
+            PT_COUNT(IshaAdjusted, 1);
+        }
+
+        // Adjust Maghrib
+        double maghrib_angle = m.maghrib_is_minutes ? 4.0 : m.maghrib_value;
+        double maghrib_diff = night_portion(maghrib_angle) * night_time;
+        if (std::isnan(times[Parameters::Maghrib]) || Calculator::time_diff(times[Parameters::Sunset], times[Parameters::Maghrib]) > maghrib_diff)
+        {
+            times[Parameters::Maghrib] = times[Parameters::Sunset] + maghrib_diff;
+            PT_COUNT(MaghribAdjusted, 1);
+        }
+    }
+
+    static void range_pass(const Calculator& calc, const Query& query, Timetable& table)
+    {
+        PT_STAGE(ComputeTimesStage);
+        const int n = table.days;
+        const Parameters::MethodConfig& m = method(calc);
+
+        // same as compute_times, but each call sweeps a chunk of days of a single prayer
+        for (int k = 0; k < n * Parameters::TimesCount; ++k)
+            table.data[k] /= 24.0;
+
+        double jd[Calculator::BATCH_SIZE];
+        for (int base = 0; base < n; base += Calculator::BATCH_SIZE)
+        {
+            const int count = std::min(Calculator::BATCH_SIZE, n - base);
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+            {
+                double* t = table.times(p) + base;
+                for (int k = 0; k < count; ++k)
+                    jd[k] = query.julian_date + (base + k) + t[k];
+
+                switch (p)
+                {
+                case Parameters::Fajr:
+                    calc.compute_time(query, 180.0 - m.fajr_angle, jd, t, count);
+                    break;
+                case Parameters::Sunrise:
+                    calc.compute_time(query, 180.0 - 0.833, jd, t, count);
+                    break;
+                case Parameters::Dhuhr:
+                    calc.compute_mid_day(jd, t, count);
+                    break;
+                case Parameters::Asr:
+                    calc.compute_asr(query, 1 + J, jd, t, count);
+                    break;
+                case Parameters::Sunset:
+                    calc.compute_time(query, 0.833, jd, t, count);
+                    break;
+                case Parameters::Maghrib:
+                    calc.compute_time(query, m.maghrib_value, jd, t, count);
+                    break;
+                case Parameters::Isha:
+                    calc.compute_time(query, m.isha_value, jd, t, count);
+                    break;
+                }
+            }
+        }
+    }
+
+    static void adjust_range_times(const Calculator& calc, const Query& query, Timetable& table)
+    {
+        PT_STAGE(AdjustTimesStage);
+        const int n = table.days;
+        const double offset = query.timezone - query.longitude / 15.0;
+        for (int k = 0; k < n * Parameters::TimesCount; ++k)
+            table.data[k] += offset;
+
+        const Parameters::MethodConfig& m = method(calc);
+        double* dhuhr = table.times(Parameters::Dhuhr);
+        double* sunset = table.times(Parameters::Sunset);
+        double* maghrib = table.times(Parameters::Maghrib);
+        double* isha = table.times(Parameters::Isha);
+
+        for (int d = 0; d < n; ++d)
+            dhuhr[d] += calc.cfg.dhuhr_minutes / 60.0;
+        if (m.maghrib_is_minutes)
+            for (int d = 0; d < n; ++d)
+                maghrib[d] = sunset[d] + m.maghrib_value / 60.0;
+        if (m.isha_is_minutes)
+            for (int d = 0; d < n; ++d)
+                isha[d] = maghrib[d] + m.isha_value / 60.0;
+
+        if (A != Parameters::None)
+            adjust_high_lat_range(calc, table);
+    }
+
+    static void adjust_high_lat_range(const Calculator& calc, Timetable& table)
+    {
+        PT_STAGE(HighLatTimesStage);
+        const Parameters::MethodConfig& m = method(calc);
+        const double fajr_portion = night_portion(m.fajr_angle);
+        const double isha_portion = night_portion(m.isha_is_minutes ? 18.0 : m.isha_value);
+        const double maghrib_portion = night_portion(m.maghrib_is_minutes ? 4.0 : m.maghrib_value);
+
+        double* fajr = table.times(Parameters::Fajr);
+        double* sunrise = table.times(Parameters::Sunrise);
+        double* sunset = table.times(Parameters::Sunset);
+        double* maghrib = table.times(Parameters::Maghrib);
+        double* isha = table.times(Parameters::Isha);
+
+        for (int d = 0; d < table.days; ++d)
+        {
+            double night_time = Calculator::time_diff(sunset[d], sunrise[d]);		// sunset to sunrise
+
+            double fajr_diff = fajr_portion * night_time;
+            if (std::isnan(fajr[d]) || Calculator::time_diff(fajr[d], sunrise[d]) > fajr_diff)
+            {
+                fajr[d] = sunrise[d] - fajr_diff;
+                PT_COUNT(FajrAdjusted, 1);
+            }
+
+            double isha_diff = isha_portion * night_time;
+            if (std::isnan(isha[d]) || Calculator::time_diff(sunset[d], isha[d]) > isha_diff)
+            {
+                isha[d] = sunset[d] + isha_diff;
+                PT_COUNT(IshaAdjusted, 1);
+            }
+
+            double maghrib_diff = maghrib_portion * night_time;
+            if (std::isnan(maghrib[d]) || Calculator::time_diff(sunset[d], maghrib[d]) > maghrib_diff)
+            {
+                maghrib[d] = sunset[d] + maghrib_diff;
+                PT_COUNT(MaghribAdjusted, 1);
+            }
+        }
+    }
+};
+
+template <Parameters::CalculationMethod M, Parameters::JuristicMethod J, Parameters::AdjustingMethod A>
+const Calculator::Kernel MethodKernel<M, J, A>::kernel =
+{
+    &MethodKernel::compute_times,
+    &MethodKernel::adjust_times,
+    &MethodKernel::adjust_high_lat_times,
+    &MethodKernel::range_pass,
+    &MethodKernel::adjust_range_times,
+    &MethodKernel::adjust_high_lat_range,
+};
+
+// Runtime dispatch to MethodKernel, done once per Calculator.
+struct KernelSelector
+{
+    static const Calculator::Kernel& select(const CalcConfig& config)
+    {
+        // the method whose settings config has, Custom if none
+        int method = 0;
+        while (method < Parameters::Custom && !same_settings(config.method, BUILTIN_METHODS[method]))
+            ++method;
+
+        switch (method)
+        {
+        case Parameters::Jafari:
+            return select<Parameters::Jafari>(config);
+        case Parameters::Karachi:
+            return select<Parameters::Karachi>(config);
+        case Parameters::ISNA:
+            return select<Parameters::ISNA>(config);
+        case Parameters::MWL:
+            return select<Parameters::MWL>(config);
+        case Parameters::Makkah:
+            return select<Parameters::Makkah>(config);
+        case Parameters::Egypt:
+            return select<Parameters::Egypt>(config);
+        default:
+            return select<Parameters::Custom>(config);
+        }
+    }
+
+    template <Parameters::CalculationMethod M>
+    static const Calculator::Kernel& select(const CalcConfig& config)
+    {
+        if (config.asr_juristic == Parameters::Hanafi)
+            return select<M, Parameters::Hanafi>(config);
+        return select<M, Parameters::Shafii>(config);
+    }
+
+    template <Parameters::CalculationMethod M, Parameters::JuristicMethod J>
+    static const Calculator::Kernel& select(const CalcConfig& config)
+    {
+        switch (config.adjust_high_lats)
+        {
+        case Parameters::MidNight:
+            return MethodKernel<M, J, Parameters::MidNight>::kernel;
+        case Parameters::OneSeventh:
+            return MethodKernel<M, J, Parameters::OneSeventh>::kernel;
+        case Parameters::AngleBased:
+            return MethodKernel<M, J, Parameters::AngleBased>::kernel;
+        default:
+            return MethodKernel<M, J, Parameters::None>::kernel;
+        }
+    }
+
+    static bool same_settings(const Parameters::MethodConfig& a, const Parameters::MethodConfig& b)
+    {
+        return a.fajr_angle == b.fajr_angle && a.maghrib_is_minutes == b.maghrib_is_minutes && a.maghrib_value == b.maghrib_value
+            && a.isha_is_minutes == b.isha_is_minutes && a.isha_value == b.isha_value;
+    }
+};
+
+Calculator::Calculator(const CalcConfig& config)
+    : cfg(config)
+    , kernel(&KernelSelector::select(config))
+{
+}
+
+Calculator::Calculator(CalcProfile profile)
+    : cfg(profile.config())
+    , kernel(&KernelSelector::select(cfg))
+{
+}
+
+Calculator::DoublePair Calculator::sun_position(double jd) const
+{
+    PT_COUNT(SunPositions, 1);
+    switch (cfg.ephemeris)
+    {
+    case Parameters::CachedEphemeris:
+        return SolarEphemeris::shared().sun_position(jd);
+    case Parameters::FittedEphemeris:
+        return FittedEphemeris::shared().sun_position(jd);
+    default:
+        return exact_sun_position(jd);
+    }
+}
+
+Calculator::DoublePair Calculator::exact_sun_position(double jd)
+{
+    double d = jd - 2451545.0;
+    double g = TrigHelper::fix_angle(357.529 + 0.98560028 * d);
+    double q = TrigHelper::fix_angle(280.459 + 0.98564736 * d);
+    double l = TrigHelper::fix_angle(q + 1.915 * TrigHelper::dsin(g) + 0.020 * TrigHelper::dsin(2 * g));
+
+    // double r = 1.00014 - 0.01671 * dcos(g) - 0.00014 * dcos(2 * g);
+    double e = 23.439 - 0.00000036 * d;
+
+    double dd = TrigHelper::darcsin(TrigHelper::dsin(e) * TrigHelper::dsin(l));
+    double ra = TrigHelper::darctan2(TrigHelper::dcos(e) * TrigHelper::dsin(l), TrigHelper::dcos(l)) / 15.0;
+    ra = TrigHelper::fix_hour(ra);
+    double eq_t = q / 15.0 - ra;
+
+    return DoublePair(dd, eq_t);
+}
+
+double Calculator::equation_of_time(double jd) const
+{
+    return sun_position(jd).second;
+}
+
+double Calculator::sun_declination(double jd) const
+{
+    return sun_position(jd).first;
+}
+
+double Calculator::compute_mid_day(const Query& query, double _t) const
+{
+    double t = equation_of_time(query.julian_date + _t);
+    double z = TrigHelper::fix_hour(12 - t);
+    return z;
+}
+
+double Calculator::compute_time(const Query& query, double g, double t) const
+{
+    double d = sun_declination(query.julian_date + t);
+    double z = compute_mid_day(query, t);
+    double v = 1.0 / 15.0 * TrigHelper::darccos((-TrigHelper::dsin(g) - TrigHelper::dsin(d) * TrigHelper::dsin(query.latitude)) / (TrigHelper::dcos(d) * TrigHelper::dcos(query.latitude)));
+    PT_COUNT_UNDEFINED(&v, 1);
+    return z + (g > 90.0 ? - v :  v);
+}
+
+double Calculator::compute_asr(const Query& query, int step, double t) const  // Shafii: step=1, Hanafi: step=2
+{
+    double d = sun_declination(query.julian_date + t);
+    double g = -TrigHelper::darccot(step + TrigHelper::dtan(fabs(query.latitude - d)));
+    return compute_time(query, g, t);
+}
+
+void Calculator::sun_position(const double jd[], double declination[], double eq_t[], int n) const
+{
+    PT_COUNT(SunPositions, n);
+    switch (cfg.ephemeris)
+    {
+    case Parameters::CachedEphemeris:
+        SolarEphemeris::shared().sun_position(jd, declination, eq_t, n);
+        break;
+    case Parameters::FittedEphemeris:
+        FittedEphemeris::shared().sun_position(jd, declination, eq_t, n);
+        break;
+    default:
+        exact_sun_position(jd, declination, eq_t, n);
+    }
+}
+
+void Calculator::exact_sun_position(const double jd[], double declination[], double eq_t[], int n)
+{
+    for (int base = 0; base < n; base += BATCH_SIZE)
+    {
+        const int m = std::min(BATCH_SIZE, n - base);
+        double d[BATCH_SIZE], g[BATCH_SIZE], q[BATCH_SIZE], l[BATCH_SIZE], e[BATCH_SIZE], a[BATCH_SIZE], b[BATCH_SIZE];
+
+        for (int i = 0; i < m; ++i)
+        {
+            d[i] = jd[base + i] - 2451545.0;
+            g[i] = 357.529 + 0.98560028 * d[i];
+            q[i] = 280.459 + 0.98564736 * d[i];
+            e[i] = 23.439 - 0.00000036 * d[i];
+        }
+        TrigHelper::fix_angle(g, g, m);
+        TrigHelper::fix_angle(q, q, m);
+
+        for (int i = 0; i < m; ++i)
+            a[i] = 2 * g[i];
+        TrigHelper::dsin(g, g, m);
+        TrigHelper::dsin(a, a, m);
+        for (int i = 0; i < m; ++i)
+            l[i] = q[i] + 1.915 * g[i] + 0.020 * a[i];
+        TrigHelper::fix_angle(l, l, m);
+
+        TrigHelper::dsin(e, a, m);		// sin(e)
+        TrigHelper::dcos(e, e, m);		// cos(e)
+        TrigHelper::dsin(l, b, m);		// sin(l)
+        TrigHelper::dcos(l, l, m);		// cos(l)
+        for (int i = 0; i < m; ++i)
+        {
+            g[i] = a[i] * b[i];
+            d[i] = e[i] * b[i];
+        }
+
+        TrigHelper::darcsin(g, declination + base, m);
+        TrigHelper::darctan2(d, l, a, m);
+        for (int i = 0; i < m; ++i)
+            a[i] /= 15.0;
+        TrigHelper::fix_hour(a, a, m);
+        for (int i = 0; i < m; ++i)
+            eq_t[base + i] = q[i] / 15.0 - a[i];
+    }
+}
+
+void Calculator::compute_mid_day(const double jd[], double times[], int n) const
+{
+    for (int base = 0; base < n; base += BATCH_SIZE)
+    {
+        const int m = std::min(BATCH_SIZE, n - base);
+        double declination[BATCH_SIZE], eq_t[BATCH_SIZE];
+        sun_position(jd + base, declination, eq_t, m);
+        for (int i = 0; i < m; ++i)
+            eq_t[i] = 12 - eq_t[i];
+        TrigHelper::fix_hour(eq_t, times + base, m);
+    }
+}
+
+void Calculator::compute_time(const Query& query, double g, const double jd[], double times[], int n) const
+{
+    double angles[BATCH_SIZE];
+    std::fill(angles, angles + BATCH_SIZE, g);
+    for (int base = 0; base < n; base += BATCH_SIZE)
+    {
+        const int m = std::min(BATCH_SIZE, n - base);
+        double declination[BATCH_SIZE], eq_t[BATCH_SIZE];
+        sun_position(jd + base, declination, eq_t, m);
+        time_at_angles(query, angles, declination, eq_t, times + base, m);
+        PT_COUNT_UNDEFINED(times + base, m);
+    }
+}
+
+void Calculator::compute_asr(const Query& query, int step, const double jd[], double times[], int n) const
+{
+    for (int base = 0; base < n; base += BATCH_SIZE)
+    {
+        const int m = std::min(BATCH_SIZE, n - base);
+        double declination[BATCH_SIZE], eq_t[BATCH_SIZE], angles[BATCH_SIZE];
+        sun_position(jd + base, declination, eq_t, m);
+        for (int i = 0; i < m; ++i)
+            angles[i] = fabs(query.latitude - declination[i]);
+        TrigHelper::dtan(angles, angles, m);
+        for (int i = 0; i < m; ++i)
+            angles[i] += step;
+        TrigHelper::darccot(angles, angles, m);
+        for (int i = 0; i < m; ++i)
+            angles[i] = -angles[i];
+        time_at_angles(query, angles, declination, eq_t, times + base, m);
+        PT_COUNT_UNDEFINED(times + base, m);
+    }
+}
+
+void Calculator::time_at_angles(const Query& query, const double g[], const double declination[], const double eq_t[], double times[], int n) const
+{
+    double sin_g[BATCH_SIZE], sin_d[BATCH_SIZE], cos_d[BATCH_SIZE], v[BATCH_SIZE], z[BATCH_SIZE];
+    const double sin_lat = TrigHelper::dsin(query.latitude);
+    const double cos_lat = TrigHelper::dcos(query.latitude);
+
+    TrigHelper::dsin(g, sin_g, n);
+    TrigHelper::dsin(declination, sin_d, n);
+    TrigHelper::dcos(declination, cos_d, n);
+    for (int i = 0; i < n; ++i)
+    {
+        v[i] = (-sin_g[i] - sin_d[i] * sin_lat) / (cos_d[i] * cos_lat);
+        z[i] = 12 - eq_t[i];
+    }
+    TrigHelper::darccos(v, v, n);
+    TrigHelper::fix_hour(z, z, n);
+    for (int i = 0; i < n; ++i)
+        times[i] = z[i] + (g[i] > 90.0 ? - v[i] : v[i]) / 15.0;
+}
+
+void Calculator::compute_times(const Query& query, double times[]) const
+{
+    kernel->compute_times(*this, query, times);
+}
+
+template <>
+void Calculator::day_times<Parameters::FastTier>(const Query& query, double times[]) const
+{
+    // every time from the sun position at noon
+    DoublePair position = sun_position(query.julian_date + 0.5);
+    double declination[Parameters::TimesCount], eq_t[Parameters::TimesCount], angles[Parameters::TimesCount];
+    std::fill(declination, declination + Parameters::TimesCount, position.first);
+    std::fill(eq_t, eq_t + Parameters::TimesCount, position.second);
+
+    angles[Parameters::Fajr]    = 180.0 - cfg.method.fajr_angle;
+    angles[Parameters::Sunrise] = 180.0 - 0.833;
+    angles[Parameters::Dhuhr]   = 0;		// replaced by mid-day below
+    angles[Parameters::Asr]     = -TrigHelper::darccot(1 + cfg.asr_juristic + TrigHelper::dtan(fabs(query.latitude - position.first)));
+    angles[Parameters::Sunset]  = 0.833;
+    angles[Parameters::Maghrib] = cfg.method.maghrib_value;
+    angles[Parameters::Isha]    = cfg.method.isha_value;
+
+    time_at_angles(query, angles, declination, eq_t, times, Parameters::TimesCount);
+    times[Parameters::Dhuhr] = TrigHelper::fix_hour(12 - position.second);
+    PT_COUNT_UNDEFINED(times, Parameters::TimesCount);
+
+    adjust_times(query, times);
+}
+
+template <>
+void Calculator::day_times<Parameters::DefaultTier>(const Query& query, double times[]) const
+{
+    double default_times[] = { 5, 6, 12, 13, 18, 18, 18 };		// default times
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+        times[i] = default_times[i];
+
+    compute_times(query, times);
+
+    adjust_times(query, times);
+}
+
+template <>
+void Calculator::day_times<Parameters::PreciseTier>(const Query& query, double times[]) const
+{
+    double default_times[] = { 5, 6, 12, 13, 18, 18, 18 };		// default times
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+        times[i] = default_times[i];
+
+    for (int i = 0; i < PRECISE_MAX_PASSES; ++i)
+    {
+        double previous[Parameters::TimesCount];
+        std::copy(times, times + Parameters::TimesCount, previous);
+        compute_times(query, times);
+        if (converged(previous, times, Parameters::TimesCount, PRECISE_TOLERANCE))
+            break;
+    }
+
+    adjust_times(query, times);
+}
+
+void Calculator::compute_day_times(const Query& query, double times[]) const
+{
+    PT_STAGE(DayTimesStage);
+    PT_COUNT(DaysComputed, 1);
+    switch (cfg.precision)
+    {
+    case Parameters::FastTier:
+        day_times<Parameters::FastTier>(query, times);
+        break;
+    case Parameters::PreciseTier:
+        day_times<Parameters::PreciseTier>(query, times);
+        break;
+    default:
+        day_times<Parameters::DefaultTier>(query, times);
+    }
+}
+
+void Calculator::adjust_times(const Query& query, double times[]) const
+{
+    kernel->adjust_times(*this, query, times);
+}
+
+void Calculator::adjust_high_lat_times(double times[]) const
+{
+    kernel->adjust_high_lat_times(*this, times);
+}
+
+double Calculator::night_portion(double angle) const
+{
+    switch (cfg.adjust_high_lats)
+    {
+    case Parameters::AngleBased:
+        return angle / 60.0;
+    case Parameters::MidNight:
+        return 1.0 / 2.0;
+    case Parameters::OneSeventh:
+        return 1.0 / 7.0;
+    default:
+        // Just to return something!
+        // In original library nothing was returned
+        // Maybe I should throw an exception
+        // It must be impossible to reach here
+        return 0;
+    }
+}
+
+void Calculator::day_portion(double times[])
+{
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+        times[i] /= 24.0;
+}
+
+template <>
+void Calculator::range_times<Parameters::FastTier>(const Query& query, Timetable& table) const
+{
+    const int n = table.days;
+    const Parameters::MethodConfig& method = cfg.method;
+
+    // same as the single day version, one sun position per day for a chunk of days
+    double jd[BATCH_SIZE], declination[BATCH_SIZE], eq_t[BATCH_SIZE], angles[BATCH_SIZE];
+    for (int base = 0; base < n; base += BATCH_SIZE)
+    {
+        const int m = std::min(BATCH_SIZE, n - base);
+        for (int k = 0; k < m; ++k)
+            jd[k] = query.julian_date + (base + k) + 0.5;
+        sun_position(jd, declination, eq_t, m);
+
+        for (int p = 0; p < Parameters::TimesCount; ++p)
+        {
+            double* t = table.times(p) + base;
+            switch (p)
+            {
+            case Parameters::Fajr:
+                std::fill(angles, angles + m, 180.0 - method.fajr_angle);
+                break;
+            case Parameters::Sunrise:
+                std::fill(angles, angles + m, 180.0 - 0.833);
+                break;
+            case Parameters::Dhuhr:
+                for (int k = 0; k < m; ++k)
+                    t[k] = 12 - eq_t[k];
+                TrigHelper::fix_hour(t, t, m);
+                continue;
+            case Parameters::Asr:
+                for (int k = 0; k < m; ++k)
+                    angles[k] = fabs(query.latitude - declination[k]);
+                TrigHelper::dtan(angles, angles, m);
+                for (int k = 0; k < m; ++k)
+                    angles[k] += 1 + cfg.asr_juristic;
+                TrigHelper::darccot(angles, angles, m);
+                for (int k = 0; k < m; ++k)
+                    angles[k] = -angles[k];
+                break;
+            case Parameters::Sunset:
+                std::fill(angles, angles + m, 0.833);
+                break;
+            case Parameters::Maghrib:
+                std::fill(angles, angles + m, method.maghrib_value);
+                break;
+            case Parameters::Isha:
+                std::fill(angles, angles + m, method.isha_value);
+                break;
+            }
+            time_at_angles(query, angles, declination, eq_t, t, m);
+            PT_COUNT_UNDEFINED(t, m);
+        }
+    }
+
+    adjust_range_times(query, table);
+}
+
+template <>
+void Calculator::range_times<Parameters::DefaultTier>(const Query& query, Timetable& table) const
+{
+    static const double default_times[] = { 5, 6, 12, 13, 18, 18, 18 };		// default times
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+        std::fill(table.times(i), table.times(i) + table.days, default_times[i]);
+
+    kernel->range_pass(*this, query, table);
+
+    adjust_range_times(query, table);
+}
+
+template <>
+void Calculator::range_times<Parameters::PreciseTier>(const Query& query, Timetable& table) const
+{
+    static const double default_times[] = { 5, 6, 12, 13, 18, 18, 18 };		// default times
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+        std::fill(table.times(i), table.times(i) + table.days, default_times[i]);
+
+    std::vector<double> previous;
+    for (int i = 0; i < PRECISE_MAX_PASSES; ++i)
+    {
+        previous = table.data;
+        kernel->range_pass(*this, query, table);
+        if (converged(previous.data(), table.data.data(), (int) table.data.size(), PRECISE_TOLERANCE))
+            break;
+    }
+
+    adjust_range_times(query, table);
+}
+
+void Calculator::compute_range_times(const Query& query, Timetable& table) const
+{
+    PT_STAGE(RangeTimesStage);
+    PT_COUNT(DaysComputed, table.days);
+    if (table.days <= 0)
+        return;
+    switch (cfg.precision)
+    {
+    case Parameters::FastTier:
+        range_times<Parameters::FastTier>(query, table);
+        break;
+    case Parameters::PreciseTier:
+        range_times<Parameters::PreciseTier>(query, table);
+        break;
+    default:
+        range_times<Parameters::DefaultTier>(query, table);
+    }
+}
+
+void Calculator::adjust_range_times(const Query& query, Timetable& table) const
+{
+    kernel->adjust_range_times(*this, query, table);
+}
+
+void Calculator::adjust_high_lat_range(Timetable& table) const
+{
+    kernel->adjust_high_lat_range(*this, table);
+}
+
+double Calculator::time_diff(double time1, double time2)
+{
+    return TrigHelper::fix_hour(time2 - time1);
+}
+
+double Calculator::julian_date(int year, int month, int day)
+{
+    if (month <= 2)
+    {
+        year -= 1;
+        month += 12;
+    }
+
+    double a = floor(year / 100.0);
+    double b = 2 - a + floor(a / 4.0);
+
+    return floor(365.25 * (year + 4716)) + floor(30.6001 * (month + 1)) + day + b - 1524.5;
+}
@@ -0,0 +1,307 @@
+﻿#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "daemon.hpp"
+#include "timezone.hpp"
+
+namespace {
+
+const char* const PRAYER_NAMES[Parameters::TimesCount] =
+{
+    "Fajr", "Sunrise", "Dhuhr", "Asr", "Sunset", "Maghrib", "Isha",
+};
+
+const int64_t DAY_SECONDS = 60 * 60 * 24;
+
+int64_t floor_div(int64_t a, int64_t b)
+{
+    return a / b - (a % b < 0);
+}
+
+double now_seconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* histogram bucket of a jitter: 0 below 1 us, then JITTER_STEPS per power of two */
+int jitter_bucket(double microseconds)
+{
+    const int steps = PrayerDaemon::JITTER_STEPS;
+    if (!(microseconds >= 1))
+        return 0;
+    int exponent;
+    double mantissa = frexp(microseconds, &exponent);		// in [0.5, 1)
+    int bucket = 1 + (exponent - 1) * steps + (int) ((2 * mantissa - 1) * steps);
+    return std::min(bucket, (int) PrayerDaemon::JITTER_BUCKETS - 1);
+}
+
+/* microseconds in the middle of a bucket */
+double jitter_bucket_value(int bucket)
+{
+    const int steps = PrayerDaemon::JITTER_STEPS;
+    if (bucket == 0)
+        return 0.5;
+    return ldexp(1 + ((bucket - 1) % steps + 0.5) / steps, (bucket - 1) / steps);
+}
+
+}
+
+PrayerDaemon::PrayerDaemon(const CalcConfig& config, const std::vector<Location>& locations, const TimeZone* zone, int out_fd)
+    : calculator(config)
+    , locations(locations)
+    , zone(zone)
+    , out_fd(out_fd)
+    , timer_fd(-1)
+    , signal_fd(-1)
+    , scheduled_until(locations.size(), INT64_MIN)
+    , jitter_sum(0)
+    , jitter_max(0)
+{
+    memset(jitter_counts, 0, sizeof(jitter_counts));
+    memset(&counts, 0, sizeof(counts));
+}
+
+PrayerDaemon::~PrayerDaemon()
+{
+    if (timer_fd >= 0)
+        close(timer_fd);
+    if (signal_fd >= 0)
+        close(signal_fd);
+}
+
+bool PrayerDaemon::run()
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &signals, NULL) != 0
+        || (signal_fd = signalfd(-1, &signals, SFD_CLOEXEC)) < 0
+        || (timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK)) < 0)
+    {
+        perror("Error: daemon");
+        return false;
+    }
+    // the default 50 us of timer slack would be most of the jitter
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+
+    schedule((int64_t) floor(now_seconds()));
+    if (!arm_timer())
+        return false;
+
+    for (;;)
+    {
+        pollfd fds[2] = { { timer_fd, POLLIN, 0 }, { signal_fd, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Error: poll");
+            return false;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            signalfd_siginfo info;
+            if (read(signal_fd, &info, sizeof(info)) == sizeof(info))
+            {
+                print_stats();
+                if (info.ssi_signo != SIGUSR1)
+                    return true;
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+            {
+                if (errno != ECANCELED)
+                    continue;
+                // the wall clock was set: the deadline may be far off or long gone
+                ++counts.clock_changes;
+                reschedule((int64_t) floor(now_seconds()));
+            }
+            else
+            {
+                const double now = now_seconds();
+                ++counts.wakeups;
+                record_jitter((now - events.front().at) * 1e6);
+                if (!fire((int64_t) floor(now)))
+                    return false;
+                schedule((int64_t) floor(now));
+            }
+            if (!arm_timer())
+                return false;
+        }
+    }
+}
+
+PrayerDaemon::Stats PrayerDaemon::stats() const
+{
+    Stats s = counts;
+    s.jitter_mean = s.jitter_p50 = s.jitter_p99 = s.jitter_max = 0;
+    if (counts.wakeups == 0)
+        return s;
+
+    s.jitter_mean = jitter_sum / counts.wakeups;
+    s.jitter_p50 = jitter_quantile(0.50);
+    s.jitter_p99 = jitter_quantile(0.99);
+    s.jitter_max = jitter_max;
+    return s;
+}
+
+void PrayerDaemon::record_jitter(double microseconds)
+{
+    ++jitter_counts[jitter_bucket(microseconds)];
+    jitter_sum += microseconds;
+    jitter_max = std::max(jitter_max, microseconds);
+}
+
+double PrayerDaemon::jitter_quantile(double quantile) const
+{
+    // the bucket of the sample that sorting every wake-up would put at this rank
+    const uint64_t rank = std::min(counts.wakeups - 1, (uint64_t) (counts.wakeups * quantile));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < JITTER_BUCKETS; ++bucket)
+    {
+        seen += jitter_counts[bucket];
+        if (seen > rank)
+            return std::min(jitter_bucket_value(bucket), jitter_max);
+    }
+    return jitter_max;
+}
+
+int64_t PrayerDaemon::utc_offset(int location, int64_t utc) const
+{
+    const double timezone = locations[location].timezone;
+    return std::isnan(timezone) ? zone->utc_offset(utc) : llround(timezone * 3600);
+}
+
+int64_t PrayerDaemon::local_day(int location, int64_t utc) const
+{
+    return floor_div(utc + utc_offset(location, utc), DAY_SECONDS);
+}
+
+void PrayerDaemon::schedule_day(int location, int64_t day, int64_t now)
+{
+    int year, month, mday;
+    CivilCalendar::civil_from_days(day, year, month, mday);
+    const Location& where = locations[location];
+    // times are in the offset of local midnight, so they convert back to UTC with it across a DST change
+    const double timezone = std::isnan(where.timezone) ? zone->timezone(year, month, mday) : where.timezone;
+    double times[Parameters::TimesCount];
+    calculator.compute_day_times(Query::make(year, month, mday, where.latitude, where.longitude, timezone), times);
+
+    for (int p = 0; p < Parameters::TimesCount; ++p)
+    {
+        if (std::isnan(times[p]))
+            continue;
+        Event event = { day * DAY_SECONDS + llround((times[p] - timezone) * 3600), location, p };
+        if (event.at <= now)
+            continue;
+        events.push_back(event);
+        std::push_heap(events.begin(), events.end(), std::greater<Event>());
+    }
+}
+
+void PrayerDaemon::schedule(int64_t now)
+{
+    for (int l = 0; l < (int) locations.size(); ++l)
+    {
+        // start a day early: times past midnight belong to the previous day
+        const int64_t today = local_day(l, now);
+        for (int64_t day = std::max(scheduled_until[l], today - 1); day < today + HORIZON_DAYS; ++day)
+            schedule_day(l, day, now);
+        scheduled_until[l] = std::max(scheduled_until[l], (int64_t) today + HORIZON_DAYS);
+    }
+}
+
+void PrayerDaemon::reschedule(int64_t now)
+{
+    for (std::size_t i = 0; i < events.size(); ++i)
+        if (events[i].at <= now)
+            ++counts.missed;
+    events.clear();
+    std::fill(scheduled_until.begin(), scheduled_until.end(), INT64_MIN);
+    schedule(now);
+}
+
+bool PrayerDaemon::arm_timer()
+{
+    // with no event left (no location), a zero deadline disarms the timer
+    itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (!events.empty())
+        spec.it_value.tv_sec = events.front().at;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) != 0)
+    {
+        perror("Error: timerfd_settime");
+        return false;
+    }
+    return true;
+}
+
+bool PrayerDaemon::fire(int64_t now)
+{
+    std::string out;
+    while (!events.empty() && events.front().at <= now)
+    {
+        const Event event = events.front();
+        std::pop_heap(events.begin(), events.end(), std::greater<Event>());
+        events.pop_back();
+
+        const int64_t offset = utc_offset(event.location, event.at);
+        const int64_t local = event.at + offset;
+        const int64_t seconds = local - floor_div(local, DAY_SECONDS) * DAY_SECONDS;
+        const int64_t offset_minutes = (offset < 0 ? -offset : offset) / 60;
+        int year, month, day;
+        CivilCalendar::civil_from_days(floor_div(local, DAY_SECONDS), year, month, day);
+        char line[96];
+        int n = snprintf(line, sizeof(line), "%04d-%02d-%02dT%02d:%02d:%02d%c%02d:%02d,%d,%s\n",
+                         year, month, day, (int) (seconds / 3600), (int) (seconds / 60 % 60), (int) (seconds % 60),
+                         offset < 0 ? '-' : '+', (int) (offset_minutes / 60), (int) (offset_minutes % 60),
+                         event.location, PRAYER_NAMES[event.prayer]);
+        out.append(line, n);
+        ++counts.events;
+    }
+
+    for (std::size_t done = 0; done < out.size(); )
+    {
+        ssize_t n = write(out_fd, out.data() + done, out.size() - done);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Error: write");
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+void PrayerDaemon::print_stats() const
+{
+    Stats s = stats();
+    fprintf(stderr, "%llu events, %llu wake-ups, %llu clock changes, %llu missed; "
+            "jitter mean %.0lf us, p50 %.0lf us, p99 %.0lf us, max %.0lf us\n",
+            (unsigned long long) s.events, (unsigned long long) s.wakeups,
+            (unsigned long long) s.clock_changes, (unsigned long long) s.missed,
+            s.jitter_mean, s.jitter_p50, s.jitter_p99, s.jitter_max);
+}
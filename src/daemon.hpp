@@ -0,0 +1,126 @@
+﻿#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "calculator.hpp"
+
+class TimeZone;
+
+/* -------------------- Daemon Mode --------------------- */
+
+// Long-running mode of the command line tool that announces every prayer of
+// a set of locations when it is due.
+//
+// The times of the next HORIZON_DAYS days of every location are kept in a
+// min-heap of events at UTC instants. A single timerfd is armed at the
+// earliest event with an absolute CLOCK_REALTIME deadline, so the process
+// sleeps in poll() until it is due. Each due event is written as a line
+//
+//     2024-03-01T05:12:34+03:30,0,Fajr
+//
+// (local time, location index, prayer) to the output descriptor, and the
+// days of a location are extended as it moves past them.
+//
+// The timer is created with TFD_TIMER_CANCEL_ON_SET: when the wall clock is
+// set, the wait ends with ECANCELED and the events are rebuilt for the new
+// time, the ones jumped over being counted as missed. A location with a
+// timezone keeps that fixed offset; one without (NAN) takes the offsets of
+// the zone, so DST changes move its local times.
+//
+// The delay between every deadline and the wake-up is counted in a fixed
+// log-scale histogram, so its percentiles come within half a bucket without
+// keeping every sample. SIGUSR1 writes the stats to stderr; SIGINT and
+// SIGTERM write them and stop.
+class PrayerDaemon
+{
+public:
+    enum
+    {
+        HORIZON_DAYS = 3,		// days of every location kept scheduled
+        JITTER_STEPS = 8,		// histogram buckets per doubling of the jitter
+        JITTER_BUCKETS = 1 + 32 * JITTER_STEPS,		// below 1 us, then 1 us up to 2^32 us
+    };
+
+    struct Stats
+    {
+        uint64_t events;		// lines written
+        uint64_t wakeups;		// timer expirations
+        uint64_t clock_changes;		// wall clock sets seen
+        uint64_t missed;		// events skipped by a clock set
+        double jitter_mean;		// microseconds from deadline to wake-up
+        double jitter_p50;
+        double jitter_p99;
+        double jitter_max;
+    };
+
+    /* zone gives the offsets of the locations without a timezone (NAN) and
+       may be NULL when every location has one */
+    PrayerDaemon(const CalcConfig& config, const std::vector<Location>& locations, const TimeZone* zone, int out_fd);
+    ~PrayerDaemon();
+
+    /* run until SIGINT or SIGTERM; false on a system or write error */
+    bool run();
+
+    Stats stats() const;
+
+private:
+    PrayerDaemon(const PrayerDaemon&);
+    PrayerDaemon& operator=(const PrayerDaemon&);
+
+    struct Event
+    {
+        int64_t at;		// UTC, seconds since the epoch
+        int location;
+        int prayer;
+
+        bool operator>(const Event& other) const
+        {
+            if (at != other.at)
+                return at > other.at;
+            return location != other.location ? location > other.location : prayer > other.prayer;
+        }
+    };
+
+    /* UTC offset of a location at a UTC instant, in seconds */
+    int64_t utc_offset(int location, int64_t utc) const;
+
+    /* local day of a location at a UTC instant, in days since the epoch */
+    int64_t local_day(int location, int64_t utc) const;
+
+    /* queue the events of a day of a location after now */
+    void schedule_day(int location, int64_t day, int64_t now);
+
+    /* extend every location to HORIZON_DAYS days from its current day */
+    void schedule(int64_t now);
+
+    /* forget every event and schedule from now; the events up to now count as missed */
+    void reschedule(int64_t now);
+
+    bool arm_timer();
+    bool fire(int64_t now);
+    void print_stats() const;
+
+    /* count the delay of a wake-up */
+    void record_jitter(double microseconds);
+
+    /* jitter at a quantile of the wake-ups, the middle of its histogram bucket */
+    double jitter_quantile(double quantile) const;
+
+    const Calculator calculator;
+    const std::vector<Location> locations;
+    const TimeZone* zone;
+    const int out_fd;
+    int timer_fd;
+    int signal_fd;
+    std::vector<Event> events;		// min-heap on at
+    std::vector<int64_t> scheduled_until;		// first local day of every location not queued yet
+    uint64_t jitter_counts[JITTER_BUCKETS];		// wake-ups per histogram bucket
+    double jitter_sum;		// microseconds
+    double jitter_max;
+    Stats counts;
+};
+
+#endif
@@ -0,0 +1,53 @@
+﻿#include <algorithm>
+
+#include "dayrange.hpp"
+#include "timezone.hpp"
+
+Generator<DayTimes> DayRange::days(Calculator calculator, Location location, int year, int month, int day,
+                                   int num_days, const TimeZone* zone)
+{
+    DayTimes out;
+    out.year = year;
+    out.month = month;
+    out.day = day;
+
+    const double timezone = zone ? zone->timezone(year, month, day) : location.timezone;
+    Query query = Query::make(year, month, day, location.latitude, location.longitude, timezone);
+    Timetable table;
+    double offsets[BLOCK_DAYS];		// of the zone on the days of a block
+
+    for (int done = 0, size = FIRST_BLOCK_DAYS; num_days == 0 || done < num_days; done += size, size = std::min(2 * size, (int) BLOCK_DAYS))
+    {
+        const int block = num_days == 0 ? size : std::min(size, num_days - done);
+        table.resize(block);
+        calculator.compute_range_times(query, table);
+        if (zone)
+        {
+            zone->day_offsets(out.year, out.month, out.day, block, offsets);
+            table.shift_days(offsets, timezone);
+        }
+
+        for (int d = 0; d < block; ++d)
+        {
+            out.timezone = zone ? offsets[d] : timezone;
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+                out.times[p] = table.at(d, p);
+            co_yield out;
+            next_day(out.year, out.month, out.day);
+        }
+        query.julian_date += block;
+    }
+}
+
+void DayRange::next_day(int& year, int& month, int& day)
+{
+    static const int month_days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (++day <= month_days[month - 1] || (month == 2 && day == 29 && CivilCalendar::is_leap_year(year)))
+        return;
+    day = 1;
+    if (++month > 12)
+    {
+        month = 1;
+        ++year;
+    }
+}
@@ -0,0 +1,254 @@
+﻿#include <cmath>
+
+#include "ephemeris.hpp"
+
+SolarEphemeris& SolarEphemeris::shared()
+{
+    static SolarEphemeris instance;
+    return instance;
+}
+
+SolarEphemeris::SolarEphemeris()
+    : first_jd(Calculator::julian_date(FIRST_YEAR, 1, 1))
+    , num_blocks((long) ceil((Calculator::julian_date(FIRST_YEAR + YEARS, 1, 1) - first_jd) / (int) BLOCK_DAYS))
+    , blocks(new std::atomic<Block*>[num_blocks])
+    , hits(0)
+    , misses(0)
+    , bypassed(0)
+    , computed_blocks(0)
+{
+    for (long i = 0; i < num_blocks; ++i)
+        blocks[i].store(NULL, std::memory_order_relaxed);
+}
+
+SolarEphemeris::~SolarEphemeris()
+{
+    for (long i = 0; i < num_blocks; ++i)
+        delete blocks[i].load(std::memory_order_relaxed);
+}
+
+Calculator::DoublePair SolarEphemeris::sun_position(double jd)
+{
+    double declination, eq_t;
+    bool computed = false;
+    if (!lookup(jd, declination, eq_t, computed))
+    {
+        bypassed.fetch_add(1, std::memory_order_relaxed);
+        return Calculator::exact_sun_position(jd);
+    }
+    (computed ? misses : hits).fetch_add(1, std::memory_order_relaxed);
+    return Calculator::DoublePair(declination, eq_t);
+}
+
+void SolarEphemeris::sun_position(const double jd[], double declination[], double eq_t[], int n)
+{
+    uint64_t batch_hits = 0, batch_misses = 0, batch_bypassed = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        bool computed = false;
+        if (lookup(jd[i], declination[i], eq_t[i], computed))
+            ++(computed ? batch_misses : batch_hits);
+        else
+        {
+            Calculator::DoublePair position = Calculator::exact_sun_position(jd[i]);
+            declination[i] = position.first;
+            eq_t[i] = position.second;
+            ++batch_bypassed;
+        }
+    }
+    hits.fetch_add(batch_hits, std::memory_order_relaxed);
+    misses.fetch_add(batch_misses, std::memory_order_relaxed);
+    bypassed.fetch_add(batch_bypassed, std::memory_order_relaxed);
+}
+
+SolarEphemeris::Stats SolarEphemeris::stats() const
+{
+    Stats s;
+    s.hits = hits.load(std::memory_order_relaxed);
+    s.misses = misses.load(std::memory_order_relaxed);
+    s.bypassed = bypassed.load(std::memory_order_relaxed);
+    s.blocks = computed_blocks.load(std::memory_order_relaxed);
+    return s;
+}
+
+void SolarEphemeris::reset_stats()
+{
+    hits.store(0, std::memory_order_relaxed);
+    misses.store(0, std::memory_order_relaxed);
+    bypassed.store(0, std::memory_order_relaxed);
+}
+
+bool SolarEphemeris::lookup(double jd, double& declination, double& eq_t, bool& computed)
+{
+    double x = (jd - first_jd) * (int) SAMPLES_PER_DAY;
+    if (!(x >= 0 && x < (double) num_blocks * (int) BLOCK_SAMPLES))		// also rejects NaN
+        return false;
+
+    long k = (long) x;
+    double f = x - k;
+    long index = k / BLOCK_SAMPLES;
+    int i = (int) (k - index * BLOCK_SAMPLES);
+    const Block* b = block(index, computed);
+
+    declination = b->declination[i] + f * (b->declination[i + 1] - b->declination[i]);
+
+    // the equation of time wraps by 24 hours when the mean longitude and the
+    // right ascension cross zero at different moments
+    double e0 = b->eq_t[i];
+    double e1 = b->eq_t[i + 1];
+    if (e1 - e0 > 12.0)
+        e1 -= 24.0;
+    else if (e0 - e1 > 12.0)
+        e1 += 24.0;
+    eq_t = e0 + f * (e1 - e0);
+    return true;
+}
+
+const SolarEphemeris::Block* SolarEphemeris::block(long index, bool& computed)
+{
+    Block* b = blocks[index].load(std::memory_order_acquire);
+    if (b)
+        return b;
+
+    std::unique_ptr<Block> fresh(new Block);
+    double jd[BLOCK_SAMPLES + 1];
+    for (int i = 0; i <= BLOCK_SAMPLES; ++i)
+        jd[i] = first_jd + (double) (index * BLOCK_SAMPLES + i) / (int) SAMPLES_PER_DAY;
+    Calculator::exact_sun_position(jd, fresh->declination, fresh->eq_t, BLOCK_SAMPLES + 1);
+    computed = true;
+
+    // another thread may have published the same block in the meantime
+    Block* expected = NULL;
+    if (blocks[index].compare_exchange_strong(expected, fresh.get(), std::memory_order_acq_rel))
+    {
+        computed_blocks.fetch_add(1, std::memory_order_relaxed);
+        return fresh.release();
+    }
+    return expected;
+}
+
+/* ---------------------- Fitted Solar Ephemeris ----------------------- */
+
+namespace {
+
+const double YEAR_DAYS = 365.25;
+const double SEGMENT_DAYS = YEAR_DAYS / (int) FittedEphemeris::SEGMENTS_PER_YEAR;
+
+/* sum of c[k] T_k(x) by the Clenshaw recurrence */
+inline double chebyshev(const double* c, double x)
+{
+    double b1 = 0, b2 = 0;
+    for (int k = FittedEphemeris::TERMS - 1; k > 0; --k)
+    {
+        double b0 = 2 * x * b1 - b2 + c[k];
+        b2 = b1;
+        b1 = b0;
+    }
+    return c[0] + x * b1 - b2;
+}
+
+}
+
+FittedEphemeris& FittedEphemeris::shared()
+{
+    static FittedEphemeris instance;
+    return instance;
+}
+
+FittedEphemeris::FittedEphemeris()
+    : first_jd(Calculator::julian_date(FIRST_YEAR, 1, 1))
+    , years(new std::atomic<Year*>[YEARS])
+    , fitted(0)
+{
+    for (long i = 0; i < YEARS; ++i)
+        years[i].store(NULL, std::memory_order_relaxed);
+}
+
+FittedEphemeris::~FittedEphemeris()
+{
+    for (long i = 0; i < YEARS; ++i)
+        delete years[i].load(std::memory_order_relaxed);
+}
+
+Calculator::DoublePair FittedEphemeris::sun_position(double jd)
+{
+    double declination, eq_t;
+    if (!evaluate(jd, declination, eq_t))
+        return Calculator::exact_sun_position(jd);
+    return Calculator::DoublePair(declination, eq_t);
+}
+
+void FittedEphemeris::sun_position(const double jd[], double declination[], double eq_t[], int n)
+{
+    for (int i = 0; i < n; ++i)
+        if (!evaluate(jd[i], declination[i], eq_t[i]))
+        {
+            Calculator::DoublePair position = Calculator::exact_sun_position(jd[i]);
+            declination[i] = position.first;
+            eq_t[i] = position.second;
+        }
+}
+
+bool FittedEphemeris::evaluate(double jd, double& declination, double& eq_t)
+{
+    double x = (jd - first_jd) / SEGMENT_DAYS;
+    if (!(x >= 0 && x < (double) YEARS * (int) SEGMENTS_PER_YEAR))		// also rejects NaN
+        return false;
+
+    long k = (long) x;
+    const Year* y = year(k / SEGMENTS_PER_YEAR);
+    int segment = (int) (k % SEGMENTS_PER_YEAR);
+    double t = 2 * (x - k) - 1;		// position in the segment, [-1, 1)
+    declination = chebyshev(y->declination[segment], t);
+    eq_t = chebyshev(y->eq_t[segment], t);
+    return true;
+}
+
+const FittedEphemeris::Year* FittedEphemeris::year(long index)
+{
+    Year* y = years[index].load(std::memory_order_acquire);
+    if (y)
+        return y;
+
+    // exact values at the Chebyshev nodes of every segment
+    const int n = SEGMENTS_PER_YEAR * TERMS;
+    double jd[n], declination[n], eq_t[n];
+    for (int s = 0; s < SEGMENTS_PER_YEAR; ++s)
+        for (int k = 0; k < TERMS; ++k)
+        {
+            double node = cos(M_PI * (k + 0.5) / (int) TERMS);
+            jd[s * TERMS + k] = first_jd + index * YEAR_DAYS + (s + 0.5 * (node + 1)) * SEGMENT_DAYS;
+        }
+    Calculator::exact_sun_position(jd, declination, eq_t, n);
+
+    std::unique_ptr<Year> fresh(new Year);
+    for (int s = 0; s < SEGMENTS_PER_YEAR; ++s)
+    {
+        const double* dv = declination + s * TERMS;
+        double* ev = eq_t + s * TERMS;
+        for (int k = 0; k < TERMS; ++k)		// see SolarEphemeris::lookup for the 24 hour wrap
+            ev[k] -= 24.0 * floor((ev[k] + 12.0) / 24.0);
+        for (int j = 0; j < TERMS; ++j)
+        {
+            double sum_d = 0, sum_e = 0;
+            for (int k = 0; k < TERMS; ++k)
+            {
+                double c = cos(M_PI * j * (k + 0.5) / (int) TERMS);
+                sum_d += dv[k] * c;
+                sum_e += ev[k] * c;
+            }
+            double scale = (j == 0 ? 1.0 : 2.0) / (int) TERMS;
+            fresh->declination[s][j] = scale * sum_d;
+            fresh->eq_t[s][j] = scale * sum_e;
+        }
+    }
+
+    // another thread may have published the same year in the meantime
+    Year* expected = NULL;
+    if (years[index].compare_exchange_strong(expected, fresh.get(), std::memory_order_acq_rel))
+    {
+        fitted.fetch_add(1, std::memory_order_relaxed);
+        return fresh.release();
+    }
+    return expected;
+}
@@ -0,0 +1,190 @@
+﻿#include <algorithm>
+#include <cmath>
+
+#include "eventindex.hpp"
+#include "executor.hpp"
+#include "timezone.hpp"
+
+EventIndex::EventIndex(const Calculator& calculator, const std::vector<Location>& locations,
+                       const TimeZone* zone, unsigned threads)
+    : calculator(calculator)
+    , locations(locations)
+    , zone(zone)
+    , first_slot(0)
+    , first_day_number(0)
+    , built(false)
+    , times(locations.size() * Parameters::TimesCount)
+{
+    if (threads != 1)
+    {
+        pool.reset(new WorkStealingPool(threads));
+        if (pool->size() == 0)		// only the calling thread
+            pool.reset();
+    }
+}
+
+EventIndex::~EventIndex()
+{
+}
+
+void EventIndex::build(int year, int month, int day)
+{
+    first_day_number = CivilCalendar::days_from_civil(year, month, day);
+    first_slot = 0;
+    for (int k = 0; k < DAYS; ++k)
+        index_day(k, first_day_number + k);
+    built = true;
+}
+
+void EventIndex::advance()
+{
+    if (!built)
+        return;
+    // the slot of the first day becomes the last one
+    index_day(first_slot, first_day_number + DAYS);
+    first_slot = (first_slot + 1) % DAYS;
+    ++first_day_number;
+}
+
+int EventIndex::roll_over(int64_t utc)
+{
+    int days = 0;
+    while (built)
+    {
+        // the first day ends everywhere at noon UTC of the next day (UTC-12), and later if an event is later
+        int64_t end = (first_day_number + 1) * 86400 + 12 * 3600;
+        for (int p = 0; p < Parameters::TimesCount; ++p)
+        {
+            const Segment& segment = segments[first_slot][p];
+            if (!segment.offsets.empty())
+                end = std::max(end, segment.last + 1);
+        }
+        if (utc < end)
+            break;
+        advance();
+        ++days;
+    }
+    return days;
+}
+
+void EventIndex::index_day(int slot, int64_t day)
+{
+    int year, month, mday;
+    CivilCalendar::civil_from_days(day, year, month, mday);
+    const double zone_offset = zone ? zone->timezone(year, month, mday) : NAN;
+    const std::size_t n = locations.size();
+
+    auto compute = [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            const Location& location = locations[i];
+            double timezone = std::isnan(location.timezone) ? zone_offset : location.timezone;
+            calculator.compute_day_times(Query::make(year, month, mday, location.latitude, location.longitude, timezone),
+                                         &times[i * Parameters::TimesCount]);
+        }
+    };
+    if (pool && n > 1)
+        pool->parallel_for(n, 256, compute);
+    else
+        compute(0, n);
+
+    // (seconds after the first event, location) keys, sorted per prayer
+    std::vector<std::pair<int64_t, uint32_t> > events;
+    events.reserve(n);
+    for (int p = 0; p < Parameters::TimesCount; ++p)
+    {
+        events.clear();
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double time = times[i * Parameters::TimesCount + p];
+            double timezone = std::isnan(locations[i].timezone) ? zone_offset : locations[i].timezone;
+            if (!std::isnan(time) && !std::isnan(timezone))
+                events.push_back(std::make_pair(day * 86400 + llround((time - timezone) * 3600), (uint32_t) i));
+        }
+        std::sort(events.begin(), events.end());
+
+        Segment& segment = segments[slot][p];
+        segment.offsets.resize(events.size());
+        segment.ids.resize(events.size());
+        if (events.empty())
+        {
+            segment.origin = segment.last = day * 86400;
+            segment.buckets.assign(1, 0);
+            continue;
+        }
+
+        // bucket b covers [origin + b * BUCKET_SECONDS, ...)
+        const int64_t first = events.front().first;
+        segment.origin = first - (first % BUCKET_SECONDS + BUCKET_SECONDS) % BUCKET_SECONDS;
+        segment.last = events.back().first;
+        const std::size_t num_buckets = (segment.last - segment.origin) / BUCKET_SECONDS + 1;
+        segment.buckets.resize(num_buckets + 1);
+        std::size_t e = 0;
+        for (std::size_t b = 0; b <= num_buckets; ++b)
+        {
+            int64_t start = segment.origin + (int64_t) b * BUCKET_SECONDS;
+            while (e < events.size() && events[e].first < start)
+            {
+                segment.offsets[e] = (int32_t) (events[e].first - segment.origin);
+                segment.ids[e] = events[e].second;
+                ++e;
+            }
+            segment.buckets[b] = (uint32_t) e;
+        }
+    }
+}
+
+std::size_t EventIndex::query(int64_t from, int64_t to, std::vector<Event>& events, unsigned mask) const
+{
+    const std::size_t count = events.size();
+    if (!built)
+        return 0;
+    for (int k = 0; k < DAYS; ++k)
+    {
+        const int slot = (first_slot + k) % DAYS;
+        for (int p = 0; p < Parameters::TimesCount; ++p)
+        {
+            const Segment& segment = segments[slot][p];
+            if (!(mask & (1u << p)) || segment.offsets.empty() || to <= segment.origin || from > segment.last)
+                continue;
+
+            // the bucket of from, then the events of its minute before from
+            std::size_t i = from <= segment.origin ? 0 : segment.buckets[(from - segment.origin) / BUCKET_SECONDS];
+            const std::size_t end = segment.offsets.size();
+            while (i < end && segment.origin + segment.offsets[i] < from)
+                ++i;
+            for (; i < end && segment.origin + segment.offsets[i] < to; ++i)
+            {
+                Event event;
+                event.location = segment.ids[i];
+                event.prayer = (Parameters::TimeID) p;
+                event.utc = segment.origin + segment.offsets[i];
+                events.push_back(event);
+            }
+        }
+    }
+    return events.size() - count;
+}
+
+std::size_t EventIndex::size() const
+{
+    std::size_t n = 0;
+    for (int k = 0; k < DAYS; ++k)
+        for (int p = 0; p < Parameters::TimesCount; ++p)
+            n += segments[k][p].offsets.size();
+    return n;
+}
+
+std::size_t EventIndex::memory_bytes() const
+{
+    std::size_t bytes = sizeof(*this) + times.capacity() * sizeof(double) + locations.capacity() * sizeof(Location);
+    for (int k = 0; k < DAYS; ++k)
+        for (int p = 0; p < Parameters::TimesCount; ++p)
+        {
+            const Segment& segment = segments[k][p];
+            bytes += segment.buckets.capacity() * sizeof(uint32_t) + segment.offsets.capacity() * sizeof(int32_t)
+                + segment.ids.capacity() * sizeof(uint32_t);
+        }
+    return bytes;
+}
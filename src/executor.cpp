@@ -0,0 +1,145 @@
+﻿#include "executor.hpp"
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+    : job(NULL)
+    , generation(0)
+    , pending(0)
+    , stopping(false)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // the caller of parallel_for works as well, so one thread less is started
+    for (unsigned i = 0; i + 1 < threads; ++i)
+        workers.push_back(std::unique_ptr<Worker>(new Worker));
+    for (unsigned i = 0; i < workers.size(); ++i)
+        workers[i]->thread = std::thread(&WorkStealingPool::worker_loop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i]->thread.join();
+}
+
+void WorkStealingPool::parallel_for(std::size_t n, std::size_t grain, const RangeFunction& f)
+{
+    if (n == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    std::lock_guard<std::mutex> job_guard(job_lock);
+    if (workers.empty())
+    {
+        f(0, n);
+        return;
+    }
+
+    // the job is published before any range, so a worker still draining the
+    // previous call can only ever pick up ranges together with this job
+    const std::size_t count = (n + grain - 1) / grain;
+    pending.store(count);
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        job = &f;
+        ++generation;
+    }
+
+    std::size_t index = 0;
+    for (std::size_t begin = 0; begin < n; begin += grain, ++index)
+    {
+        Worker& w = *workers[index % workers.size()];
+        std::lock_guard<std::mutex> guard(w.lock);
+        w.ranges.push_back(Range(begin, std::min(n, begin + grain)));
+    }
+    wake.notify_all();
+
+    drain(size());
+
+    std::unique_lock<std::mutex> lock(state_lock);
+    done.wait(lock, [this] { return pending.load() == 0; });
+    job = NULL;
+}
+
+void WorkStealingPool::worker_loop(unsigned index)
+{
+    unsigned long seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(state_lock);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        drain(index);
+    }
+}
+
+void WorkStealingPool::drain(unsigned self)
+{
+    Range range;
+    while (take(self, range))
+    {
+        (*job)(range.first, range.second);
+        if (pending.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            done.notify_all();
+        }
+    }
+}
+
+bool WorkStealingPool::take(unsigned self, Range& range)
+{
+    const unsigned count = (unsigned) workers.size();
+    if (self < count)
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.ranges.empty())
+        {
+            range = own.ranges.back();
+            own.ranges.pop_back();
+            return true;
+        }
+    }
+
+    for (unsigned i = 1; i <= count; ++i)
+    {
+        Worker& victim = *workers[(self + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.ranges.empty())
+        {
+            range = victim.ranges.front();
+            victim.ranges.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+BulkExecutor::BulkExecutor(unsigned threads)
+    : pool(threads)
+{
+}
+
+void BulkExecutor::run(const Calculator& calculator, const Location locations[], std::size_t num_locations,
+                       int year, int month, int day, int num_days, Timetable tables[])
+{
+    pool.parallel_for(num_locations, 1, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            tables[i].resize(num_days);
+            calculator.compute_range_times(Query::make(year, month, day, locations[i]), tables[i]);
+        }
+    });
+}
@@ -0,0 +1,484 @@
+﻿#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "exporter.hpp"
+#include "prayertimes.hpp"
+#include "timeformat.hpp"
+#include "timezone.hpp"
+
+// Output of a run of consecutive locations.
+struct TimetableExporter::Chunk
+{
+    std::size_t sequence;
+    std::size_t first;		// index of the first location
+    std::vector<char> text;
+    std::vector<std::size_t> ends;		// end of the text of each location
+};
+
+// A day of the export, with what every location needs of it.
+struct TimetableExporter::Day
+{
+    int year, month, day;
+    int64_t epoch_day;		// days since 1970-01-01
+    char date[TimeFormat::DATE_SIZE];		// YYYY-MM-DD
+};
+
+// One call of write or write_files.
+struct TimetableExporter::Job
+{
+    const Location* locations;
+    std::size_t num_locations;
+    int num_days;
+    const TimeZone* zone;
+    std::vector<Day> days;
+    std::vector<double> offsets;		// of the zone on every day, empty without one
+    char stamp[16];		// YYYYMMDDTHHMMSSZ
+    std::function<bool(const Chunk& chunk)> sink;		// called in order from the writing thread
+};
+
+namespace {
+
+const char* const CSV_HEADER = "location,latitude,longitude,date,fajr,sunrise,dhuhr,asr,sunset,maghrib,isha\n";
+const char* const JSON_NAMES[Parameters::TimesCount] = { "fajr", "sunrise", "dhuhr", "asr", "sunset", "maghrib", "isha" };
+const char* const EVENT_NAMES[Parameters::TimesCount] = { "Fajr", "Sunrise", "Dhuhr", "Asr", "Sunset", "Maghrib", "Isha" };
+
+const std::size_t LOCATION_SIZE = 256;		// bound of the per location text besides the days
+
+inline char* put(const char* text, char* out)
+{
+    std::size_t n = strlen(text);
+    memcpy(out, text, n);
+    return out + n;
+}
+
+inline int64_t floor_div(int64_t a, int64_t b)
+{
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+/* write YYYYMMDDTHHMMSSZ of a UTC time */
+char* utc_stamp(int64_t seconds, char* out)
+{
+    int64_t days = floor_div(seconds, 86400);
+    int second_of_day = (int) (seconds - days * 86400);
+    int year, month, day;
+    CivilCalendar::civil_from_days(days, year, month, day);
+    out = TimeFormat::two_digits(year / 100 % 100, out);
+    out = TimeFormat::two_digits(year % 100, out);
+    out = TimeFormat::two_digits(month, out);
+    out = TimeFormat::two_digits(day, out);
+    *out++ = 'T';
+    out = TimeFormat::two_digits(second_of_day / 3600, out);
+    out = TimeFormat::two_digits(second_of_day / 60 % 60, out);
+    out = TimeFormat::two_digits(second_of_day % 60, out);
+    *out++ = 'Z';
+    return out;
+}
+
+bool write_all(int fd, const char* data, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Buffers a stream into WRITE_SIZE writes from page-aligned memory.
+class AlignedWriter
+{
+public:
+    explicit AlignedWriter(int fd)
+        : fd(fd)
+        , buffer(NULL)
+        , used(0)
+        , written(0)
+    {
+        void* memory;
+        if (posix_memalign(&memory, TimetableExporter::WRITE_ALIGNMENT, TimetableExporter::WRITE_SIZE) == 0)
+            buffer = (char*) memory;
+    }
+
+    ~AlignedWriter()
+    {
+        free(buffer);
+    }
+
+    bool append(const char* data, std::size_t size)
+    {
+        if (!buffer)
+            return false;
+        while (size > 0)
+        {
+            std::size_t n = std::min(size, (std::size_t) TimetableExporter::WRITE_SIZE - used);
+            memcpy(buffer + used, data, n);
+            used += n;
+            data += n;
+            size -= n;
+            if (used == TimetableExporter::WRITE_SIZE && !flush())
+                return false;
+        }
+        return true;
+    }
+
+    bool flush()
+    {
+        if (!buffer || !write_all(fd, buffer, used))
+            return false;
+        written += used;
+        used = 0;
+        return true;
+    }
+
+    uint64_t bytes() const { return written; }
+
+private:
+    int fd;
+    char* buffer;
+    std::size_t used;
+    uint64_t written;
+};
+
+}
+
+TimetableExporter::TimetableExporter(const CalcConfig& config, Format format, unsigned threads)
+    : calculator(config)
+    , format(format)
+    , threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+    , stamp(time(NULL))
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+TimetableExporter::~TimetableExporter()
+{
+}
+
+const char* TimetableExporter::extension(Format format)
+{
+    switch (format)
+    {
+    case Json:
+        return "json";
+    case ICal:
+        return "ics";
+    default:
+        return "csv";
+    }
+}
+
+std::size_t TimetableExporter::max_day_size() const
+{
+    switch (format)
+    {
+    case Json:
+        return 256;		// {"date":"YYYY-MM-DD", "maghrib":"HH:MM" ...},
+    case ICal:
+        return Parameters::TimesCount * 160;		// a VEVENT of 5 lines per prayer
+    default:
+        return 128;		// location, latitude, longitude, date and 7 times
+    }
+}
+
+char* TimetableExporter::format_location(const Job& job, std::size_t index, const Timetable& table, char* out) const
+{
+    const Location& location = job.locations[index];
+    char prefix[LOCATION_SIZE];
+    int prefix_size;
+
+    switch (format)
+    {
+    case Csv:
+        prefix_size = snprintf(prefix, sizeof(prefix), "%zu,%.5lf,%.5lf,", index, location.latitude, location.longitude);
+        for (int d = 0; d < job.num_days; ++d)
+        {
+            memcpy(out, prefix, prefix_size);
+            out = (char*) memcpy(out + prefix_size, job.days[d].date, TimeFormat::DATE_SIZE) + TimeFormat::DATE_SIZE;
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+            {
+                *out++ = ',';
+                out = TimeFormat::time24(table.at(d, p), out);
+            }
+            *out++ = '\n';
+        }
+        break;
+
+    case Json:
+        out += snprintf(out, LOCATION_SIZE, "{\"location\":%zu,\"latitude\":%.5lf,\"longitude\":%.5lf,\"days\":[",
+                        index, location.latitude, location.longitude);
+        for (int d = 0; d < job.num_days; ++d)
+        {
+            out = put(d ? ",{\"date\":\"" : "{\"date\":\"", out);
+            out = (char*) memcpy(out, job.days[d].date, TimeFormat::DATE_SIZE) + TimeFormat::DATE_SIZE;
+            *out++ = '"';
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+            {
+                *out++ = ',';
+                *out++ = '"';
+                out = put(JSON_NAMES[p], out);
+                const double time = table.at(d, p);
+                if (std::isnan(time))
+                {
+                    out = put("\":null", out);
+                    continue;
+                }
+                out = put("\":\"", out);
+                out = TimeFormat::time24(time, out);
+                *out++ = '"';
+            }
+            *out++ = '}';
+        }
+        out = put("]}\n", out);
+        break;
+
+    case ICal:
+        out += snprintf(out, LOCATION_SIZE, "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//qt-salat//prayer times//EN\r\n"
+                        "X-WR-CALNAME:Prayer times %.5lf,%.5lf\r\n", location.latitude, location.longitude);
+        prefix_size = snprintf(prefix, sizeof(prefix), "BEGIN:VEVENT\r\nUID:%zu-", index);
+        for (int d = 0; d < job.num_days; ++d)
+        {
+            const Day& day = job.days[d];
+            char uid_date[8];		// YYYYMMDD
+            memcpy(uid_date, day.date, 4);
+            memcpy(uid_date + 4, day.date + 5, 2);
+            memcpy(uid_date + 6, day.date + 8, 2);
+            const double offset = job.zone ? job.offsets[d] : location.timezone;
+            for (int p = 0; p < Parameters::TimesCount; ++p)
+            {
+                const double time = table.at(d, p);
+                if (std::isnan(time))
+                    continue;
+                // the local minute shown by the other formats, in UTC; not wrapped
+                // to the day, as Isha can fall after midnight
+                const int64_t minute = (int64_t) floor((time + 0.5 / 60) * 60);
+                const int64_t seconds = day.epoch_day * 86400 + minute * 60 - llround(offset * 3600);
+
+                out = (char*) memcpy(out, prefix, prefix_size) + prefix_size;
+                out = (char*) memcpy(out, uid_date, sizeof(uid_date)) + sizeof(uid_date);
+                *out++ = '-';
+                *out++ = (char) ('0' + p);
+                out = put("@qt-salat\r\nDTSTAMP:", out);
+                out = (char*) memcpy(out, job.stamp, sizeof(job.stamp)) + sizeof(job.stamp);
+                out = put("\r\nDTSTART:", out);
+                out = utc_stamp(seconds, out);
+                out = put("\r\nSUMMARY:", out);
+                out = put(EVENT_NAMES[p], out);
+                out = put("\r\nEND:VEVENT\r\n", out);
+            }
+        }
+        out = put("END:VCALENDAR\r\n", out);
+        break;
+    }
+    return out;
+}
+
+bool TimetableExporter::run(Job& job)
+{
+    const std::size_t location_bound = job.num_days * max_day_size() + LOCATION_SIZE;
+    const std::size_t per_chunk = std::max((std::size_t) 1, (std::size_t) CHUNK_BYTES / location_bound);
+    const std::size_t num_chunks = (job.num_locations + per_chunk - 1) / per_chunk;
+    const unsigned workers = (unsigned) std::min((std::size_t) threads, std::max((std::size_t) 1, num_chunks));
+    const std::size_t slots = 2 * workers + 2;		// chunks in flight
+
+    std::vector<std::unique_ptr<Chunk> > chunks(slots);
+    std::vector<Chunk*> free_chunks;
+    std::vector<Chunk*> ready(slots, (Chunk*) NULL);		// by sequence modulo slots
+    for (std::size_t i = 0; i < slots; ++i)
+    {
+        chunks[i].reset(new Chunk);
+        free_chunks.push_back(chunks[i].get());
+    }
+
+    std::mutex lock;
+    std::condition_variable chunk_free;
+    std::condition_variable chunk_ready;
+    std::size_t next = 0;		// sequence of the next chunk to compute
+    bool stopping = false;
+
+    auto work = [&]()
+    {
+        Timetable table(job.num_days);
+        for (;;)
+        {
+            Chunk* chunk;
+            {
+                // chunks are taken in order, so the one the writer waits for is always being computed
+                std::unique_lock<std::mutex> guard(lock);
+                chunk_free.wait(guard, [&]() { return stopping || next >= num_chunks || !free_chunks.empty(); });
+                if (stopping || next >= num_chunks)
+                    return;
+                chunk = free_chunks.back();
+                free_chunks.pop_back();
+                chunk->sequence = next++;
+            }
+
+            chunk->first = chunk->sequence * per_chunk;
+            const std::size_t count = std::min(per_chunk, job.num_locations - chunk->first);
+            chunk->text.resize(count * location_bound);
+            chunk->ends.clear();
+            char* const start = &chunk->text[0];
+            char* out = start;
+            for (std::size_t i = chunk->first; i < chunk->first + count; ++i)
+            {
+                const Location& location = job.locations[i];
+                const double timezone = job.zone ? job.offsets[0] : location.timezone;
+                const Day& day = job.days[0];
+                calculator.compute_range_times(Query::make(day.year, day.month, day.day, location.latitude,
+                                                           location.longitude, timezone), table);
+                if (job.zone)
+                    table.shift_days(&job.offsets[0], timezone);
+                out = format_location(job, i, table, out);
+                chunk->ends.push_back(out - start);
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                ready[chunk->sequence % slots] = chunk;
+            }
+            chunk_ready.notify_one();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < workers; ++t)
+        pool.push_back(std::thread(work));
+
+    bool ok = true;
+    for (std::size_t sequence = 0; sequence < num_chunks && ok; ++sequence)
+    {
+        Chunk* chunk;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            Chunk*& slot = ready[sequence % slots];
+            chunk_ready.wait(guard, [&]() { return slot && slot->sequence == sequence; });
+            chunk = slot;
+            slot = NULL;
+        }
+        ok = job.sink(*chunk);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            free_chunks.push_back(chunk);
+            stopping = !ok;
+        }
+        chunk_free.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    chunk_free.notify_all();
+    for (std::size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+    return ok;
+}
+
+void TimetableExporter::prepare(Job& job, const Location locations[], std::size_t num_locations,
+                                int year, int month, int day, int num_days, const TimeZone* zone) const
+{
+    job.locations = locations;
+    job.num_locations = num_locations;
+    job.num_days = num_days;
+    job.zone = zone;
+
+    // dates and offsets of every day, once for all locations
+    const int64_t first = CivilCalendar::days_from_civil(year, month, day);
+    job.days.resize(num_days);
+    for (int d = 0; d < num_days; ++d)
+    {
+        Day& out = job.days[d];
+        out.epoch_day = first + d;
+        CivilCalendar::civil_from_days(out.epoch_day, out.year, out.month, out.day);
+        TimeFormat::date(out.year, out.month, out.day, out.date);
+    }
+    job.offsets.clear();
+    if (zone)
+    {
+        job.offsets.resize(num_days);
+        zone->day_offsets(year, month, day, num_days, &job.offsets[0]);
+    }
+    utc_stamp(stamp, job.stamp);
+}
+
+bool TimetableExporter::write(int fd, const Location locations[], std::size_t num_locations,
+                              int year, int month, int day, int num_days, const TimeZone* zone)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    memset(&counters, 0, sizeof(counters));
+    if (num_days < 1)
+        return false;
+
+    Job job;
+    prepare(job, locations, num_locations, year, month, day, num_days, zone);
+    AlignedWriter writer(fd);
+    job.sink = [&](const Chunk& chunk)
+    {
+        return writer.append(&chunk.text[0], chunk.ends.back());
+    };
+    bool ok = (format != Csv || writer.append(CSV_HEADER, strlen(CSV_HEADER))) && run(job) && writer.flush();
+
+    counters.locations = num_locations;
+    counters.days = (uint64_t) num_locations * num_days;
+    counters.bytes = writer.bytes();
+    counters.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+bool TimetableExporter::write_files(const std::string& directory, const Location locations[], std::size_t num_locations,
+                                    int year, int month, int day, int num_days, const TimeZone* zone)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    memset(&counters, 0, sizeof(counters));
+    if (num_days < 1)
+        return false;
+
+    Job job;
+    prepare(job, locations, num_locations, year, month, day, num_days, zone);
+    const std::size_t header_size = format == Csv ? strlen(CSV_HEADER) : 0;
+    std::vector<char> path(directory.size() + 32);
+    job.sink = [&](const Chunk& chunk)
+    {
+        std::size_t begin = 0;
+        for (std::size_t i = 0; i < chunk.ends.size(); ++i)
+        {
+            snprintf(&path[0], path.size(), "%s/%06zu.%s", directory.c_str(), chunk.first + i, extension(format));
+            int fd = open(&path[0], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+                return false;
+            bool ok = write_all(fd, CSV_HEADER, header_size) && write_all(fd, &chunk.text[begin], chunk.ends[i] - begin);
+            ok = close(fd) == 0 && ok;
+            if (!ok)
+                return false;
+            counters.bytes += header_size + chunk.ends[i] - begin;
+            begin = chunk.ends[i];
+        }
+        return true;
+    };
+    bool ok = run(job);
+
+    counters.locations = num_locations;
+    counters.days = (uint64_t) num_locations * num_days;
+    counters.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
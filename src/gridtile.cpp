@@ -0,0 +1,391 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gridtile.hpp"
+#include "executor.hpp"
+#include "timezone.hpp"
+
+// File layout: Header, int16_t values[days][rows][cols][TimesCount],
+// uint8_t flags[days][rows - 1][cols - 1]; all in host byte order.
+struct GridTile::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    double south;
+    double west;
+    double lat_step;
+    double lon_step;
+    uint32_t rows;
+    uint32_t cols;
+    int32_t year;
+    int32_t month;
+    int32_t day;
+    uint32_t days;
+    // settings the tile was computed with, for the exact fallback
+    double fajr_angle;
+    double maghrib_value;
+    double isha_value;
+    double dhuhr_minutes;
+    uint8_t maghrib_is_minutes;
+    uint8_t isha_is_minutes;
+    uint8_t asr_juristic;
+    uint8_t adjust_high_lats;
+    float max_error;		// seconds
+    float measured_error;		// seconds, largest at the check points of interpolated cells
+    uint32_t exact_cells;		// flagged (day, cell) pairs
+    uint8_t ephemeris;
+    uint8_t precision;
+    uint8_t reserved[6];
+};
+
+namespace {
+
+const char MAGIC[8] = { 'P', 'T', 'G', 'R', 'I', 'D', '\r', '\n' };
+const uint32_t VERSION = 3;
+
+const int16_t UNDEFINED = INT16_MIN;		// NaN, or out of the representable range
+const double UNITS_PER_HOUR = 1800.0;		// 2 second units
+
+/* hours from solar noon of a longitude to a UTC time */
+inline double noon(double longitude)
+{
+    return 12.0 - longitude / 15.0;
+}
+
+int16_t encode(double utc_hours, double longitude)
+{
+    double units = std::floor((utc_hours - noon(longitude)) * UNITS_PER_HOUR + 0.5);
+    if (std::isnan(units) || units <= UNDEFINED || units > INT16_MAX)
+        return UNDEFINED;
+    return (int16_t) units;
+}
+
+/* bilinear interpolation between the corners (row, col), (row, col + 1),
+   (row + 1, col), (row + 1, col + 1); false if any corner is undefined */
+bool interpolate(const int16_t* c00, const int16_t* c01, const int16_t* c10, const int16_t* c11,
+                 double fy, double fx, double longitude, double times[])
+{
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+    {
+        if (c00[i] == UNDEFINED || c01[i] == UNDEFINED || c10[i] == UNDEFINED || c11[i] == UNDEFINED)
+            return false;
+        double bottom = c00[i] + (c01[i] - c00[i]) * fx;
+        double top = c10[i] + (c11[i] - c10[i]) * fx;
+        times[i] = noon(longitude) + (bottom + (top - bottom) * fy) / UNITS_PER_HOUR;
+    }
+    return true;
+}
+
+/* exact UTC times of every day at a point */
+void compute_point(const Calculator& calculator, const GridSpec& spec, double latitude, double longitude, Timetable& table)
+{
+    table.resize(spec.days);
+    calculator.compute_range_times(Query::make(spec.year, spec.month, spec.day, latitude, longitude, 0.0), table);
+}
+
+}
+
+GridTile::GridTile()
+    : mapping(NULL)
+    , mapping_size(0)
+    , header(NULL)
+    , values(NULL)
+    , flags(NULL)
+    , first_day(0)
+{
+    memset(&grid, 0, sizeof(grid));
+}
+
+GridTile::~GridTile()
+{
+    close();
+}
+
+bool GridTile::generate(const std::string& path, const CalcConfig& config, const GridSpec& spec, unsigned threads)
+{
+    if (spec.rows < 2 || spec.cols < 2 || spec.days < 1 || !(spec.lat_step > 0) || !(spec.lon_step > 0))
+        return false;
+
+    const Calculator calculator(config);
+    const std::size_t rows = spec.rows, cols = spec.cols, days = spec.days;
+    const std::size_t day_values = rows * cols * Parameters::TimesCount;
+    const std::size_t day_cells = (rows - 1) * (cols - 1);
+    std::vector<int16_t> values(days * day_values);
+    std::vector<uint8_t> flags(days * day_cells);
+    WorkStealingPool pool(threads);
+
+    // times at the grid points
+    pool.parallel_for(rows, 1, [&](std::size_t begin, std::size_t end)
+    {
+        Timetable table;
+        for (std::size_t r = begin; r < end; ++r)
+            for (std::size_t c = 0; c < cols; ++c)
+            {
+                double longitude = spec.west + c * spec.lon_step;
+                compute_point(calculator, spec, spec.south + r * spec.lat_step, longitude, table);
+                for (std::size_t d = 0; d < days; ++d)
+                    for (int i = 0; i < Parameters::TimesCount; ++i)
+                        values[d * day_values + (r * cols + c) * Parameters::TimesCount + i] = encode(table.at(d, i), longitude);
+            }
+    });
+
+    // check every cell at its center and edge midpoints
+    std::mutex result_lock;
+    double measured_error = 0;
+    uint32_t exact_cells = 0;
+    pool.parallel_for(rows - 1, 1, [&](std::size_t begin, std::size_t end)
+    {
+        struct Check
+        {
+            double fy, fx;		// position inside the cell
+            const Timetable* table;
+        };
+        std::vector<Timetable> centers(cols - 1), bottoms(cols - 1), tops(cols - 1), sides(cols);
+        double row_error = 0;
+        uint32_t row_exact = 0;
+        for (std::size_t r = begin; r < end; ++r)
+        {
+            double latitude = spec.south + r * spec.lat_step;
+            for (std::size_t c = 0; c < cols; ++c)
+            {
+                double longitude = spec.west + c * spec.lon_step;
+                compute_point(calculator, spec, latitude + 0.5 * spec.lat_step, longitude, sides[c]);
+                if (c + 1 == cols)
+                    break;
+                compute_point(calculator, spec, latitude + 0.5 * spec.lat_step, longitude + 0.5 * spec.lon_step, centers[c]);
+                compute_point(calculator, spec, latitude, longitude + 0.5 * spec.lon_step, bottoms[c]);
+                compute_point(calculator, spec, latitude + spec.lat_step, longitude + 0.5 * spec.lon_step, tops[c]);
+            }
+
+            for (std::size_t c = 0; c + 1 < cols; ++c)
+            {
+                const Check checks[] =
+                {
+                    { 0.5, 0.5, &centers[c] },
+                    { 0.0, 0.5, &bottoms[c] },
+                    { 1.0, 0.5, &tops[c] },
+                    { 0.5, 0.0, &sides[c] },
+                    { 0.5, 1.0, &sides[c + 1] },
+                };
+                for (std::size_t d = 0; d < days; ++d)
+                {
+                    const int16_t* base = &values[d * day_values];
+                    const int16_t* c00 = base + (r * cols + c) * Parameters::TimesCount;
+                    const int16_t* c10 = c00 + cols * Parameters::TimesCount;
+                    double cell_error = 0;
+                    bool exact = false;
+                    for (const Check& check : checks)
+                    {
+                        double longitude = spec.west + (c + check.fx) * spec.lon_step;
+                        double times[Parameters::TimesCount];
+                        if (!interpolate(c00, c00 + Parameters::TimesCount, c10, c10 + Parameters::TimesCount, check.fy, check.fx, longitude, times))
+                        {
+                            exact = true;
+                            break;
+                        }
+                        for (int i = 0; i < Parameters::TimesCount; ++i)
+                        {
+                            double expected = check.table->at(d, i);
+                            if (std::isnan(expected))
+                                exact = true;
+                            else
+                                cell_error = std::max(cell_error, fabs(times[i] - expected) * 3600.0);
+                        }
+                    }
+                    if (exact || cell_error > 0.5 * spec.max_error)
+                    {
+                        flags[d * day_cells + r * (cols - 1) + c] = 1;
+                        ++row_exact;
+                    }
+                    else
+                        row_error = std::max(row_error, cell_error);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> guard(result_lock);
+        measured_error = std::max(measured_error, row_error);
+        exact_cells += row_exact;
+    });
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.header_size = sizeof(Header);
+    header.south = spec.south;
+    header.west = spec.west;
+    header.lat_step = spec.lat_step;
+    header.lon_step = spec.lon_step;
+    header.rows = spec.rows;
+    header.cols = spec.cols;
+    header.year = spec.year;
+    header.month = spec.month;
+    header.day = spec.day;
+    header.days = spec.days;
+    header.fajr_angle = config.method.fajr_angle;
+    header.maghrib_value = config.method.maghrib_value;
+    header.isha_value = config.method.isha_value;
+    header.dhuhr_minutes = config.dhuhr_minutes;
+    header.maghrib_is_minutes = config.method.maghrib_is_minutes;
+    header.isha_is_minutes = config.method.isha_is_minutes;
+    header.asr_juristic = config.asr_juristic;
+    header.adjust_high_lats = config.adjust_high_lats;
+    header.ephemeris = config.ephemeris;
+    header.precision = config.precision;
+    header.max_error = spec.max_error;
+    header.measured_error = measured_error;
+    header.exact_cells = exact_cells;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(&values[0], sizeof(int16_t), values.size(), f) == values.size()
+        && fwrite(&flags[0], 1, flags.size(), f) == flags.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool GridTile::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (std::size_t) st.st_size >= sizeof(Header))
+    {
+        void* m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED)
+        {
+            mapping = m;
+            mapping_size = st.st_size;
+        }
+    }
+    ::close(fd);
+    if (!mapping)
+        return false;
+
+    const Header* h = (const Header*) mapping;
+    if (memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 || h->version != VERSION || h->header_size != sizeof(Header)
+        || h->rows < 2 || h->cols < 2 || h->days < 1)
+    {
+        close();
+        return false;
+    }
+    std::size_t num_values = (std::size_t) h->days * h->rows * h->cols * Parameters::TimesCount;
+    std::size_t num_flags = (std::size_t) h->days * (h->rows - 1) * (h->cols - 1);
+    if (mapping_size != sizeof(Header) + num_values * sizeof(int16_t) + num_flags)
+    {
+        close();
+        return false;
+    }
+
+    header = h;
+    values = (const int16_t*) (h + 1);
+    flags = (const uint8_t*) (values + num_values);
+
+    grid.south = h->south;
+    grid.west = h->west;
+    grid.lat_step = h->lat_step;
+    grid.lon_step = h->lon_step;
+    grid.rows = h->rows;
+    grid.cols = h->cols;
+    grid.year = h->year;
+    grid.month = h->month;
+    grid.day = h->day;
+    grid.days = h->days;
+    grid.max_error = h->max_error;
+    first_day = CivilCalendar::days_from_civil(h->year, h->month, h->day);
+
+    CalcConfig config;
+    config.method = Parameters::MethodConfig(h->fajr_angle, h->maghrib_is_minutes, h->maghrib_value, h->isha_is_minutes, h->isha_value);
+    config.asr_juristic = (Parameters::JuristicMethod) h->asr_juristic;
+    config.adjust_high_lats = (Parameters::AdjustingMethod) h->adjust_high_lats;
+    config.dhuhr_minutes = h->dhuhr_minutes;
+    config.ephemeris = (Parameters::EphemerisMode) h->ephemeris;
+    config.precision = (Parameters::PrecisionTier) h->precision;
+    calculator = Calculator(config);
+    return true;
+}
+
+void GridTile::close()
+{
+    if (mapping)
+        munmap(mapping, mapping_size);
+    mapping = NULL;
+    mapping_size = 0;
+    header = NULL;
+    values = NULL;
+    flags = NULL;
+}
+
+const int16_t* GridTile::point(int day, int row, int col) const
+{
+    return values + (((std::size_t) day * grid.rows + row) * grid.cols + col) * Parameters::TimesCount;
+}
+
+bool GridTile::cell_exact(int day, int row, int col) const
+{
+    return flags[((std::size_t) day * (grid.rows - 1) + row) * (grid.cols - 1) + col] != 0;
+}
+
+GridTile::Source GridTile::times(double latitude, double longitude, int day, double timezone, double times[]) const
+{
+    if (!header || day < 0 || day >= grid.days)
+        return Outside;
+    double fy = (latitude - grid.south) / grid.lat_step;
+    double fx = (longitude - grid.west) / grid.lon_step;
+    if (!(fy >= 0 && fx >= 0 && fy <= grid.rows - 1 && fx <= grid.cols - 1))
+        return Outside;
+
+    int row = std::min((int) fy, grid.rows - 2);
+    int col = std::min((int) fx, grid.cols - 2);
+    if (!cell_exact(day, row, col))
+    {
+        const int16_t* c00 = point(day, row, col);
+        const int16_t* c10 = point(day, row + 1, col);
+        if (interpolate(c00, c00 + Parameters::TimesCount, c10, c10 + Parameters::TimesCount, fy - row, fx - col, longitude, times))
+        {
+            for (int i = 0; i < Parameters::TimesCount; ++i)
+                times[i] += timezone;
+            return Interpolated;
+        }
+    }
+
+    int year, month, mday;
+    CivilCalendar::civil_from_days(first_day + day, year, month, mday);
+    calculator.compute_day_times(Query::make(year, month, mday, latitude, longitude, timezone), times);
+    return Exact;
+}
+
+GridTile::Source GridTile::times(double latitude, double longitude, int year, int month, int day, double timezone, double times[]) const
+{
+    if (!header)
+        return Outside;
+    int64_t index = CivilCalendar::days_from_civil(year, month, day) - first_day;
+    if (index < 0 || index >= grid.days)
+        return Outside;
+    return this->times(latitude, longitude, (int) index, timezone, times);
+}
+
+double GridTile::exact_share() const
+{
+    if (!header)
+        return 0;
+    return (double) header->exact_cells / ((double) grid.days * (grid.rows - 1) * (grid.cols - 1));
+}
+
+double GridTile::measured_error() const
+{
+    return header ? header->measured_error : 0;
+}
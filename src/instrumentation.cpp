@@ -0,0 +1,275 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "instrumentation.hpp"
+
+namespace {
+
+const char* const COUNTER_NAMES[CalcCounterCount] =
+{
+    "days_computed",
+    "sun_positions",
+    "undefined_times",
+    "fajr_adjusted",
+    "isha_adjusted",
+    "maghrib_adjusted",
+};
+
+const char* const STAGE_NAMES[CalcStageCount] =
+{
+    "compute_day_times",
+    "compute_range_times",
+    "compute_times",
+    "adjust_times",
+    "adjust_high_lat_times",
+};
+
+#ifdef PRAYERTIMES_INSTRUMENTATION
+
+struct TraceEvent
+{
+    CalcStage stage;
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+// Totals of one thread. Only the owner writes, so relaxed load and store
+// replace the read-modify-write and readers see every value whole.
+struct ThreadSlot
+{
+    ThreadSlot();
+    ~ThreadSlot();
+
+    std::atomic<uint64_t> counters[CalcCounterCount];
+    std::atomic<uint64_t> calls[CalcStageCount];
+    std::atomic<uint64_t> cycles[CalcStageCount];
+    std::vector<TraceEvent> events;
+    unsigned thread_id;
+};
+
+std::mutex slots_lock;
+std::vector<ThreadSlot*> slots;		// of running threads
+CalcStats retired;		// totals of exited threads
+std::vector<std::pair<unsigned, TraceEvent> > retired_events;
+unsigned next_thread_id = 1;
+
+std::atomic<bool> tracing(false);
+std::atomic<std::size_t> max_trace_events(0);
+const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+ThreadSlot::ThreadSlot()
+{
+    for (int i = 0; i < CalcCounterCount; ++i)
+        counters[i].store(0, std::memory_order_relaxed);
+    for (int i = 0; i < CalcStageCount; ++i)
+    {
+        calls[i].store(0, std::memory_order_relaxed);
+        cycles[i].store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> guard(slots_lock);
+    thread_id = next_thread_id++;
+    slots.push_back(this);
+}
+
+ThreadSlot::~ThreadSlot()
+{
+    std::lock_guard<std::mutex> guard(slots_lock);
+    for (int i = 0; i < CalcCounterCount; ++i)
+        retired.counters[i] += counters[i].load(std::memory_order_relaxed);
+    for (int i = 0; i < CalcStageCount; ++i)
+    {
+        retired.calls[i] += calls[i].load(std::memory_order_relaxed);
+        retired.cycles[i] += cycles[i].load(std::memory_order_relaxed);
+    }
+    for (const TraceEvent& event : events)
+        retired_events.push_back(std::make_pair(thread_id, event));
+    slots.erase(std::find(slots.begin(), slots.end(), this));
+}
+
+ThreadSlot& slot()
+{
+    static thread_local ThreadSlot s;
+    return s;
+}
+
+inline void add(std::atomic<uint64_t>& total, uint64_t n)
+{
+    total.store(total.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline int64_t trace_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+void write_event(FILE* f, bool first, unsigned thread_id, const TraceEvent& event)
+{
+    fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+            first ? "" : ",", STAGE_NAMES[event.stage], event.start_ns / 1000.0, event.duration_ns / 1000.0, thread_id);
+}
+
+#endif
+
+}
+
+bool Instrumentation::enabled()
+{
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+}
+
+CalcStats Instrumentation::stats()
+{
+    CalcStats stats;
+    memset(&stats, 0, sizeof(stats));
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    std::lock_guard<std::mutex> guard(slots_lock);
+    stats = retired;
+    for (const ThreadSlot* s : slots)
+    {
+        for (int i = 0; i < CalcCounterCount; ++i)
+            stats.counters[i] += s->counters[i].load(std::memory_order_relaxed);
+        for (int i = 0; i < CalcStageCount; ++i)
+        {
+            stats.calls[i] += s->calls[i].load(std::memory_order_relaxed);
+            stats.cycles[i] += s->cycles[i].load(std::memory_order_relaxed);
+        }
+    }
+#endif
+    return stats;
+}
+
+void Instrumentation::reset()
+{
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    std::lock_guard<std::mutex> guard(slots_lock);
+    memset(&retired, 0, sizeof(retired));
+    for (ThreadSlot* s : slots)
+    {
+        for (int i = 0; i < CalcCounterCount; ++i)
+            s->counters[i].store(0, std::memory_order_relaxed);
+        for (int i = 0; i < CalcStageCount; ++i)
+        {
+            s->calls[i].store(0, std::memory_order_relaxed);
+            s->cycles[i].store(0, std::memory_order_relaxed);
+        }
+    }
+#endif
+}
+
+const char* Instrumentation::counter_name(CalcCounter counter)
+{
+    return COUNTER_NAMES[counter];
+}
+
+const char* Instrumentation::stage_name(CalcStage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+void Instrumentation::start_trace(std::size_t max_events)
+{
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    max_trace_events.store(max_events, std::memory_order_relaxed);
+    tracing.store(true, std::memory_order_relaxed);
+#else
+    (void) max_events;
+#endif
+}
+
+bool Instrumentation::write_trace(const std::string& path)
+{
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    tracing.store(false, std::memory_order_relaxed);
+#endif
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", f);
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    {
+        std::lock_guard<std::mutex> guard(slots_lock);
+        bool first = true;
+        for (const std::pair<unsigned, TraceEvent>& event : retired_events)
+        {
+            write_event(f, first, event.first, event.second);
+            first = false;
+        }
+        for (const ThreadSlot* s : slots)
+            for (const TraceEvent& event : s->events)
+            {
+                write_event(f, first, s->thread_id, event);
+                first = false;
+            }
+    }
+#endif
+    fputs("\n]}\n", f);
+    return fclose(f) == 0;
+}
+
+void Instrumentation::count(CalcCounter counter, uint64_t n)
+{
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    add(slot().counters[counter], n);
+#else
+    (void) counter;
+    (void) n;
+#endif
+}
+
+void Instrumentation::count_undefined(const double times[], int n)
+{
+    uint64_t undefined = 0;
+    for (int i = 0; i < n; ++i)
+        undefined += std::isnan(times[i]);
+    if (undefined)
+        count(UndefinedTimes, undefined);
+}
+
+Instrumentation::StageTimer::StageTimer(CalcStage stage)
+    : stage(stage)
+    , start_cycles(0)
+    , start_ns(-1)
+{
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    if (tracing.load(std::memory_order_relaxed))
+        start_ns = trace_ns();
+    start_cycles = read_cycles();
+#endif
+}
+
+Instrumentation::StageTimer::~StageTimer()
+{
+#ifdef PRAYERTIMES_INSTRUMENTATION
+    uint64_t elapsed = read_cycles() - start_cycles;
+    ThreadSlot& s = slot();
+    add(s.calls[stage], 1);
+    add(s.cycles[stage], elapsed);
+    if (start_ns >= 0 && s.events.size() < max_trace_events.load(std::memory_order_relaxed))
+    {
+        TraceEvent event = { stage, start_ns, trace_ns() - start_ns };
+        s.events.push_back(event);
+    }
+#endif
+}
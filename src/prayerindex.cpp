@@ -0,0 +1,77 @@
+﻿#include <algorithm>
+#include <cmath>
+
+#include "prayerindex.hpp"
+#include "timezone.hpp"
+
+PrayerIndex::PrayerIndex()
+    : bucket_origin(0)
+{
+}
+
+PrayerIndex::PrayerIndex(const Timetable& table, int year, int month, int day, double timezone, unsigned mask)
+    : bucket_origin(0)
+{
+    // times are hours after local midnight, possibly outside [0, 24) after adjusting
+    std::vector<std::pair<int64_t, uint8_t> > events;
+    events.reserve(table.days * Parameters::TimesCount);
+    int64_t first_day = CivilCalendar::days_from_civil(year, month, day);
+    for (int d = 0; d < table.days; ++d)
+        for (int i = 0; i < Parameters::TimesCount; ++i)
+        {
+            double time = table.at(d, i);
+            if ((mask & (1u << i)) && !std::isnan(time))
+                events.push_back(std::make_pair((first_day + d) * 86400 + llround((time - timezone) * 3600), (uint8_t) i));
+        }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const std::pair<int64_t, uint8_t>& a, const std::pair<int64_t, uint8_t>& b) { return a.first < b.first; });
+
+    times.resize(events.size());
+    ids.resize(events.size());
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        times[i] = events[i].first;
+        ids[i] = events[i].second;
+    }
+    if (times.empty())
+        return;
+
+    // bucket b covers [bucket_origin + b * BUCKET_SECONDS, ...)
+    bucket_origin = times.front() - (times.front() % BUCKET_SECONDS + BUCKET_SECONDS) % BUCKET_SECONDS;
+    std::size_t num_buckets = (times.back() - bucket_origin) / BUCKET_SECONDS + 1;
+    buckets.resize(num_buckets);
+    std::size_t e = 0;
+    for (std::size_t b = 0; b < num_buckets; ++b)
+    {
+        int64_t start = bucket_origin + (int64_t) b * BUCKET_SECONDS;
+        while (e < times.size() && times[e] < start)
+            ++e;
+        buckets[b] = (uint32_t) e;
+    }
+}
+
+PrayerIndex PrayerIndex::make(const Calculator& calculator, int year, int month, int day, int num_days,
+                              double latitude, double longitude, unsigned mask)
+{
+    Timetable table(num_days);
+    calculator.compute_range_times(Query::make(year, month, day, latitude, longitude, 0.0), table);
+    return PrayerIndex(table, year, month, day, 0.0, mask);
+}
+
+bool PrayerIndex::lookup(int64_t utc, Position& position) const
+{
+    if (times.empty() || utc < times.front() || utc >= times.back())
+        return false;
+
+    // first event after utc: at most the events of one bucket to skip
+    std::size_t i = buckets[(utc - bucket_origin) / BUCKET_SECONDS];
+    while (times[i] <= utc)
+        ++i;
+
+    position.current = (Parameters::TimeID) ids[i - 1];
+    position.next = (Parameters::TimeID) ids[i];
+    position.current_start = times[i - 1];
+    position.next_start = times[i];
+    position.seconds_until = times[i] - utc;
+    return true;
+}
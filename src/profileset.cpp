@@ -0,0 +1,141 @@
+﻿#include <cmath>
+
+#include "profileset.hpp"
+#include "instrumentation.hpp"
+#include "trig.hpp"
+
+namespace {
+
+// Terms of compute_times that do not depend on the method, for one query and
+// ephemeris mode. Slots are the distinct guesses of the default tier.
+struct SolarTerms
+{
+    enum
+    {
+        FajrSlot,
+        SunriseSlot,
+        DhuhrSlot,
+        AsrSlot,
+        SunsetSlot,		// also Maghrib and Isha
+
+        SlotsCount
+    };
+
+    void compute(const Calculator& calc, const Query& query)
+    {
+        PT_STAGE(ComputeTimesStage);
+        static const double guesses[SlotsCount] = { 5, 6, 12, 13, 18 };		// default times of compute_day_times
+        sin_lat = TrigHelper::dsin(query.latitude);
+        cos_lat = TrigHelper::dcos(query.latitude);
+        latitude = query.latitude;
+        for (int s = 0; s < SlotsCount; ++s)
+        {
+            Calculator::DoublePair position = calc.sun_position(query.julian_date + guesses[s] / 24.0);
+            declination[s] = position.first;
+            sin_d[s] = TrigHelper::dsin(position.first);
+            cos_d[s] = TrigHelper::dcos(position.first);
+            mid_day[s] = TrigHelper::fix_hour(12 - position.second);
+        }
+        sunrise = hour_time(SunriseSlot, 180.0 - 0.833);
+        dhuhr = mid_day[DhuhrSlot];
+        sunset = hour_time(SunsetSlot, 0.833);
+        asr_times[0] = asr_times[1] = NAN;
+        has_asr[0] = has_asr[1] = false;
+    }
+
+    /* Calculator::compute_time at the guess of a slot */
+    double hour_time(int slot, double g) const
+    {
+        double v = 1.0 / 15.0 * TrigHelper::darccos((-TrigHelper::dsin(g) - sin_d[slot] * sin_lat) / (cos_d[slot] * cos_lat));
+        PT_COUNT_UNDEFINED(&v, 1);
+        return mid_day[slot] + (g > 90.0 ? - v :  v);
+    }
+
+    /* Calculator::compute_asr at its guess, once per juristic method */
+    double asr(Parameters::JuristicMethod juristic)
+    {
+        if (!has_asr[juristic])
+        {
+            double g = -TrigHelper::darccot(1 + juristic + TrigHelper::dtan(fabs(latitude - declination[AsrSlot])));
+            asr_times[juristic] = hour_time(AsrSlot, g);
+            has_asr[juristic] = true;
+        }
+        return asr_times[juristic];
+    }
+
+    double latitude;
+    double sin_lat;
+    double cos_lat;
+    double declination[SlotsCount];
+    double sin_d[SlotsCount];
+    double cos_d[SlotsCount];
+    double mid_day[SlotsCount];
+    double sunrise;
+    double dhuhr;
+    double sunset;
+    double asr_times[2];		// per juristic method
+    bool has_asr[2];
+};
+
+}
+
+ProfileSet::ProfileSet()
+{
+}
+
+ProfileSet::ProfileSet(const std::vector<CalcProfile>& profiles)
+{
+    calculators.reserve(profiles.size());
+    for (std::size_t i = 0; i < profiles.size(); ++i)
+        add(profiles[i]);
+}
+
+ProfileSet::ProfileSet(const CalcProfile profiles[], int count)
+{
+    calculators.reserve(count);
+    for (int i = 0; i < count; ++i)
+        add(profiles[i]);
+}
+
+void ProfileSet::add(CalcProfile profile)
+{
+    calculators.push_back(Calculator(profile));
+}
+
+void ProfileSet::compute_day_times(const Query& query, double times[]) const
+{
+    SolarTerms terms[Parameters::FittedEphemeris + 1];		// per ephemeris mode, computed on first use
+    bool ready[Parameters::FittedEphemeris + 1] = { false, false, false };
+
+    for (int i = 0; i < size(); ++i)
+    {
+        const Calculator& calc = calculators[i];
+        const CalcConfig& cfg = calc.config();
+        double* out = times + i * Parameters::TimesCount;
+        if (cfg.precision != Parameters::DefaultTier)
+        {
+            calc.compute_day_times(query, out);
+            continue;
+        }
+
+        PT_COUNT(DaysComputed, 1);
+        SolarTerms& t = terms[cfg.ephemeris];
+        if (!ready[cfg.ephemeris])
+        {
+            t.compute(calc, query);
+            ready[cfg.ephemeris] = true;
+        }
+
+        // the minutes settings replace Maghrib and Isha in adjust_times
+        const Parameters::MethodConfig& m = cfg.method;
+        out[Parameters::Fajr]    = t.hour_time(SolarTerms::FajrSlot, 180.0 - m.fajr_angle);
+        out[Parameters::Sunrise] = t.sunrise;
+        out[Parameters::Dhuhr]   = t.dhuhr;
+        out[Parameters::Asr]     = t.asr(cfg.asr_juristic);
+        out[Parameters::Sunset]  = t.sunset;
+        out[Parameters::Maghrib] = m.maghrib_is_minutes ? 0 : t.hour_time(SolarTerms::SunsetSlot, m.maghrib_value);
+        out[Parameters::Isha]    = m.isha_is_minutes ? 0 : t.hour_time(SolarTerms::SunsetSlot, m.isha_value);
+
+        calc.adjust_times(query, out);
+    }
+}
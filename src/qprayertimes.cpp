@@ -0,0 +1,22 @@
+﻿#include "qprayertimes.hpp"
+
+QPrayerTimes::QPrayerTimes(QObject* parent, Parameters::CalculationMethod calc_method, Parameters::JuristicMethod asr_juristic, Parameters::AdjustingMethod adjust_high_lats, double dhuhr_minutes)
+    : QObject(parent)
+    , PrayerTimes(calc_method, asr_juristic, adjust_high_lats, dhuhr_minutes)
+{
+}
+
+QPrayerTimes::~QPrayerTimes()
+{
+}
+
+QTimetableJob* QPrayerTimes::start_timetables(const QVector<Location>& locations, int year, int month, int day, int num_days,
+                                              const TimeZone* zone)
+{
+    QTimetableJob* job = new QTimetableJob(config(), this);
+    connect(job, &QTimetableJob::finished, job, &QObject::deleteLater);
+    if (job->start(locations, year, month, day, num_days, zone))
+        return job;
+    delete job;
+    return NULL;
+}
@@ -1,11 +1,22 @@
 ﻿#include <ctime>
 #include <cmath>
 #include <cstring>
+#include <memory>
+#include <vector>
 #include <unistd.h>
 #include <getopt.h>
 
 #include "prayertimes.hpp"
 #include "trig.hpp"
+#include "timezone.hpp"
+#include "batch.hpp"
+#include "daemon.hpp"
+#include "server.hpp"
+#include "resultcache.hpp"
+#include "timeformat.hpp"
+#include "timetablefile.hpp"
+#include "exporter.hpp"
+#include "instrumentation.hpp"
 
 #define PROG_NAME "prayertimes"
 #define PROG_NAME_FRIENDLY "PrayerTimes"
@@ -32,6 +43,9 @@ void print_help(FILE* f)
           "    --version                   -v  prints name and version, then exits\n"
           "    --date arg                  -d  get prayer times for arbitrary date\n"
           "    --timezone arg              -z  get prayer times for arbitrary timezone\n"
+          "    --zone arg                  -Z  take the timezone from a tz database zone, e.g. Europe/London\n"
+          "    --batch arg                 -b  read queries from stdin, csv or ndjson, see below\n"
+          "    --threads arg               -j  threads computing batch queries, 0 for all cores (default)\n"
           "  * --latitude arg              -l  latitude of desired location\n"
           "  * --longitude arg             -n  longitude of desired location\n"
           "    --calc-method arg           -c  select prayer time calculation method\n"
@@ -43,8 +57,19 @@ void print_help(FILE* f)
           " ** --fajr-angle arg                angle for calculating Fajr prayer time\n"
           " ** --maghrib-angle arg             angle for calculating Maghrib prayer time\n"
           " ** --isha-angle arg                angle for calculating Isha prayer time\n"
+          "    --precision arg                 trade accuracy for speed, see below\n"
+          "    --export file                   write a binary timetable from the date on, see below\n"
+          "    --days arg                      number of days to export, 365 by default\n"
+          "    --inspect file                  print a binary timetable as CSV\n"
+          "    --timetable arg                 write timetables from the date on as csv, json or ical, see below\n"
+          "    --output-dir dir                write --timetable to one file per location in dir, not stdout\n"
+          "    --serve address                 answer queries on a Unix socket path or [host:]port, see below\n"
+          "    --cache entries                 cache answers of single days in --serve, 0 for none (default)\n"
+          "    --daemon                        print every prayer when it is due, see below\n"
+          "    --stats                         print calculation counters and stage timings on exit\n"
+          "    --trace file                    write a Chrome trace of the calculation stages on exit\n"
           "\n"
-          "  * These options are required\n"
+          "  * These options are required, except in batch mode\n"
           " ** By providing any of these options the calculation method is set to custom\n"
           "\n"
           " Possible arguments for --calc-method\n"
@@ -65,10 +90,270 @@ void print_help(FILE* f)
           "    midnight      middle of night\n"
           "    oneseventh    1/7th of night\n"
           "    anglebased    angle/60th of night\n"
+          "\n"
+          " Possible arguments for --precision\n"
+          "    fast          times from one sun position per day, for previews\n"
+          "    default       one refinement of fixed guesses (standard)\n"
+          "    precise       refine until every time converges\n"
+          "\n"
+          " Batch mode\n"
+          "    Every input line is a query, either CSV\n"
+          "        latitude,longitude,YYYY-MM-DD[,days[,timezone[,method[,asr[,high-lats]]]]]\n"
+          "    or a JSON object with the keys lat, lon, date, days, tz, method, asr and high_lats.\n"
+          "    timezone is in hours or a zone name; empty or missing fields take the options above.\n"
+          "    Every day is written as one line of the same format, tagged with its input line.\n"
+          "    Malformed lines are reported and skipped, making the exit status 1.\n"
+          "\n"
+          " Timetable files\n"
+          "    --export computes the location given by --latitude and --longitude, or\n"
+          "    every 'latitude,longitude[,timezone]' line of stdin when they are missing.\n"
+          "    --inspect writes the settings to stderr and every day as CSV to stdout.\n"
+          "    --timetable takes the locations the same way and writes --days days of each\n"
+          "    as text, computed and formatted on --threads threads.\n"
+          "\n"
+          " Query server\n"
+          "    --serve answers batch records sent as lines, CSV or JSON, with the lines batch\n"
+          "    mode would write, or binary queries (see src/server.hpp), using --threads workers.\n"
+          "    TCP listens on 127.0.0.1 unless a host is given. SIGINT and SIGTERM stop it.\n"
+          "\n"
+          " Daemon mode\n"
+          "    --daemon announces the location given by --latitude and --longitude, or every\n"
+          "    'latitude,longitude[,timezone]' line of stdin, as 'local time,location,prayer'\n"
+          "    lines on stdout. Times follow --zone, else the timezone of the locations, else\n"
+          "    the system zone.\n"
+          "    SIGUSR1 prints the wake-up jitter to stderr, SIGINT and SIGTERM stop it.\n"
+          "\n"
+          " Instrumentation\n"
+          "    --stats and --trace need a build configured with -DPRAYERTIMES_INSTRUMENTATION=ON.\n"
+          "    Traces open in chrome://tracing or Perfetto.\n"
           , stderr);
 
 }
 
+// Reports the instrumentation of the run when main returns.
+class StatsReport
+{
+public:
+    StatsReport()
+        : show_stats(false)
+        , trace_path(NULL)
+    {
+    }
+
+    ~StatsReport()
+    {
+        if (trace_path && Instrumentation::enabled() && !Instrumentation::write_trace(trace_path))
+            fprintf(stderr, "Error: Failed to write trace '%s'\n", trace_path);
+        if (show_stats && Instrumentation::enabled())
+            print(stderr);
+    }
+
+    void start(bool stats, const char* trace)
+    {
+        show_stats = stats;
+        trace_path = trace;
+        if ((show_stats || trace_path) && !Instrumentation::enabled())
+            fputs("Warning: instrumentation is not compiled in, configure with -DPRAYERTIMES_INSTRUMENTATION=ON\n", stderr);
+        if (trace_path)
+            Instrumentation::start_trace();
+    }
+
+private:
+    static void print(FILE* f)
+    {
+        CalcStats stats = Instrumentation::stats();
+        fputs("\n", f);
+        for (int i = 0; i < CalcCounterCount; ++i)
+            fprintf(f, "%-18s: %llu\n", Instrumentation::counter_name((CalcCounter) i),
+                    (unsigned long long) stats.counters[i]);
+        if (stats.counters[DaysComputed])
+            fprintf(f, "%-18s: %.2lf\n", "sun positions/day",
+                    (double) stats.counters[SunPositions] / stats.counters[DaysComputed]);
+        fprintf(f, "\n%-22s %12s %16s %12s\n", "stage", "calls", "cycles", "cycles/call");
+        for (int i = 0; i < CalcStageCount; ++i)
+            fprintf(f, "%-22s %12llu %16llu %12.0lf\n", Instrumentation::stage_name((CalcStage) i),
+                    (unsigned long long) stats.calls[i], (unsigned long long) stats.cycles[i],
+                    stats.calls[i] ? (double) stats.cycles[i] / stats.calls[i] : 0.0);
+    }
+
+    bool show_stats;
+    const char* trace_path;
+};
+
+/* days since 1970-01-01 of the calendar day of an instant in a zone, rounded down
+   so that instants before 1970 stay on their own day */
+static int64_t zone_day(const TimeZone& zone, time_t date)
+{
+    int64_t local = date + zone.utc_offset(date);
+    return local / (60 * 60 * 24) - (local % (60 * 60 * 24) < 0);
+}
+
+/* the location of the options, or the 'latitude,longitude[,timezone]' lines of stdin
+   when they are missing; false after reporting a malformed line */
+static bool read_locations(double latitude, double longitude, double timezone, const TimeZone* zone,
+                           std::vector<Location>& locations)
+{
+    if (!std::isnan(latitude) && !std::isnan(longitude))
+    {
+        Location location = { latitude, longitude, timezone };
+        locations.push_back(location);
+    }
+    else
+    {
+        char line[256];
+        for (int line_number = 1; fgets(line, sizeof(line), stdin); ++line_number)
+        {
+            Location location = { NAN, NAN, timezone };
+            if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+                continue;
+            if (sscanf(line, "%lf,%lf,%lf", &location.latitude, &location.longitude, &location.timezone) < 2
+                || fabs(location.latitude) > 90 || fabs(location.longitude) > 180)
+            {
+                fprintf(stderr, "Error: line %d: expected latitude,longitude[,timezone]\n", line_number);
+                return false;
+            }
+            if (std::isnan(location.timezone) && !zone)
+            {
+                fprintf(stderr, "Error: line %d: no timezone\n", line_number);
+                return false;
+            }
+            locations.push_back(location);
+        }
+    }
+    return true;
+}
+
+/* write a timetable file for one location or the locations on stdin */
+static int export_timetable(const char* path, const PrayerTimes& prayer_times, double latitude, double longitude,
+                            double timezone, const TimeZone* zone, int year, int month, int day, int num_days, unsigned threads)
+{
+    std::vector<Location> locations;
+    if (!read_locations(latitude, longitude, timezone, zone, locations))
+        return 2;
+
+    if (!TimetableFile::write(path, prayer_times.config(), locations.empty() ? NULL : &locations[0], locations.size(),
+                              year, month, day, num_days, zone, threads))
+    {
+        fprintf(stderr, "Error: Failed to write '%s'\n", path);
+        return 1;
+    }
+    fprintf(stderr, "%zu locations, %d days from %04d-%02d-%02d written to %s\n", locations.size(), num_days, year, month, day, path);
+    return 0;
+}
+
+/* write text timetables for one location or the locations on stdin, to stdout or one file each in directory */
+static int write_timetables(TimetableExporter::Format format, const char* directory, const PrayerTimes& prayer_times,
+                            double latitude, double longitude, double timezone, const TimeZone* zone,
+                            int year, int month, int day, int num_days, unsigned threads)
+{
+    std::vector<Location> locations;
+    if (!read_locations(latitude, longitude, timezone, zone, locations))
+        return 2;
+
+    TimetableExporter exporter(prayer_times.config(), format, threads);
+    const Location* first = locations.empty() ? NULL : &locations[0];
+    bool ok = directory ? exporter.write_files(directory, first, locations.size(), year, month, day, num_days, zone)
+                        : exporter.write(STDOUT_FILENO, first, locations.size(), year, month, day, num_days, zone);
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Failed to write timetables to %s (%m)\n", directory ? directory : "stdout");
+        return 1;
+    }
+    const TimetableExporter::Stats& stats = exporter.stats();
+    fprintf(stderr, "%llu locations, %d days from %04d-%02d-%02d: %.1lf MiB in %.3lf s (%.0lf MiB/s)\n",
+            (unsigned long long) stats.locations, num_days, year, month, day, stats.bytes / 1048576.0, stats.seconds,
+            stats.seconds > 0 ? stats.bytes / 1048576.0 / stats.seconds : 0.0);
+    return 0;
+}
+
+/* announce the prayers of one location or the locations on stdin until stopped */
+static int run_daemon(const PrayerTimes& prayer_times, double latitude, double longitude, double timezone, const TimeZone* zone)
+{
+    // locations without an offset follow the DST changes of the process zone
+    const TimeZone* local = zone || !std::isnan(timezone) ? NULL : TimeZoneDb::system().local();
+    if (!zone && !local && std::isnan(timezone))
+        timezone = PrayerTimes::get_effective_timezone(time(NULL));
+
+    std::vector<Location> locations;
+    if (!read_locations(latitude, longitude, timezone, zone ? zone : local, locations))
+        return 2;
+    if (locations.empty())
+    {
+        fprintf(stderr, "Error: No locations\n");
+        return 2;
+    }
+    // --zone takes over every location, else the process zone only those without a timezone
+    std::size_t zoned = 0;
+    for (std::size_t i = 0; i < locations.size(); ++i)
+    {
+        if (zone)
+            locations[i].timezone = NAN;
+        zoned += std::isnan(locations[i].timezone);
+    }
+    if (!zone)
+        zone = local;
+
+    if (zoned == 0)
+        fprintf(stderr, "%zu locations, times in their timezone\n", locations.size());
+    else if (zoned == locations.size())
+        fprintf(stderr, "%zu locations, times in %s\n", locations.size(), zone->name().c_str());
+    else
+        fprintf(stderr, "%zu locations, times in their timezone, else in %s\n", locations.size(), zone->name().c_str());
+    PrayerDaemon daemon(prayer_times.config(), locations, zone, STDOUT_FILENO);
+    return daemon.run() ? 0 : 1;
+}
+
+/* print the settings of a timetable file to stderr and its days as CSV to stdout */
+static int inspect_timetable(const char* path)
+{
+    TimetableFile file;
+    if (!file.open(path))
+    {
+        fprintf(stderr, "Error: Failed to read '%s' as a timetable\n", path);
+        return 1;
+    }
+
+    CalcConfig config = file.config();
+    int year, month, day;
+    file.date(0, year, month, day);
+    fprintf(stderr, "file          : %s, %zu bytes\n", path, file.file_size());
+    fprintf(stderr, "locations     : %zu\n", file.num_locations());
+    fprintf(stderr, "days          : %d from %04d-%02d-%02d\n", file.num_days(), year, month, day);
+    fprintf(stderr, "zone          : %s\n", file.zone_name().empty() ? "(fixed offsets)" : file.zone_name().c_str());
+    fprintf(stderr, "fajr angle    : %.2lf\n", config.method.fajr_angle);
+    fprintf(stderr, "maghrib       : %.2lf %s\n", config.method.maghrib_value, config.method.maghrib_is_minutes ? "minutes" : "degrees");
+    fprintf(stderr, "isha          : %.2lf %s\n", config.method.isha_value, config.method.isha_is_minutes ? "minutes" : "degrees");
+    fprintf(stderr, "dhuhr minutes : %.2lf\n", config.dhuhr_minutes);
+    fprintf(stderr, "asr juristic  : %d\n", (int) config.asr_juristic);
+    fprintf(stderr, "high lats     : %d\n", (int) config.adjust_high_lats);
+    fprintf(stderr, "ephemeris     : %d\n", (int) config.ephemeris);
+    fprintf(stderr, "precision     : %d\n", (int) config.precision);
+
+    static char buffer[1 << 16];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+    puts("location,latitude,longitude,date,fajr,sunrise,dhuhr,asr,sunset,maghrib,isha");
+    for (std::size_t i = 0; i < file.num_locations(); ++i)
+    {
+        char row[256];
+        int prefix = snprintf(row, sizeof(row), "%zu,%.5lf,%.5lf,", i, file.location(i).latitude, file.location(i).longitude);
+        for (int d = 0; d < file.num_days(); ++d)
+        {
+            double times[Parameters::TimesCount];
+            file.day_times(i, d, times);
+            file.date(d, year, month, day);
+            char* p = TimeFormat::date(year, month, day, row + prefix);
+            for (int k = 0; k < Parameters::TimesCount; ++k)
+            {
+                *p++ = ',';
+                p = TimeFormat::time24(times[k], p);
+            }
+            *p++ = '\n';
+            fwrite(row, 1, p - row, stdout);
+        }
+    }
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
 int main(int argc, char* argv[])
 {
     PrayerTimes prayer_times;
@@ -76,6 +361,20 @@ int main(int argc, char* argv[])
     double longitude = NAN;		// 51.4358
     time_t date = time(NULL);
     double timezone = NAN;
+    const TimeZone* zone = NULL;
+    int batch_format = -1;
+    unsigned threads = 0;
+    const char* export_path = NULL;
+    const char* inspect_path = NULL;
+    int num_days = 365;
+    bool show_stats = false;
+    bool daemon_mode = false;
+    const char* serve_address = NULL;
+    std::size_t cache_entries = 0;
+    const char* trace_path = NULL;
+    int timetable_format = -1;
+    const char* output_dir = NULL;
+    StatsReport report;		// declared before the runners so that their threads are done when it reports
 
     // Parse options
     for (;;)
@@ -91,32 +390,57 @@ int main(int argc, char* argv[])
             { "calc-method",         required_argument, NULL, 'c' },
             { "asr-juristic-method", required_argument, NULL, 'a' },
             { "high-lats-method",    required_argument, NULL, 'i' },
+            { "zone",                required_argument, NULL, 'Z' },
+            { "batch",               required_argument, NULL, 'b' },
+            { "threads",             required_argument, NULL, 'j' },
             { "dhuhr-minutes",       required_argument, NULL, 0   },
             { "maghrib-minutes",     required_argument, NULL, 0   },
             { "isha-minutes",        required_argument, NULL, 0   },
             { "fajr-angle",          required_argument, NULL, 0   },
             { "maghrib-angle",       required_argument, NULL, 0   },
             { "isha-angle",          required_argument, NULL, 0   },
+            { "export",              required_argument, NULL, 0   },
+            { "inspect",             required_argument, NULL, 0   },
+            { "days",                required_argument, NULL, 0   },
+            { "precision",           required_argument, NULL, 0   },
+            { "stats",               no_argument,       NULL, 0   },
+            { "daemon",              no_argument,       NULL, 0   },
+            { "trace",               required_argument, NULL, 0   },
+            { "serve",               required_argument, NULL, 0   },
+            { "cache",               required_argument, NULL, 0   },
+            { "timetable",           required_argument, NULL, 0   },
+            { "output-dir",          required_argument, NULL, 0   },
             { 0, 0, 0, 0 }
         };
 
         enum	// long options missing a short form
         {
-            DHUHR_MINUTES = 9,
+            DHUHR_MINUTES = 12,
             MAGHRIB_MINUTES,
             ISHA_MINUTES,
             FAJR_ANGLE,
             MAGHRIB_ANGLE,
             ISHA_ANGLE,
+            EXPORT,
+            INSPECT,
+            DAYS,
+            PRECISION,
+            STATS,
+            DAEMON,
+            TRACE,
+            SERVE,
+            CACHE,
+            TIMETABLE,
+            OUTPUT_DIR,
         };
 
         int option_index = 0;
-        int c = getopt_long(argc, argv, "hvd:z:l:n:c:a:i:", long_options, &option_index);
+        int c = getopt_long(argc, argv, "hvd:z:Z:b:j:l:n:c:a:i:", long_options, &option_index);
 
         if (c == -1)
             break;		// Last option
 
-        if (!optarg && c != 'h' && c != 'v')
+        if (!optarg && c != 'h' && c != 'v' && !(c == 0 && (option_index == STATS || option_index == DAEMON)))
         {
             fprintf(stderr, "Error: %s option requires an argument\n", long_options[option_index].name);
             return 2;
@@ -125,6 +449,67 @@ int main(int argc, char* argv[])
         switch (c)
         {
             case 0:
+                if (option_index == EXPORT)
+                {
+                    export_path = optarg;
+                    break;
+                }
+                if (option_index == INSPECT)
+                {
+                    inspect_path = optarg;
+                    break;
+                }
+                if (option_index == STATS)
+                {
+                    show_stats = true;
+                    break;
+                }
+                if (option_index == DAEMON)
+                {
+                    daemon_mode = true;
+                    break;
+                }
+                if (option_index == SERVE)
+                {
+                    serve_address = optarg;
+                    break;
+                }
+                if (option_index == TIMETABLE)
+                {
+                    if (strcmp(optarg, "csv") == 0)
+                        timetable_format = TimetableExporter::Csv;
+                    else if (strcmp(optarg, "json") == 0)
+                        timetable_format = TimetableExporter::Json;
+                    else if (strcmp(optarg, "ical") == 0)
+                        timetable_format = TimetableExporter::ICal;
+                    else
+                    {
+                        fprintf(stderr, "Error: Unknown timetable format '%s'\n", optarg);
+                        return 2;
+                    }
+                    break;
+                }
+                if (option_index == OUTPUT_DIR)
+                {
+                    output_dir = optarg;
+                    break;
+                }
+                if (option_index == TRACE)
+                {
+                    trace_path = optarg;
+                    break;
+                }
+                if (option_index == PRECISION)
+                {
+                    Parameters::PrecisionTier tier;
+                    if (!parse_precision_tier(optarg, tier))
+                    {
+                        fprintf(stderr, "Error: Unknown precision '%s'\n", optarg);
+                        return 2;
+                    }
+                    prayer_times.set_precision(tier);
+                    break;
+                }
                 double arg;
                 if (sscanf(optarg, "%lf", &arg) != 1)
                 {
@@ -151,6 +536,22 @@ int main(int argc, char* argv[])
                     case ISHA_ANGLE:
                         prayer_times.set_isha_angle(arg);
                         break;
+                    case CACHE:
+                        if (arg < 0)
+                        {
+                            fprintf(stderr, "Error: Invalid cache size '%s'\n", optarg);
+                            return 2;
+                        }
+                        cache_entries = (std::size_t) arg;
+                        break;
+                    case DAYS:
+                        if (arg < 1 || arg > BatchRunner::MAX_DAYS)
+                        {
+                            fprintf(stderr, "Error: Invalid number of days '%s'\n", optarg);
+                            return 2;
+                        }
+                        num_days = (int) arg;
+                        break;
                     default:
                         fprintf(stderr, "Error: Invalid command line option\n");
                         return 2;
@@ -180,6 +581,14 @@ int main(int argc, char* argv[])
                     return 2;
                 }
                 break;
+            case 'Z':		// --zone
+                zone = TimeZoneDb::system().find(optarg);
+                if (!zone)
+                {
+                    fprintf(stderr, "Error: Unknown zone '%s'\n", optarg);
+                    return 2;
+                }
+                break;
             case 'l':		// --latitude
                 if (sscanf(optarg, "%lf", &latitude) != 1)
                 {
@@ -195,51 +604,55 @@ int main(int argc, char* argv[])
                 }
                 break;
             case 'c':		// --calc-method
-                if (strcmp(optarg, "jafari") == 0)
-                    prayer_times.set_calc_method(Parameters::Jafari);
-                else if (strcmp(optarg, "karachi") == 0)
-                    prayer_times.set_calc_method(Parameters::Karachi);
-                else if (strcmp(optarg, "isna") == 0)
-                    prayer_times.set_calc_method(Parameters::ISNA);
-                else if (strcmp(optarg, "mwl") == 0)
-                    prayer_times.set_calc_method(Parameters::MWL);
-                else if (strcmp(optarg, "makkah") == 0)
-                    prayer_times.set_calc_method(Parameters::Makkah);
-                else if (strcmp(optarg, "egypt") == 0)
-                    prayer_times.set_calc_method(Parameters::Egypt);
-                else if (strcmp(optarg, "custom") == 0)
-                    prayer_times.set_calc_method(Parameters::Custom);
-                else
+            {
+                Parameters::CalculationMethod method;
+                if (!parse_calc_method(optarg, method))
                 {
                     fprintf(stderr, "Error: Unknown method '%s'\n", optarg);
                     return 2;
                 }
+                prayer_times.set_calc_method(method);
                 break;
+            }
             case 'a':		// --asr-juristic-method
-                if (strcmp(optarg, "shafii") == 0)
-                    prayer_times.set_asr_method(Parameters::Shafii);
-                else if (strcmp(optarg, "hanafi") == 0)
-                    prayer_times.set_asr_method(Parameters::Hanafi);
-                else
+            {
+                Parameters::JuristicMethod method;
+                if (!parse_juristic_method(optarg, method))
                 {
                     fprintf(stderr, "Error: Unknown method '%s'\n", optarg);
                     return 2;
                 }
+                prayer_times.set_asr_method(method);
                 break;
+            }
             case 'i':		// --high-lats-method
-                if (strcmp(optarg, "none") == 0)
-                    prayer_times.set_high_lats_adjust_method(Parameters::None);
-                else if (strcmp(optarg, "midnight") == 0)
-                    prayer_times.set_high_lats_adjust_method(Parameters::MidNight);
-                else if (strcmp(optarg, "oneseventh") == 0)
-                    prayer_times.set_high_lats_adjust_method(Parameters::OneSeventh);
-                else if (strcmp(optarg, "anglebased") == 0)
-                    prayer_times.set_high_lats_adjust_method(Parameters::AngleBased);
-                else
+            {
+                Parameters::AdjustingMethod method;
+                if (!parse_adjusting_method(optarg, method))
                 {
                     fprintf(stderr, "Error: Unknown method '%s'\n", optarg);
                     return 2;
                 }
+                prayer_times.set_high_lats_adjust_method(method);
+                break;
+            }
+            case 'b':		// --batch
+                if (strcmp(optarg, "csv") == 0)
+                    batch_format = BatchRunner::Csv;
+                else if (strcmp(optarg, "ndjson") == 0)
+                    batch_format = BatchRunner::NdJson;
+                else
+                {
+                    fprintf(stderr, "Error: Unknown batch format '%s'\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'j':		// --threads
+                if (sscanf(optarg, "%u", &threads) != 1)
+                {
+                    fprintf(stderr, "Error: Invalid number of threads '%s'\n", optarg);
+                    return 2;
+                }
                 break;
             default:
                 fprintf(stderr, "Error: Unknown option '%c'\n", c);
@@ -248,6 +661,69 @@ int main(int argc, char* argv[])
         }
     }
 
+    report.start(show_stats, trace_path);
+
+    if (inspect_path)
+        return inspect_timetable(inspect_path);
+
+    if (export_path || timetable_format >= 0)
+    {
+        int year, month, day;
+        if (zone)
+            CivilCalendar::civil_from_days(zone_day(*zone, date), year, month, day);
+        else
+        {
+            tm t;
+            localtime_r(&date, &t);
+            year = 1900 + t.tm_year;
+            month = t.tm_mon + 1;
+            day = t.tm_mday;
+        }
+        if (std::isnan(timezone) && !zone)
+            timezone = PrayerTimes::get_effective_timezone(date);
+        if (timetable_format >= 0)
+            return write_timetables((TimetableExporter::Format) timetable_format, output_dir, prayer_times, latitude, longitude,
+                                    timezone, zone, year, month, day, num_days, threads);
+        return export_timetable(export_path, prayer_times, latitude, longitude, timezone, zone, year, month, day, num_days, threads);
+    }
+
+    if (daemon_mode)
+        return run_daemon(prayer_times, latitude, longitude, timezone, zone);
+
+    if (serve_address)
+    {
+        std::unique_ptr<ResultCache> cache(cache_entries ? new ResultCache(cache_entries) : NULL);
+        QueryServer server(prayer_times, timezone, zone, threads);
+        server.set_cache(cache.get());
+        if (!server.listen(serve_address))
+            return 1;
+        fprintf(stderr, "serving on %s\n", serve_address);
+        bool ok = server.run(true);
+        const QueryServer::Stats stats = server.stats();
+        fprintf(stderr, "%llu connections, %llu requests, %llu rejected\n", (unsigned long long) stats.connections,
+                (unsigned long long) stats.requests, (unsigned long long) stats.rejected);
+        if (cache)
+        {
+            const ResultCache::Stats cache_stats = cache->stats();
+            fprintf(stderr, "cache: %.1lf%% hits, %llu evictions, %zu of %zu entries, %zu KiB\n",
+                    100 * cache_stats.hit_rate(), (unsigned long long) cache_stats.evictions,
+                    cache_stats.entries, cache_stats.capacity, cache_stats.memory_bytes / 1024);
+        }
+        return ok ? 0 : 1;
+    }
+
+    if (batch_format >= 0)
+    {
+        BatchRunner runner(prayer_times, (BatchRunner::Format) batch_format, timezone, zone, threads);
+        bool ok = runner.run(STDIN_FILENO, STDOUT_FILENO);
+        const BatchRunner::Stats& stats = runner.stats();
+        fprintf(stderr, "%llu records, %llu days, %llu rejected in %.3lf s (%.0lf records/s)\n",
+                (unsigned long long) stats.records, (unsigned long long) stats.days,
+                (unsigned long long) stats.rejected, stats.seconds,
+                stats.seconds > 0 ? stats.records / stats.seconds : 0.0);
+        return ok && !stats.rejected ? 0 : 1;
+    }
+
     if (std::isnan(latitude) || std::isnan(longitude))
     {
         fprintf(stderr, "Error: You must provide both latitude and longitude\n");
@@ -257,15 +733,25 @@ int main(int argc, char* argv[])
     fputs(PROG_NAME_FRIENDLY " " PROG_VERSION "\n\n", stderr);
 
     if (std::isnan(timezone))
-        timezone = PrayerTimes::get_effective_timezone(date);
+        timezone = zone ? PrayerTimes::get_effective_timezone(*zone, date) : PrayerTimes::get_effective_timezone(date);
 
     double times[Parameters::TimesCount];
     fprintf(stderr, "date          : %s", ctime(&date));
+    if (zone)
+        fprintf(stderr, "zone          : %s\n", zone->name().c_str());
     fprintf(stderr, "timezone      : %.1lf\n", timezone);
     fprintf(stderr, "latitude      : %.5lf\n", latitude);
     fprintf(stderr, "longitude     : %.5lf\n", longitude);
     puts("");
-    prayer_times.get_prayer_times(date, latitude, longitude, timezone, times);
+    if (zone)
+    {
+        // the calendar day in the zone, not in the process time-zone
+        int year, month, day;
+        CivilCalendar::civil_from_days(zone_day(*zone, date), year, month, day);
+        prayer_times.get_prayer_times(year, month, day, latitude, longitude, timezone, times);
+    }
+    else
+        prayer_times.get_prayer_times(date, latitude, longitude, timezone, times);
     for (int i = 0; i < Parameters::TimesCount; ++i)
         printf("%8s : %s\n", TimeName[i], PrayerTimes::float_time_to_time24(times[i]).c_str());
     return 0;
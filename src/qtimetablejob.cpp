@@ -0,0 +1,165 @@
+﻿#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "qtimetablejob.hpp"
+#include "timezone.hpp"
+
+// Everything the tasks of a run read, kept alive by the tasks themselves so
+// that the job can be deleted while they run.
+struct QTimetableJob::Shared
+{
+    explicit Shared(const Calculator& calculator)
+        : calculator(calculator)
+        , job(NULL)
+    {
+    }
+
+    const Calculator calculator;
+    QVector<Location> locations;
+    int year, month, day;
+    QVector<double> zone_offsets;		// offset of every day, empty without a zone
+    QAtomicInt cancelled;
+    QMutex lock;		// guards job
+    QTimetableJob* job;		// NULL once the job is deleted
+};
+
+class QTimetableJob::Task : public QRunnable
+{
+public:
+    Task(const QSharedPointer<Shared>& shared, int location, int first_day, int days)
+        : shared(shared)
+        , location(location)
+        , first_day(first_day)
+        , days(days)
+    {
+    }
+
+    void run()
+    {
+        QTimetableChunk chunk;
+        chunk.location = location;
+        chunk.first_day = first_day;
+        const bool computed = !shared->cancelled.loadAcquire();
+        if (computed)
+            compute(chunk);
+
+        QMutexLocker locker(&shared->lock);
+        if (shared->job)
+            QMetaObject::invokeMethod(shared->job, "task_done", Qt::QueuedConnection,
+                                      Q_ARG(QTimetableChunk, chunk), Q_ARG(bool, computed));
+    }
+
+private:
+    void compute(QTimetableChunk& chunk) const
+    {
+        const Location& where = shared->locations[location];
+        const bool zoned = !shared->zone_offsets.isEmpty();
+        const double timezone = zoned ? shared->zone_offsets[first_day] : where.timezone;
+        Query query = Query::make(shared->year, shared->month, shared->day, where.latitude, where.longitude, timezone);
+        query.julian_date += first_day;
+
+        Timetable table(days);
+        shared->calculator.compute_range_times(query, table);
+        if (zoned)
+            table.shift_days(shared->zone_offsets.constData() + first_day, timezone);
+
+        chunk.days = days;
+        chunk.times_data.resize(days * Parameters::TimesCount);
+        double* out = chunk.times_data.data();
+        for (int p = 0; p < Parameters::TimesCount; ++p)
+            for (int d = 0; d < days; ++d)
+                *out++ = table.at(d, p);
+    }
+
+    const QSharedPointer<Shared> shared;
+    const int location;
+    const int first_day;
+    const int days;
+};
+
+QTimetableJob::QTimetableJob(const CalcConfig& config, QObject* parent)
+    : QObject(parent)
+    , calculator(config)
+    , pool(QThreadPool::globalInstance())
+    , chunk_size(DEFAULT_CHUNK_DAYS)
+    , running(false)
+    , cancelled(false)
+    , total(0)
+    , done(0)
+{
+    qRegisterMetaType<QTimetableChunk>();
+}
+
+QTimetableJob::~QTimetableJob()
+{
+    if (shared)
+    {
+        shared->cancelled.storeRelease(1);
+        QMutexLocker locker(&shared->lock);
+        shared->job = NULL;
+    }
+}
+
+void QTimetableJob::set_chunk_days(int days)
+{
+    chunk_size = qMax(1, days);
+}
+
+void QTimetableJob::set_thread_pool(QThreadPool* thread_pool)
+{
+    pool = thread_pool;
+}
+
+bool QTimetableJob::start(const QVector<Location>& locations, int year, int month, int day, int num_days,
+                          const TimeZone* zone)
+{
+    if (running || locations.isEmpty() || num_days < 1)
+        return false;
+
+    shared = QSharedPointer<Shared>::create(calculator);
+    shared->locations = locations;
+    shared->year = year;
+    shared->month = month;
+    shared->day = day;
+    shared->job = this;
+    if (zone)
+    {
+        shared->zone_offsets.resize(num_days);
+        zone->day_offsets(year, month, day, num_days, shared->zone_offsets.data());
+    }
+
+    const int chunks_per_location = (num_days + chunk_size - 1) / chunk_size;
+    running = true;
+    cancelled = false;
+    total = locations.size() * chunks_per_location;
+    done = 0;
+    for (int l = 0; l < locations.size(); ++l)
+        for (int first_day = 0; first_day < num_days; first_day += chunk_size)
+            pool->start(new Task(shared, l, first_day, qMin(chunk_size, num_days - first_day)));
+    return true;
+}
+
+void QTimetableJob::cancel()
+{
+    if (!running || cancelled)
+        return;
+    cancelled = true;
+    shared->cancelled.storeRelease(1);
+}
+
+void QTimetableJob::task_done(const QTimetableChunk& chunk, bool computed)
+{
+    ++done;
+    if (computed && !cancelled)
+        emit chunk_ready(chunk);
+    emit progress(done, total);
+    if (done < total)
+        return;
+
+    running = false;
+    shared.clear();
+    emit finished(cancelled);
+}
@@ -0,0 +1,197 @@
+﻿#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#include "resultcache.hpp"
+#include "timezone.hpp"
+
+struct alignas(64) ResultCache::Shard
+{
+    mutable std::shared_mutex lock;
+    std::unique_ptr<Set[]> sets;
+    std::size_t entries;		// guarded by the exclusive lock
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+};
+
+namespace {
+
+inline uint64_t mix(uint64_t h)
+{
+    // splitmix64 finalizer
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+inline uint64_t mix(uint64_t h, uint64_t value)
+{
+    return mix(h ^ (value + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+inline uint64_t bits(double value)
+{
+    uint64_t b;
+    memcpy(&b, &value, sizeof(b));
+    return b;
+}
+
+std::size_t round_up_pow2(std::size_t n)
+{
+    std::size_t p = 1;
+    while (p < n)
+        p *= 2;
+    return p;
+}
+
+}
+
+ResultCache::ResultCache(std::size_t capacity, double quantum, unsigned shards_count)
+    : quantum(quantum)
+    , num_shards((unsigned) round_up_pow2(shards_count ? shards_count : 1))
+    , sets_per_shard(round_up_pow2((capacity + WAYS * num_shards - 1) / (WAYS * num_shards)))
+    , shards(new Shard[num_shards])
+{
+    for (unsigned s = 0; s < num_shards; ++s)
+        shards[s].sets.reset(new Set[sets_per_shard]);
+    clear();
+}
+
+ResultCache::~ResultCache()
+{
+}
+
+ResultCache::Shard& ResultCache::shard_of(uint64_t hash) const
+{
+    return shards[hash & (num_shards - 1)];
+}
+
+ResultCache::Set& ResultCache::set_of(Shard& shard, uint64_t hash) const
+{
+    return shard.sets[(hash >> 32) & (sets_per_shard - 1)];
+}
+
+void ResultCache::day_times(const Calculator& calculator, int year, int month, int day,
+                            double latitude, double longitude, double timezone, double times[])
+{
+    Key key;
+    key.settings = settings_hash(calculator.config());
+    key.latitude = (int32_t) llround(latitude / quantum);
+    key.longitude = (int32_t) llround(longitude / quantum);
+    key.day = (int32_t) CivilCalendar::days_from_civil(year, month, day);
+    key.timezone = (int32_t) llround(timezone * 60);
+    const uint64_t hash = mix(mix(mix(mix(key.settings, (uint32_t) key.latitude), (uint32_t) key.longitude),
+                                  (uint32_t) key.day), (uint32_t) key.timezone);
+    Shard& shard = shard_of(hash);
+    Set& set = set_of(shard, hash);
+
+    {
+        std::shared_lock<std::shared_mutex> reader(shard.lock);
+        for (int w = 0; w < WAYS; ++w)
+        {
+            Entry& entry = set.ways[w];
+            if (entry.used && entry.key == key)
+            {
+                memcpy(times, entry.times, sizeof(entry.times));
+                if (!entry.referenced.load(std::memory_order_relaxed))		// keep the line shared when already set
+                    entry.referenced.store(1, std::memory_order_relaxed);
+                shard.hits.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    calculator.compute_day_times(Query::make(year, month, day, latitude, longitude, timezone), times);
+
+    std::unique_lock<std::shared_mutex> writer(shard.lock);
+    Entry* victim = NULL;
+    for (int w = 0; w < WAYS && !victim; ++w)
+    {
+        Entry& entry = set.ways[w];
+        if (entry.used && entry.key == key)
+            return;		// stored by another thread meanwhile
+        if (!entry.used)
+            victim = &entry;
+    }
+    if (victim)
+        ++shard.entries;
+    else
+    {
+        // second chance: clear referenced bits until an unreferenced entry comes up
+        for (;;)
+        {
+            Entry& entry = set.ways[set.hand];
+            set.hand = (set.hand + 1) % WAYS;
+            if (!entry.referenced.load(std::memory_order_relaxed))
+            {
+                victim = &entry;
+                break;
+            }
+            entry.referenced.store(0, std::memory_order_relaxed);
+        }
+        shard.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    victim->key = key;
+    victim->used = true;
+    victim->referenced.store(0, std::memory_order_relaxed);
+    memcpy(victim->times, times, sizeof(victim->times));
+}
+
+void ResultCache::clear()
+{
+    for (unsigned s = 0; s < num_shards; ++s)
+    {
+        Shard& shard = shards[s];
+        std::unique_lock<std::shared_mutex> writer(shard.lock);
+        for (std::size_t i = 0; i < sets_per_shard; ++i)
+        {
+            Set& set = shard.sets[i];
+            for (int w = 0; w < WAYS; ++w)
+            {
+                set.ways[w].used = false;
+                set.ways[w].referenced.store(0, std::memory_order_relaxed);
+            }
+            set.hand = 0;
+        }
+        shard.entries = 0;
+        shard.hits.store(0, std::memory_order_relaxed);
+        shard.misses.store(0, std::memory_order_relaxed);
+        shard.evictions.store(0, std::memory_order_relaxed);
+    }
+}
+
+ResultCache::Stats ResultCache::stats() const
+{
+    Stats stats;
+    memset(&stats, 0, sizeof(stats));
+    for (unsigned s = 0; s < num_shards; ++s)
+    {
+        const Shard& shard = shards[s];
+        stats.hits += shard.hits.load(std::memory_order_relaxed);
+        stats.misses += shard.misses.load(std::memory_order_relaxed);
+        stats.evictions += shard.evictions.load(std::memory_order_relaxed);
+        std::shared_lock<std::shared_mutex> reader(shard.lock);
+        stats.entries += shard.entries;
+    }
+    stats.capacity = num_shards * sets_per_shard * WAYS;
+    stats.memory_bytes = sizeof(*this) + num_shards * (sizeof(Shard) + sets_per_shard * sizeof(Set));
+    return stats;
+}
+
+uint64_t ResultCache::settings_hash(const CalcConfig& config)
+{
+    uint64_t h = mix(bits(config.method.fajr_angle));
+    h = mix(h, config.method.maghrib_is_minutes);
+    h = mix(h, bits(config.method.maghrib_value));
+    h = mix(h, config.method.isha_is_minutes);
+    h = mix(h, bits(config.method.isha_value));
+    h = mix(h, config.asr_juristic);
+    h = mix(h, config.adjust_high_lats);
+    h = mix(h, bits(config.dhuhr_minutes));
+    h = mix(h, config.ephemeris);
+    return mix(h, config.precision);
+}
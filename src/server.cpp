@@ -0,0 +1,526 @@
+﻿#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hpp"
+#include "timezone.hpp"
+#include "resultcache.hpp"
+
+struct QueryServer::Connection
+{
+    enum Mode { Unknown, Text, Binary };
+
+    explicit Connection(int fd)
+        : fd(fd)
+        , mode(Unknown)
+        , in_used(0)
+        , out_sent(0)
+        , lines(0)
+        , days_done(0)
+        , blocked(false)
+        , eof(false)
+    {
+        memset(&record, 0, sizeof(record));
+    }
+
+    int fd;
+    Mode mode;
+    std::vector<char> in;
+    std::size_t in_used;
+    std::string out;
+    std::size_t out_sent;
+    uint64_t lines;		// text requests so far, numbering the answers
+    RecordParser::Record record;		// text request being answered, parsed but not prepared
+    RecordParser::Format record_format;
+    int days_done;		// days of record answered, record.days once it is complete
+    bool blocked;		// answering stopped at MAX_PENDING with requests left in the input
+    bool eof;		// peer done sending, close once the output is sent
+};
+
+namespace {
+
+const int MAX_EVENTS = 64;
+
+bool add_fd(int epoll_fd, int fd, uint32_t events, void* ptr, int op = EPOLL_CTL_ADD)
+{
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = ptr;
+    return epoll_ctl(epoll_fd, op, fd, &event) == 0;
+}
+
+}
+
+QueryServer::QueryServer(const PrayerTimes& defaults, double timezone, const TimeZone* zone, unsigned threads)
+    : defaults(defaults)
+    , default_timezone(timezone)
+    , default_zone(zone)
+    , num_threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+    , cache(NULL)
+    , listen_fd(-1)
+    , epoll_fd(epoll_create1(EPOLL_CLOEXEC))
+    , stop_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    , signal_fd(-1)
+    , num_connections(0)
+    , num_requests(0)
+    , num_rejected(0)
+{
+}
+
+QueryServer::~QueryServer()
+{
+    while (!connections.empty())
+        close_connection(*connections.begin());
+    if (listen_fd >= 0)
+        close(listen_fd);
+    if (!socket_path.empty())
+        unlink(socket_path.c_str());
+    if (signal_fd >= 0)
+        close(signal_fd);
+    if (stop_fd >= 0)
+        close(stop_fd);
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+}
+
+bool QueryServer::listen(const std::string& address)
+{
+    if (address.find('/') != std::string::npos)
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Error: Socket path '%s' is too long\n", address.c_str());
+            return false;
+        }
+        strcpy(addr.sun_path, address.c_str());
+        // replace the socket a previous server left behind, nothing else
+        struct stat st;
+        if (stat(address.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(address.c_str());
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0 || bind(listen_fd, (sockaddr*) &addr, sizeof(addr)) != 0)
+        {
+            fprintf(stderr, "Error: Cannot listen on '%s' (%m)\n", address.c_str());
+            return false;
+        }
+        socket_path = address;
+    }
+    else
+    {
+        std::string host = "127.0.0.1";
+        std::string port = address;
+        std::size_t colon = address.rfind(':');
+        if (colon != std::string::npos)
+        {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+        }
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        char* end;
+        long number = strtol(port.c_str(), &end, 10);
+        if (port.empty() || *end || number < 0 || number > 65535 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        {
+            fprintf(stderr, "Error: Invalid address '%s', expected a socket path or [host:]port\n", address.c_str());
+            return false;
+        }
+        addr.sin_port = htons((uint16_t) number);
+
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int on = 1;
+        if (listen_fd < 0 || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+            || bind(listen_fd, (sockaddr*) &addr, sizeof(addr)) != 0)
+        {
+            fprintf(stderr, "Error: Cannot listen on '%s' (%m)\n", address.c_str());
+            return false;
+        }
+    }
+
+    if (::listen(listen_fd, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Error: Cannot listen on '%s' (%m)\n", address.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool QueryServer::run(bool stop_on_signals)
+{
+    if (epoll_fd < 0 || stop_fd < 0 || listen_fd < 0)
+    {
+        fprintf(stderr, "Error: Server not listening\n");
+        return false;
+    }
+
+    if (stop_on_signals)
+    {
+        // blocked before the workers start, so that they inherit the mask
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        if (sigprocmask(SIG_BLOCK, &signals, NULL) != 0
+            || (signal_fd = signalfd(-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK)) < 0
+            || !add_fd(epoll_fd, signal_fd, EPOLLIN, &signal_fd))
+        {
+            perror("Error: signalfd");
+            return false;
+        }
+    }
+    // stop_fd is level-triggered and never read, so that it wakes every worker
+    if (!add_fd(epoll_fd, stop_fd, EPOLLIN, &stop_fd)
+        || !add_fd(epoll_fd, listen_fd, EPOLLIN | EPOLLET | EPOLLONESHOT, NULL))
+    {
+        perror("Error: epoll_ctl");
+        return false;
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < num_threads; ++i)
+        workers.push_back(std::thread(&QueryServer::work, this));
+    work();
+    for (std::size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    return true;
+}
+
+void QueryServer::stop()
+{
+    uint64_t one = 1;
+    if (write(stop_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("Error: write");
+}
+
+QueryServer::Stats QueryServer::stats() const
+{
+    Stats stats;
+    stats.connections = num_connections.load(std::memory_order_relaxed);
+    stats.requests = num_requests.load(std::memory_order_relaxed);
+    stats.rejected = num_rejected.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void QueryServer::work()
+{
+    RecordParser parser(defaults, default_timezone, default_zone);
+    Timetable table;
+    epoll_event events[MAX_EVENTS];
+    for (;;)
+    {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Error: epoll_wait");
+            stop();
+            return;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &stop_fd)
+                return;
+            if (ptr == &signal_fd)
+                stop();
+            else if (ptr == NULL)
+                accept_connections();
+            else
+                handle((Connection*) ptr, parser, table);
+        }
+    }
+}
+
+void QueryServer::accept_connections()
+{
+    for (;;)
+    {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("Error: accept");		// out of descriptors: retried on the next connection
+            break;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));		// fails harmlessly on Unix sockets
+
+        Connection* connection = new Connection(fd);
+        {
+            std::lock_guard<std::mutex> guard(connections_lock);
+            connections.insert(connection);
+        }
+        num_connections.fetch_add(1, std::memory_order_relaxed);
+        if (!add_fd(epoll_fd, fd, EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT, connection))
+            close_connection(connection);
+    }
+    add_fd(epoll_fd, listen_fd, EPOLLIN | EPOLLET | EPOLLONESHOT, NULL, EPOLL_CTL_MOD);
+}
+
+void QueryServer::handle(Connection* connection, RecordParser& parser, Timetable& table)
+{
+    bool ok = true;
+    for (;;)
+    {
+        // answer what is buffered before reading more; answering stops at
+        // MAX_PENDING, leaving the rest for when the output has drained
+        if (connection->mode == Connection::Text)
+            ok = answer_text(connection, parser, table);
+        else if (connection->mode == Connection::Binary)
+            ok = answer_binary(connection, parser);
+        // keep reading while the output is sent, a slow reader only holding up its own connection
+        ok = ok && write_pending(connection);
+        if (!ok || connection->out.size() - connection->out_sent >= MAX_PENDING)
+            break;
+        if (connection->blocked)
+            continue;		// sent enough to answer more of the input
+        if (connection->eof)
+            break;
+
+        if (connection->in.size() - connection->in_used < READ_SIZE)
+            connection->in.resize(connection->in_used + READ_SIZE);
+        ssize_t n = read(connection->fd, &connection->in[connection->in_used], READ_SIZE);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ok = errno == EAGAIN || errno == EWOULDBLOCK;
+            break;
+        }
+        connection->eof = n == 0;
+        connection->in_used += n;
+
+        if (connection->mode == Connection::Unknown && connection->in_used > 0)
+        {
+            const uint32_t magic = QUERY_MAGIC;
+            std::size_t compared = std::min(connection->in_used, sizeof(magic));
+            if (memcmp(&connection->in[0], &magic, compared) != 0)
+                connection->mode = Connection::Text;
+            else if (compared == sizeof(magic))
+                connection->mode = Connection::Binary;
+        }
+    }
+
+    const bool pending = connection->out_sent < connection->out.size();
+    if (!ok || (connection->eof && !pending && !connection->blocked))
+    {
+        close_connection(connection);
+        return;
+    }
+    // no more input while the output is full, EPOLLOUT resumes answering
+    const bool reading = !connection->eof && connection->out.size() - connection->out_sent < MAX_PENDING;
+    uint32_t events = EPOLLRDHUP | EPOLLET | EPOLLONESHOT | (reading ? (uint32_t) EPOLLIN : 0u) | (pending ? (uint32_t) EPOLLOUT : 0u);
+    if (!add_fd(epoll_fd, connection->fd, events, connection, EPOLL_CTL_MOD))
+        close_connection(connection);
+}
+
+bool QueryServer::answer_text(Connection* connection, RecordParser& parser, Timetable& table)
+{
+    char* begin = connection->in.data();
+    char* end = begin + connection->in_used;
+    connection->blocked = false;
+    for (;;)
+    {
+        if (connection->out.size() - connection->out_sent >= MAX_PENDING)
+        {
+            connection->blocked = connection->days_done < connection->record.days || begin < end;
+            break;
+        }
+        if (connection->days_done < connection->record.days)
+        {
+            answer_days(connection, parser, table);
+            continue;
+        }
+
+        char* newline = (char*) memchr(begin, '\n', end - begin);
+        if (!newline)
+        {
+            if (end - begin > (std::ptrdiff_t) MAX_LINE)
+                return false;
+            if (!connection->eof || begin == end)
+                break;
+            newline = end;		// last line without a newline
+        }
+        *newline = '\0';
+        const uint64_t line_number = ++connection->lines;
+
+        char* line = begin;
+        while (*line == ' ' || *line == '\t' || *line == '\r')
+            ++line;
+        begin = newline + (newline < end);
+        if (!*line || *line == '#')
+            continue;
+
+        const RecordParser::Format format = *line == '{' ? RecordParser::NdJson : RecordParser::Csv;
+        RecordParser::Record record;
+        const char* error = NULL;
+        if (!parser.parse(format, line, record, error))
+        {
+            char answer[RecordParser::MAX_ROW_SIZE];
+            int n = format == RecordParser::Csv
+                ? snprintf(answer, sizeof(answer), "%llu,error: %s\n", (unsigned long long) line_number, error)
+                : snprintf(answer, sizeof(answer), "{\"line\":%llu,\"error\":\"%s\"}\n", (unsigned long long) line_number, error);
+            connection->out.append(answer, n);
+            num_rejected.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        record.line_number = line_number;
+        connection->record = record;
+        connection->record_format = format;
+        connection->days_done = 0;
+        num_requests.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    connection->in_used = end - begin;
+    memmove(connection->in.data(), begin, connection->in_used);
+    return true;
+}
+
+void QueryServer::answer_days(Connection* connection, RecordParser& parser, Timetable& table)
+{
+    // the next slice of the record, as a record of its own computed in the first time-zone
+    RecordParser::Record record = connection->record;
+    parser.prepare(record, connection->record.line_number);
+    if (connection->days_done > 0)
+        CivilCalendar::civil_from_days(CivilCalendar::days_from_civil(record.year, record.month, record.day) + connection->days_done,
+                                       record.year, record.month, record.day);
+    record.days = std::min((int) SLICE_DAYS, connection->record.days - connection->days_done);
+
+    table.resize(record.days);
+    Query query = Query::make(record.year, record.month, record.day, record.latitude, record.longitude, record.first_timezone);
+    if (record.days == 1 && cache)
+        cache->day_times(*record.calculator, record.year, record.month, record.day, record.latitude,
+                         record.longitude, record.first_timezone, &table.data[0]);
+    else if (record.days == 1)
+        record.calculator->compute_day_times(query, &table.data[0]);		// one day is laid out like a times array
+    else
+        record.calculator->compute_range_times(query, table);
+    if (connection->record.days > 1)
+        parser.shift_days(record, table);
+
+    std::size_t used = connection->out.size();
+    connection->out.resize(used + record.days * RecordParser::MAX_ROW_SIZE);
+    char* p = &connection->out[used];
+    for (int d = 0; d < record.days; ++d)
+    {
+        int year, month, day;
+        double times[Parameters::TimesCount];
+        parser.day_times(record, table, d, year, month, day, times);
+        p = RecordParser::format_day(connection->record_format, record.line_number, year, month, day, times, p);
+        *p++ = '\n';
+    }
+    connection->out.resize(p - connection->out.data());
+    connection->days_done += record.days;
+}
+
+bool QueryServer::answer_binary(Connection* connection, RecordParser& parser)
+{
+    std::size_t begin = 0;
+    for (; connection->in_used - begin >= sizeof(BinaryQuery); begin += sizeof(BinaryQuery))
+    {
+        BinaryQuery query;
+        memcpy(&query, &connection->in[begin], sizeof(query));
+        if (query.magic != QUERY_MAGIC)
+            return false;		// out of sync, nothing left to trust
+
+        BinaryResult result;
+        memset(&result, 0, sizeof(result));
+        result.magic = RESULT_MAGIC;
+        result.id = query.id;
+
+        int y, m, d;
+        CivilCalendar::civil_from_days(CivilCalendar::days_from_civil(query.year, query.month, query.day), y, m, d);
+        bool valid = fabs(query.latitude) <= 90 && fabs(query.longitude) <= 180 && !std::isinf(query.timezone)
+            && query.month >= 1 && query.month <= 12 && y == query.year && m == query.month && d == query.day
+            && query.method >= -1 && query.method < Parameters::CalculationMethodsCount
+            && query.asr >= -1 && query.asr <= Parameters::Hanafi
+            && query.high_lats >= -1 && query.high_lats <= Parameters::AngleBased;
+        if (valid)
+        {
+            RecordParser::Record record;
+            memset(&record, 0, sizeof(record));
+            record.latitude = query.latitude;
+            record.longitude = query.longitude;
+            record.year = query.year;
+            record.month = query.month;
+            record.day = query.day;
+            record.days = 1;
+            record.timezone = query.timezone;
+            record.method = query.method;
+            record.asr = query.asr;
+            record.high_lats = query.high_lats;
+            parser.prepare(record, query.id);
+            if (cache)
+                cache->day_times(*record.calculator, record.year, record.month, record.day, record.latitude,
+                                 record.longitude, record.first_timezone, result.times);
+            else
+                record.calculator->compute_day_times(Query::make(record.year, record.month, record.day, record.latitude,
+                                                                 record.longitude, record.first_timezone), result.times);
+            result.status = Ok;
+            num_requests.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            result.status = InvalidQuery;
+            for (int i = 0; i < Parameters::TimesCount; ++i)
+                result.times[i] = NAN;
+            num_rejected.fetch_add(1, std::memory_order_relaxed);
+        }
+        connection->out.append((const char*) &result, sizeof(result));
+    }
+
+    connection->in_used -= begin;
+    memmove(connection->in.data(), connection->in.data() + begin, connection->in_used);
+    return true;
+}
+
+bool QueryServer::write_pending(Connection* connection)
+{
+    while (connection->out_sent < connection->out.size())
+    {
+        ssize_t n = send(connection->fd, connection->out.data() + connection->out_sent,
+                         connection->out.size() - connection->out_sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        connection->out_sent += n;
+    }
+    connection->out.clear();
+    connection->out_sent = 0;
+    return true;
+}
+
+void QueryServer::close_connection(Connection* connection)
+{
+    close(connection->fd);		// also leaves the epoll set
+    {
+        std::lock_guard<std::mutex> guard(connections_lock);
+        connections.erase(connection);
+    }
+    delete connection;
+}
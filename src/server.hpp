@@ -0,0 +1,150 @@
+﻿#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "batch.hpp"
+
+class ResultCache;
+class TimeZone;
+
+/* -------------------- Query Server --------------------- */
+
+// Binary query of one day, host byte order.
+struct BinaryQuery
+{
+    uint32_t magic;		// QueryServer::QUERY_MAGIC
+    uint32_t id;		// echoed by the result
+    double latitude;
+    double longitude;
+    double timezone;		// hours, NaN for the server setting
+    int16_t year;
+    uint8_t month;
+    uint8_t day;
+    int8_t method;		// Parameters enums, -1 for the server setting
+    int8_t asr;
+    int8_t high_lats;
+    uint8_t reserved;
+};
+
+// Answer to a BinaryQuery.
+struct BinaryResult
+{
+    uint32_t magic;		// QueryServer::RESULT_MAGIC
+    uint32_t id;
+    int32_t status;		// QueryServer::Status
+    uint32_t reserved;
+    double times[Parameters::TimesCount];		// hours, NaN where undefined
+};
+
+// Answers prayer time queries on a Unix domain socket or a localhost TCP
+// port, for services that would otherwise run the command line tool per
+// request.
+//
+// A connection speaks binary if it starts with QUERY_MAGIC, else text. Text lines
+// are batch records (see RecordParser), '{' starting a JSON one; every day
+// is answered with one line in the same format, tagged with the number of
+// the request on the connection, and a malformed line with
+// {"line":n,"error":"..."} or "n,error: ...". Binary connections send
+// BinaryQuery frames and get one BinaryResult each. Requests of a
+// connection are answered in order and may be pipelined.
+//
+// All sockets are non-blocking and registered edge-triggered and one-shot
+// in one epoll instance, which every worker thread waits on: a ready
+// connection is handled by exactly one worker, which reads until EAGAIN,
+// answers every complete request with its own RecordParser and writes until
+// EAGAIN before re-arming it. Once MAX_PENDING bytes are unsent it stops
+// answering, in the middle of a long record if need be, and leaves the rest
+// of the input buffered until the peer has read enough.
+class QueryServer
+{
+public:
+    enum
+    {
+        QUERY_MAGIC = 0x31515450,		// "PTQ1"
+        RESULT_MAGIC = 0x31525450,		// "PTR1"
+    };
+
+    enum Status
+    {
+        Ok,
+        InvalidQuery,
+    };
+
+    struct Stats
+    {
+        uint64_t connections;		// accepted
+        uint64_t requests;		// answered queries
+        uint64_t rejected;		// malformed queries
+    };
+
+    static constexpr std::size_t READ_SIZE = 64 * 1024;
+    static constexpr std::size_t MAX_PENDING = 4 * 1024 * 1024;		// unsent output that stops reading a connection
+    static constexpr std::size_t MAX_LINE = 64 * 1024;		// longest text request
+    static constexpr int SLICE_DAYS = 366;		// days of a long text request formatted at a time
+
+    /* defaults are the command line settings; timezone may be NAN and zone NULL;
+       threads == 0 uses one worker per hardware thread */
+    QueryServer(const PrayerTimes& defaults, double timezone, const TimeZone* zone, unsigned threads = 0);
+    ~QueryServer();
+
+    /* listen on a Unix socket path (any address containing '/') or on
+       [host:]port, host defaulting to 127.0.0.1; false after reporting an error */
+    bool listen(const std::string& address);
+
+    /* serve until stop(), or SIGINT or SIGTERM with stop_on_signals;
+       false after reporting a system error */
+    bool run(bool stop_on_signals = false);
+
+    /* make run() return, from any thread */
+    void stop();
+
+    /* answer single day queries from a cache, NULL (the default) to compute
+       every one; set before run(), the cache must outlive the server */
+    void set_cache(ResultCache* result_cache) { cache = result_cache; }
+
+    Stats stats() const;
+
+private:
+    QueryServer(const QueryServer&);
+    QueryServer& operator=(const QueryServer&);
+
+    struct Connection;
+
+    void work();
+    void accept_connections();
+    void handle(Connection* connection, RecordParser& parser, Timetable& table);
+    bool answer_text(Connection* connection, RecordParser& parser, Timetable& table);
+    void answer_days(Connection* connection, RecordParser& parser, Timetable& table);
+    bool answer_binary(Connection* connection, RecordParser& parser);
+    bool write_pending(Connection* connection);
+    void close_connection(Connection* connection);
+
+    const PrayerTimes& defaults;
+    const double default_timezone;
+    const TimeZone* const default_zone;
+    unsigned num_threads;
+    ResultCache* cache;
+
+    int listen_fd;
+    int epoll_fd;
+    int stop_fd;		// eventfd, readable once stopping
+    int signal_fd;
+    std::string socket_path;		// unlinked on destruction
+
+    std::mutex connections_lock;
+    std::unordered_set<Connection*> connections;		// open connections, closed on destruction
+
+    std::atomic<uint64_t> num_connections;
+    std::atomic<uint64_t> num_requests;
+    std::atomic<uint64_t> num_rejected;
+};
+
+#endif
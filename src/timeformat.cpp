@@ -0,0 +1,130 @@
+﻿#include <cmath>
+#include <cstring>
+
+#include "timeformat.hpp"
+#include "timezone.hpp"
+#include "trig.hpp"
+
+namespace {
+
+const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* hours and minutes of a float time, as PrayerTimes::get_float_time_parts */
+inline void time_parts(double time, int& hours, int& minutes)
+{
+    time = TrigHelper::fix_hour(time + 0.5 / 60);		// add 0.5 minutes to round
+    hours = (int) floor(time);
+    minutes = (int) floor((time - hours) * 60);
+}
+
+inline char* put_pair(int num, char* out)
+{
+    memcpy(out, digit_pairs + 2 * num, 2);
+    return out + 2;
+}
+
+}
+
+char* TimeFormat::two_digits(int num, char* out)
+{
+    return put_pair(num, out);
+}
+
+char* TimeFormat::time24(double time, char* out)
+{
+    if (!std::isfinite(time))
+        return out;
+    int hours, minutes;
+    time_parts(time, hours, minutes);
+    out = put_pair(hours, out);
+    *out++ = ':';
+    return put_pair(minutes, out);
+}
+
+char* TimeFormat::time12(double time, char* out, bool no_suffix)
+{
+    if (!std::isfinite(time))
+        return out;
+    int hours, minutes;
+    time_parts(time, hours, minutes);
+    const char* suffix = hours >= 12 ? " PM" : " AM";
+    hours = (hours + 12 - 1) % 12 + 1;
+    if (hours >= 10)
+        out = put_pair(hours, out);
+    else
+        *out++ = (char) ('0' + hours);
+    *out++ = ':';
+    out = put_pair(minutes, out);
+    if (!no_suffix)
+    {
+        memcpy(out, suffix, 3);
+        out += 3;
+    }
+    return out;
+}
+
+char* TimeFormat::date(int year, int month, int day, char* out)
+{
+    out = put_pair(year / 100 % 100, out);
+    out = put_pair(year % 100, out);
+    *out++ = '-';
+    out = put_pair(month, out);
+    *out++ = '-';
+    return put_pair(day, out);
+}
+
+std::size_t TimeFormat::timetable_size(const Timetable& table, bool with_dates)
+{
+    return (std::size_t) table.days * (with_dates ? DATED_ROW_SIZE : ROW_SIZE);
+}
+
+char* TimeFormat::timetable(const Timetable& table, char* out)
+{
+    return timetable_rows(table, false, 0, 0, 0, out);
+}
+
+char* TimeFormat::timetable(const Timetable& table, int year, int month, int day, char* out)
+{
+    return timetable_rows(table, true, year, month, day, out);
+}
+
+char* TimeFormat::timetable_rows(const Timetable& table, bool with_dates, int year, int month, int day, char* out)
+{
+    const double* columns[Parameters::TimesCount];
+    for (int i = 0; i < Parameters::TimesCount; ++i)
+        columns[i] = table.times(i);
+
+    int64_t first = with_dates ? CivilCalendar::days_from_civil(year, month, day) : 0;
+    for (int d = 0; d < table.days; ++d)
+    {
+        if (with_dates)
+        {
+            if (d > 0)
+                CivilCalendar::civil_from_days(first + d, year, month, day);
+            out = date(year, month, day, out);
+            *out++ = ' ';
+        }
+        for (int i = 0; i < Parameters::TimesCount; ++i)
+        {
+            char* end = time24(columns[i][d], out);
+            if (end == out)
+            {
+                memcpy(out, "--:--", TIME24_SIZE);
+                end = out + TIME24_SIZE;
+            }
+            *end++ = i + 1 < Parameters::TimesCount ? ' ' : '\n';
+            out = end;
+        }
+    }
+    return out;
+}
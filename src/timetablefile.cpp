@@ -0,0 +1,295 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "timetablefile.hpp"
+#include "executor.hpp"
+#include "timezone.hpp"
+
+// File layout: Header, Location locations[num_locations],
+// Block blocks[num_locations][blocks per location]; host byte order.
+struct TimetableFile::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    int32_t year;
+    int32_t month;
+    int32_t day;
+    uint32_t days;
+    uint64_t num_locations;
+    uint32_t block_days;
+    uint32_t reserved;
+    // settings the times were computed with
+    double fajr_angle;
+    double maghrib_value;
+    double isha_value;
+    double dhuhr_minutes;
+    uint8_t maghrib_is_minutes;
+    uint8_t isha_is_minutes;
+    uint8_t asr_juristic;
+    uint8_t adjust_high_lats;
+    uint8_t ephemeris;
+    uint8_t precision;
+    uint8_t padding[2];
+    char zone[ZONE_NAME_SIZE];		// NUL terminated, empty for fixed offsets
+};
+
+struct TimetableFile::Block
+{
+    int32_t base[Parameters::TimesCount];		// seconds on the first defined day of the block
+    int16_t delta[BLOCK_DAYS][Parameters::TimesCount];		// change from the previous defined day
+};
+
+namespace {
+
+const char MAGIC[8] = { 'P', 'T', 'T', 'A', 'B', 'L', 'E', '\n' };
+const uint32_t VERSION = 3;
+const int16_t UNDEFINED = INT16_MIN;
+const std::size_t CHUNK_LOCATIONS = 256;		// locations encoded between two writes
+
+}
+
+TimetableFile::TimetableFile()
+    : mapping(NULL)
+    , mapping_size(0)
+    , header(NULL)
+    , locations(NULL)
+    , blocks(NULL)
+    , blocks_per_location(0)
+    , first_day(0)
+{
+}
+
+TimetableFile::~TimetableFile()
+{
+    close();
+}
+
+bool TimetableFile::write(const std::string& path, const CalcConfig& config,
+                          const Location locations[], std::size_t num_locations,
+                          int year, int month, int day, int num_days,
+                          const TimeZone* zone, unsigned threads)
+{
+    if (num_days < 1)
+        return false;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.header_size = sizeof(Header);
+    header.year = year;
+    header.month = month;
+    header.day = day;
+    header.days = num_days;
+    header.num_locations = num_locations;
+    header.block_days = BLOCK_DAYS;
+    header.fajr_angle = config.method.fajr_angle;
+    header.maghrib_value = config.method.maghrib_value;
+    header.isha_value = config.method.isha_value;
+    header.dhuhr_minutes = config.dhuhr_minutes;
+    header.maghrib_is_minutes = config.method.maghrib_is_minutes;
+    header.isha_is_minutes = config.method.isha_is_minutes;
+    header.asr_juristic = config.asr_juristic;
+    header.adjust_high_lats = config.adjust_high_lats;
+    header.ephemeris = config.ephemeris;
+    header.precision = config.precision;
+    if (zone)
+    {
+        if (zone->name().size() >= ZONE_NAME_SIZE)
+            return false;
+        strcpy(header.zone, zone->name().c_str());
+    }
+
+    // the offset of every day, once for all locations
+    std::vector<double> zone_offsets;
+    if (zone)
+    {
+        zone_offsets.resize(num_days);
+        zone->day_offsets(year, month, day, num_days, &zone_offsets[0]);
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && (num_locations == 0 || fwrite(locations, sizeof(Location), num_locations, f) == num_locations);
+
+    const Calculator calculator(config);
+    const std::size_t num_blocks = (num_days + BLOCK_DAYS - 1) / BLOCK_DAYS;
+    std::vector<Block> chunk(CHUNK_LOCATIONS * num_blocks);
+    WorkStealingPool pool(threads);
+    for (std::size_t begin = 0; ok && begin < num_locations; begin += CHUNK_LOCATIONS)
+    {
+        const std::size_t end = std::min(num_locations, begin + CHUNK_LOCATIONS);
+        std::atomic<bool> chunk_ok(true);
+        pool.parallel_for(end - begin, 1, [&](std::size_t first_index, std::size_t last_index)
+        {
+            Timetable table(num_days);
+            for (std::size_t i = first_index; i < last_index; ++i)
+            {
+                const Location& location = locations[begin + i];
+                double timezone = zone ? zone_offsets[0] : location.timezone;
+                calculator.compute_range_times(Query::make(year, month, day, location.latitude, location.longitude, timezone), table);
+                if (zone)
+                    table.shift_days(&zone_offsets[0], timezone);
+
+                Block* out = &chunk[i * num_blocks];
+                memset(out, 0, num_blocks * sizeof(Block));
+                for (std::size_t b = 0; b < num_blocks; ++b)
+                    for (int p = 0; p < Parameters::TimesCount; ++p)
+                    {
+                        bool defined = false;
+                        int64_t previous = 0;
+                        for (int j = 0; j < BLOCK_DAYS; ++j)
+                        {
+                            int d = (int) b * BLOCK_DAYS + j;
+                            double time = d < num_days ? table.at(d, p) : NAN;
+                            if (std::isnan(time))
+                            {
+                                out[b].delta[j][p] = UNDEFINED;
+                                continue;
+                            }
+                            int64_t seconds = llround(time * 3600);
+                            if (!defined)
+                            {
+                                out[b].base[p] = (int32_t) seconds;
+                                previous = seconds;
+                                defined = true;
+                            }
+                            int64_t delta = seconds - previous;
+                            if (delta <= UNDEFINED || delta > INT16_MAX)
+                                chunk_ok = false;
+                            out[b].delta[j][p] = (int16_t) delta;
+                            previous = seconds;
+                        }
+                    }
+            }
+        });
+        ok = chunk_ok && fwrite(&chunk[0], sizeof(Block), (end - begin) * num_blocks, f) == (end - begin) * num_blocks;
+    }
+
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        remove(path.c_str());
+    return ok;
+}
+
+bool TimetableFile::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (std::size_t) st.st_size >= sizeof(Header))
+    {
+        void* m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED)
+        {
+            mapping = m;
+            mapping_size = st.st_size;
+        }
+    }
+    ::close(fd);
+    if (!mapping)
+        return false;
+
+    const Header* h = (const Header*) mapping;
+    std::size_t num_blocks = (h->days + BLOCK_DAYS - 1) / BLOCK_DAYS;
+    std::size_t location_size = sizeof(Location) + num_blocks * sizeof(Block);		// no overflow, days is 32 bit
+    if (memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 || h->version != VERSION || h->header_size != sizeof(Header)
+        || h->block_days != BLOCK_DAYS || h->days < 1 || memchr(h->zone, '\0', ZONE_NAME_SIZE) == NULL
+        || h->num_locations > (mapping_size - sizeof(Header)) / location_size		// before the product can wrap
+        || mapping_size != sizeof(Header) + h->num_locations * location_size)
+    {
+        close();
+        return false;
+    }
+
+    header = h;
+    locations = (const Location*) (h + 1);
+    blocks = (const Block*) (locations + h->num_locations);
+    blocks_per_location = num_blocks;
+    first_day = CivilCalendar::days_from_civil(h->year, h->month, h->day);
+    return true;
+}
+
+void TimetableFile::close()
+{
+    if (mapping)
+        munmap(mapping, mapping_size);
+    mapping = NULL;
+    mapping_size = 0;
+    header = NULL;
+    locations = NULL;
+    blocks = NULL;
+    blocks_per_location = 0;
+}
+
+std::size_t TimetableFile::num_locations() const
+{
+    return header ? header->num_locations : 0;
+}
+
+int TimetableFile::num_days() const
+{
+    return header ? header->days : 0;
+}
+
+const Location& TimetableFile::location(std::size_t index) const
+{
+    return locations[index];
+}
+
+CalcConfig TimetableFile::config() const
+{
+    CalcConfig config;
+    if (!header)
+        return config;
+    config.method = Parameters::MethodConfig(header->fajr_angle, header->maghrib_is_minutes, header->maghrib_value,
+                                             header->isha_is_minutes, header->isha_value);
+    config.asr_juristic = (Parameters::JuristicMethod) header->asr_juristic;
+    config.adjust_high_lats = (Parameters::AdjustingMethod) header->adjust_high_lats;
+    config.dhuhr_minutes = header->dhuhr_minutes;
+    config.ephemeris = (Parameters::EphemerisMode) header->ephemeris;
+    config.precision = (Parameters::PrecisionTier) header->precision;
+    return config;
+}
+
+std::string TimetableFile::zone_name() const
+{
+    return header ? header->zone : "";
+}
+
+void TimetableFile::date(int day, int& year, int& month, int& mday) const
+{
+    CivilCalendar::civil_from_days(first_day + day, year, month, mday);
+}
+
+bool TimetableFile::day_times(std::size_t location, int day, double times[]) const
+{
+    if (!header || location >= header->num_locations || day < 0 || day >= (int) header->days)
+        return false;
+
+    const Block& block = blocks[location * blocks_per_location + day / BLOCK_DAYS];
+    const int last = day % BLOCK_DAYS;
+    for (int p = 0; p < Parameters::TimesCount; ++p)
+    {
+        int32_t seconds = block.base[p];
+        for (int j = 0; j < last; ++j)
+            if (block.delta[j][p] != UNDEFINED)
+                seconds += block.delta[j][p];
+        times[p] = block.delta[last][p] == UNDEFINED ? NAN : (seconds + block.delta[last][p]) / 3600.0;
+    }
+    return true;
+}
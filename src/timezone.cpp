@@ -0,0 +1,503 @@
+﻿#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "timezone.hpp"
+
+namespace {
+
+int32_t read_be32(const unsigned char* p)
+{
+    return (int32_t) (((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3]);
+}
+
+int64_t read_be64(const unsigned char* p)
+{
+    return (int64_t) (((uint64_t) (uint32_t) read_be32(p) << 32) | (uint32_t) read_be32(p + 4));
+}
+
+/* FNV-1a of a zone name */
+std::size_t hash_name(const char* name)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (; *name; ++name)
+        h = (h ^ (unsigned char) *name) * 1099511628211ULL;
+    return (std::size_t) h;
+}
+
+int64_t floor_div(int64_t a, int64_t b)
+{
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+/* [+-]hh[:mm[:ss]], returns false if no digits were found */
+bool parse_hms(const char*& s, const char* end, int32_t& seconds)
+{
+    int sign = 1;
+    if (s < end && (*s == '+' || *s == '-'))
+        sign = *s++ == '-' ? -1 : 1;
+
+    int32_t parts[3] = { 0, 0, 0 };
+    for (int i = 0; i < 3; ++i)
+    {
+        if (i > 0)
+        {
+            if (s >= end || *s != ':')
+                break;
+            ++s;
+        }
+        if (s >= end || *s < '0' || *s > '9')
+            return false;
+        while (s < end && *s >= '0' && *s <= '9')
+            parts[i] = parts[i] * 10 + (*s++ - '0');
+    }
+    seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+    return true;
+}
+
+/* zone abbreviation, either alphabetic or quoted in <> */
+bool parse_abbreviation(const char*& s, const char* end)
+{
+    if (s < end && *s == '<')
+    {
+        while (s < end && *s != '>')
+            ++s;
+        if (s == end)
+            return false;
+        ++s;
+        return true;
+    }
+    const char* start = s;
+    while (s < end && ((*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z')))
+        ++s;
+    return s - start >= 3;
+}
+
+bool parse_number(const char*& s, const char* end, int& value)
+{
+    if (s >= end || *s < '0' || *s > '9')
+        return false;
+    value = 0;
+    while (s < end && *s >= '0' && *s <= '9')
+        value = value * 10 + (*s++ - '0');
+    return true;
+}
+
+}
+
+/* -------------------- Civil Calendar --------------------- */
+
+int64_t CivilCalendar::days_from_civil(int year, int month, int day)
+{
+    int64_t y = year - (month <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void CivilCalendar::civil_from_days(int64_t days, int& year, int& month, int& day)
+{
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    day = (int) (doy - (153 * mp + 2) / 5 + 1);
+    month = (int) (mp < 10 ? mp + 3 : mp - 9);
+    year = (int) (yoe + era * 400 + (month <= 2));
+}
+
+int CivilCalendar::weekday(int64_t days)
+{
+    int64_t w = (days + 4) % 7;		// 1970-01-01 was a Thursday
+    return (int) (w < 0 ? w + 7 : w);
+}
+
+bool CivilCalendar::is_leap_year(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/* -------------------- Time Zones --------------------- */
+
+TimeZone::TimeZone()
+    : mapping(NULL)
+    , mapping_size(0)
+    , times(NULL)
+    , time_size(8)
+    , types(NULL)
+    , num_transitions(0)
+    , initial_offset(0)
+    , has_rule(false)
+{
+}
+
+TimeZone::~TimeZone()
+{
+    if (mapping)
+        munmap(mapping, mapping_size);
+}
+
+int32_t TimeZone::utc_offset(int64_t utc) const
+{
+    if (num_transitions == 0)
+        return has_rule ? rule_offset(utc) : initial_offset;
+
+    const std::size_t last = num_transitions - 1;
+    if (utc < transition(0))
+        return initial_offset;
+    if (utc >= transition(last))
+        return has_rule ? rule_offset(utc) : type_offsets[types[last]];
+
+    // last transition at or before utc
+    std::size_t lo = 0, hi = last;
+    while (hi - lo > 1)
+    {
+        std::size_t mid = lo + (hi - lo) / 2;
+        if (transition(mid) <= utc)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return type_offsets[types[lo]];
+}
+
+int64_t TimeZone::transition(std::size_t i) const
+{
+    return time_size == 8 ? read_be64(times + 8 * i) : read_be32(times + 4 * i);
+}
+
+int32_t TimeZone::local_offset(int64_t local) const
+{
+    // same choice as mktime with tm_isdst = -1 for most gaps and overlaps
+    int32_t guess = utc_offset(local);
+    return utc_offset(local - guess);
+}
+
+double TimeZone::timezone(int year, int month, int day) const
+{
+    int64_t local = CivilCalendar::days_from_civil(year, month, day) * 86400;
+    return local_offset(local) / 3600.0;
+}
+
+void TimeZone::day_offsets(int year, int month, int day, int num_days, double offsets[]) const
+{
+    const int64_t first = CivilCalendar::days_from_civil(year, month, day);
+    for (int d = 0; d < num_days; ++d)
+        offsets[d] = local_offset((first + d) * 86400) / 3600.0;
+}
+
+bool TimeZone::parse(const unsigned char* data, std::size_t size)
+{
+    const std::size_t header_size = 44;
+    if (size < header_size || memcmp(data, "TZif", 4) != 0)
+        return false;
+
+    const unsigned char* header = data;
+    int version = data[4] ? data[4] - '0' : 1;
+    int width = 4;
+    int leap_width = 8;
+
+    for (;;)
+    {
+        uint32_t isutcnt = read_be32(header + 20);
+        uint32_t isstdcnt = read_be32(header + 24);
+        uint32_t leapcnt = read_be32(header + 28);
+        uint32_t timecnt = read_be32(header + 32);
+        uint32_t typecnt = read_be32(header + 36);
+        uint32_t charcnt = read_be32(header + 40);
+
+        const unsigned char* block = header + header_size;
+        std::size_t block_size = (std::size_t) timecnt * (width + 1) + typecnt * 6 + charcnt
+            + (std::size_t) leapcnt * leap_width + isstdcnt + isutcnt;
+        if (block + block_size > data + size)
+            return false;
+
+        // version 2+ files repeat everything with 64-bit times after the first block
+        if (version >= 2 && width == 4)
+        {
+            header = block + block_size;
+            if (header + header_size > data + size || memcmp(header, "TZif", 4) != 0)
+                return false;
+            width = 8;
+            leap_width = 12;
+            continue;
+        }
+
+        if (typecnt == 0 || typecnt > 256)
+            return false;
+        times = block;
+        time_size = width;
+        types = block + (std::size_t) timecnt * width;
+        num_transitions = timecnt;
+        for (uint32_t i = 0; i < timecnt; ++i)
+            if (types[i] >= typecnt)
+                return false;
+
+        const unsigned char* ttinfo = types + timecnt;
+        for (uint32_t i = 0; i < typecnt; ++i)
+            type_offsets[i] = read_be32(ttinfo + 6 * i);
+        initial_offset = type_offsets[0];
+
+        // footer: "\n<POSIX TZ string>\n"
+        const char* footer = (const char*) (block + block_size);
+        const char* data_end = (const char*) (data + size);
+        if (version >= 2 && footer < data_end && *footer == '\n')
+        {
+            const char* rule_end = (const char*) memchr(footer + 1, '\n', data_end - footer - 1);
+            if (rule_end && rule_end > footer + 1)
+                has_rule = parse_rule(footer + 1, rule_end, rule);
+        }
+        return true;
+    }
+}
+
+bool TimeZone::parse_rule(const char* s, const char* end, Rule& rule)
+{
+    int32_t offset;
+    if (!parse_abbreviation(s, end) || !parse_hms(s, end, offset))
+        return false;
+    rule.std_offset = -offset;		// POSIX offsets count west of UTC
+    rule.dst_offset = rule.std_offset;
+    rule.has_dst = s < end;
+    if (!rule.has_dst)
+        return true;
+
+    if (!parse_abbreviation(s, end))
+        return false;
+    rule.dst_offset = rule.std_offset + 3600;
+    if (s < end && *s != ',')
+    {
+        if (!parse_hms(s, end, offset))
+            return false;
+        rule.dst_offset = -offset;
+    }
+
+    // without explicit dates use the US rules, as glibc does
+    const char* us_rules = ",M3.2.0,M11.1.0";
+    if (s == end)
+    {
+        s = us_rules;
+        end = us_rules + strlen(us_rules);
+    }
+
+    Rule::Date* dates[2] = { &rule.start, &rule.end };
+    for (int i = 0; i < 2; ++i)
+    {
+        Rule::Date& date = *dates[i];
+        if (s >= end || *s++ != ',')
+            return false;
+        date.week = date.month = 0;
+        if (s < end && *s == 'M')
+        {
+            ++s;
+            date.kind = Rule::MonthWeekDay;
+            if (!parse_number(s, end, date.month) || s >= end || *s++ != '.'
+                || !parse_number(s, end, date.week) || s >= end || *s++ != '.'
+                || !parse_number(s, end, date.day))
+                return false;
+            if (date.month < 1 || date.month > 12 || date.week < 1 || date.week > 5 || date.day > 6)
+                return false;
+        }
+        else
+        {
+            date.kind = Rule::Julian0;
+            if (s < end && *s == 'J')
+            {
+                ++s;
+                date.kind = Rule::Julian1;
+            }
+            if (!parse_number(s, end, date.day))
+                return false;
+        }
+
+        date.time = 7200;
+        if (s < end && *s == '/')
+        {
+            ++s;
+            if (!parse_hms(s, end, date.time))
+                return false;
+        }
+    }
+    return s == end;
+}
+
+int64_t TimeZone::rule_transition(const Rule::Date& date, int year)
+{
+    int64_t days;
+    switch (date.kind)
+    {
+    case Rule::Julian1:		// 1..365, February 29th is never counted
+        days = CivilCalendar::days_from_civil(year, 1, 1) + date.day - 1;
+        if (CivilCalendar::is_leap_year(year) && date.day >= 60)
+            ++days;
+        break;
+    case Rule::Julian0:		// 0..365
+        days = CivilCalendar::days_from_civil(year, 1, 1) + date.day;
+        break;
+    default:		// day d of week w of month m, week 5 is the last one
+    {
+        int64_t first = CivilCalendar::days_from_civil(year, date.month, 1);
+        int64_t next = date.month == 12 ? CivilCalendar::days_from_civil(year + 1, 1, 1) : CivilCalendar::days_from_civil(year, date.month + 1, 1);
+        days = first + (date.day - CivilCalendar::weekday(first) + 7) % 7 + (date.week - 1) * 7;
+        while (days >= next)
+            days -= 7;
+        break;
+    }
+    }
+    return days * 86400 + date.time;
+}
+
+int32_t TimeZone::rule_offset(int64_t utc) const
+{
+    if (!rule.has_dst)
+        return rule.std_offset;
+
+    int year, month, day;
+    CivilCalendar::civil_from_days(floor_div(utc + rule.std_offset, 86400), year, month, day);
+
+    // start is given in standard time, end in daylight time
+    int64_t start = rule_transition(rule.start, year) - rule.std_offset;
+    int64_t end = rule_transition(rule.end, year) - rule.dst_offset;
+    bool dst = start < end
+        ? start <= utc && utc < end
+        : !(end <= utc && utc < start);		// southern hemisphere
+    return dst ? rule.dst_offset : rule.std_offset;
+}
+
+TimeZoneDb::Index::Index(std::size_t size)
+    : mask(size - 1)
+    , count(0)
+    , slots(new std::atomic<const ZoneMap::value_type*>[size]())
+{
+}
+
+TimeZoneDb::TimeZoneDb(const std::string& root)
+    : root(root)
+    , index(NULL)
+    , local_zone(NULL)
+{
+    indexes.emplace_back(new Index(64));
+    index.store(indexes.back().get(), std::memory_order_release);
+}
+
+TimeZoneDb::~TimeZoneDb()
+{
+}
+
+TimeZoneDb& TimeZoneDb::system()
+{
+    static TimeZoneDb db;
+    return db;
+}
+
+const TimeZone* TimeZoneDb::find(const char* name)
+{
+    // zone names are relative paths inside the database
+    if (!name || !*name || name[0] == '/' || strstr(name, ".."))
+        return NULL;
+
+    const Index* current = index.load(std::memory_order_acquire);
+    for (std::size_t i = hash_name(name) & current->mask;; i = (i + 1) & current->mask)
+    {
+        const ZoneMap::value_type* entry = current->slots[i].load(std::memory_order_acquire);
+        if (!entry)
+            break;
+        if (entry->first == name)
+            return entry->second.get();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    return load(name, root + "/" + name);
+}
+
+const TimeZone* TimeZoneDb::find(const std::string& name)
+{
+    return find(name.c_str());
+}
+
+const TimeZone* TimeZoneDb::local()
+{
+    std::call_once(local_once, [this]
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        const char* tz = getenv("TZ");
+        if (!tz)
+            local_zone = load("/etc/localtime", "/etc/localtime");
+        else
+        {
+            std::string name(tz[0] == ':' ? tz + 1 : tz);
+            if (name.empty())
+                name = "UTC";
+            if (name[0] == '/')
+                local_zone = load(name, name);
+            else if (name.find("..") == std::string::npos)
+                local_zone = load(name, root + "/" + name);
+        }
+    });
+    return local_zone;
+}
+
+void TimeZoneDb::publish(const ZoneMap::value_type& entry)
+{
+    // called under the lock; readers see a slot only once the entry is complete
+    Index* current = indexes.back().get();
+    if (2 * (current->count + 1) > current->mask + 1)
+    {
+        indexes.emplace_back(new Index(2 * (current->mask + 1)));
+        current = indexes.back().get();
+        for (const ZoneMap::value_type& loaded : zones)
+        {
+            if (&loaded == &entry)
+                continue;
+            std::size_t i = hash_name(loaded.first.c_str()) & current->mask;
+            while (current->slots[i].load(std::memory_order_relaxed))
+                i = (i + 1) & current->mask;
+            current->slots[i].store(&loaded, std::memory_order_relaxed);
+            ++current->count;
+        }
+    }
+
+    std::size_t i = hash_name(entry.first.c_str()) & current->mask;
+    while (current->slots[i].load(std::memory_order_relaxed))
+        i = (i + 1) & current->mask;
+    current->slots[i].store(&entry, std::memory_order_release);
+    ++current->count;
+    index.store(current, std::memory_order_release);
+}
+
+const TimeZone* TimeZoneDb::load(const std::string& key, const std::string& path)
+{
+    ZoneMap::iterator it = zones.find(key);
+    if (it != zones.end())
+        return it->second.get();
+
+    std::unique_ptr<TimeZone> zone;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            zone.reset(new TimeZone);
+            zone->zone_name = key;
+            zone->mapping = mapping;
+            zone->mapping_size = st.st_size;
+            if (!zone->parse((const unsigned char*) mapping, st.st_size))
+                zone.reset();
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+
+    const TimeZone* result = zone.get();
+    publish(*zones.emplace(key, std::move(zone)).first);
+    return result;
+}
@@ -1,6 +1,39 @@
 ﻿#include "trig.hpp"
+#include "trig_kernels.hpp"
 #include "math.h"
 
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+/* pick the widest instruction set supported by this CPU;
+   PRAYERTIMES_SIMD=scalar|sse2|avx2 lowers the choice */
+TrigKernels select_kernels()
+{
+    const char* env = getenv("PRAYERTIMES_SIMD");
+    bool allow_sse2 = !env || strcmp(env, "scalar") != 0;
+    bool allow_avx2 = allow_sse2 && (!env || strcmp(env, "sse2") != 0);
+#ifdef TRIG_KERNELS_X86
+    __builtin_cpu_init();
+    if (allow_avx2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return trig_kernels_avx2();
+    if (allow_sse2 && __builtin_cpu_supports("sse2"))
+        return trig_kernels_sse2();
+#else
+    (void) allow_avx2;
+#endif
+    return make_trig_kernels<ScalarOps>("scalar");
+}
+
+const TrigKernels& kernels()
+{
+    static const TrigKernels k = select_kernels();
+    return k;
+}
+
+}
+
 TrigHelper::TrigHelper()
 {
 
@@ -69,3 +102,53 @@ double TrigHelper::fix_hour(double a)
     a = a < 0.0 ? a + 24.0 : a;
     return a;
 }
+
+void TrigHelper::dsin(const double* d, double* out, std::size_t n)
+{
+    kernels().dsin(d, out, n);
+}
+
+void TrigHelper::dcos(const double* d, double* out, std::size_t n)
+{
+    kernels().dcos(d, out, n);
+}
+
+void TrigHelper::dtan(const double* d, double* out, std::size_t n)
+{
+    kernels().dtan(d, out, n);
+}
+
+void TrigHelper::darcsin(const double* x, double* out, std::size_t n)
+{
+    kernels().darcsin(x, out, n);
+}
+
+void TrigHelper::darccos(const double* x, double* out, std::size_t n)
+{
+    kernels().darccos(x, out, n);
+}
+
+void TrigHelper::darctan2(const double* y, const double* x, double* out, std::size_t n)
+{
+    kernels().darctan2(y, x, out, n);
+}
+
+void TrigHelper::darccot(const double* x, double* out, std::size_t n)
+{
+    kernels().darccot(x, out, n);
+}
+
+void TrigHelper::fix_angle(const double* a, double* out, std::size_t n)
+{
+    kernels().fix_angle(a, out, n);
+}
+
+void TrigHelper::fix_hour(const double* a, double* out, std::size_t n)
+{
+    kernels().fix_hour(a, out, n);
+}
+
+const char* TrigHelper::simd_level()
+{
+    return kernels().name;
+}
@@ -0,0 +1,45 @@
+﻿// Compiled with -mavx2 -mfma; only reached after a runtime CPU check.
+
+#include "trig_kernels.hpp"
+
+#ifdef TRIG_KERNELS_X86
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2Ops
+{
+    typedef __m256d V;
+    typedef __m256d M;
+    enum { width = 4 };
+
+    static V load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, V v) { _mm256_storeu_pd(p, v); }
+    static V set(double x) { return _mm256_set1_pd(x); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm256_div_pd(a, b); }
+    static V mul_add(V a, V b, V c) { return _mm256_fmadd_pd(a, b, c); }
+    static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+    static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static V neg(V a) { return _mm256_xor_pd(_mm256_set1_pd(-0.0), a); }
+    static V floor(V a) { return _mm256_floor_pd(a); }
+    static V round(V a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static M gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static M eq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static M and_(M a, M b) { return _mm256_and_pd(a, b); }
+    static M or_(M a, M b) { return _mm256_or_pd(a, b); }
+    static V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+};
+
+}
+
+TrigKernels trig_kernels_avx2()
+{
+    return make_trig_kernels<Avx2Ops>("avx2");
+}
+
+#endif
@@ -0,0 +1,241 @@
+﻿#ifndef TRIGKERNELS_H
+#define TRIGKERNELS_H
+
+// Array kernels behind the TrigHelper span variants.
+//
+// Every algorithm is written once against an "ops" type which provides the
+// vector type V, the mask type M and the primitive operations. Each
+// instruction set translation unit (trig.cpp, trig_sse2.cpp, trig_avx2.cpp)
+// includes this header with its own ops type and is compiled with matching
+// flags. Everything lives in an anonymous namespace so no inline function
+// compiled for one instruction set can be picked up by another.
+//
+// sin/cos use the Cephes minimax polynomials on [-pi/4, pi/4] after an exact
+// reduction in degrees, atan uses the Cephes rational approximation, and
+// asin/acos/atan2 are derived from atan. All kernels stay within 1e-12 of
+// the scalar TrigHelper functions (see bench/bench_trig.cpp).
+
+#include <cmath>
+#include <cstddef>
+
+/* function table of one instruction set */
+struct TrigKernels
+{
+    typedef void (*Unary)(const double* in, double* out, std::size_t n);
+    typedef void (*Binary)(const double* a, const double* b, double* out, std::size_t n);
+
+    const char* name;
+    Unary dsin;
+    Unary dcos;
+    Unary dtan;
+    Unary darcsin;
+    Unary darccos;
+    Binary darctan2;
+    Unary darccot;
+    Unary fix_angle;
+    Unary fix_hour;
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRIG_KERNELS_X86 1
+TrigKernels trig_kernels_sse2();		// trig_sse2.cpp
+TrigKernels trig_kernels_avx2();		// trig_avx2.cpp
+#endif
+
+namespace {
+
+struct ScalarOps
+{
+    typedef double V;
+    typedef bool M;
+    enum { width = 1 };
+
+    static V load(const double* p) { return *p; }
+    static void store(double* p, V v) { *p = v; }
+    static V set(double x) { return x; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V div(V a, V b) { return a / b; }
+    static V mul_add(V a, V b, V c) { return a * b + c; }
+    static V sqrt(V a) { return std::sqrt(a); }
+    static V abs(V a) { return std::fabs(a); }
+    static V neg(V a) { return -a; }
+    static V floor(V a) { return std::floor(a); }
+    static V round(V a) { return std::floor(a + 0.5); }
+    static M lt(V a, V b) { return a < b; }
+    static M gt(V a, V b) { return a > b; }
+    static M eq(V a, V b) { return a == b; }
+    static M and_(M a, M b) { return a && b; }
+    static M or_(M a, M b) { return a || b; }
+    static V select(M m, V a, V b) { return m ? a : b; }
+};
+
+const double kDegToRad = M_PI / 180.0;
+const double kRadToDeg = 180.0 / M_PI;
+
+template <class O>
+typename O::V poly(typename O::V z, const double* c, int n)
+{
+    typename O::V r = O::set(c[0]);
+    for (int i = 1; i < n; ++i)
+        r = O::mul_add(r, z, O::set(c[i]));
+    return r;
+}
+
+/* sin (or cos when cosine is true) of an angle in degrees */
+template <class O, bool cosine>
+typename O::V sin_deg(typename O::V d)
+{
+    typedef typename O::V V;
+    static const double sin_coef[] = {
+        1.58962301576546568060E-10, -2.50507477628578072866E-8,
+        2.75573136213857245213E-6, -1.98412698295895385996E-4,
+        8.33333333332211858878E-3, -1.66666666666666307295E-1,
+    };
+    static const double cos_coef[] = {
+        -1.13585365213876817300E-11, 2.08757008419747316778E-9,
+        -2.75573141792967388112E-7, 2.48015872888517045348E-5,
+        -1.38888888888730564116E-3, 4.16666666666665929218E-2,
+    };
+
+    // d = 90 * q + r with r in [-45, 45]; q mod 4 selects the quadrant
+    V q = O::round(O::mul(d, O::set(1.0 / 90.0)));
+    V r = O::sub(d, O::mul(q, O::set(90.0)));
+    V quadrant = O::sub(q, O::mul(O::floor(O::mul(q, O::set(0.25))), O::set(4.0)));
+    if (cosine)
+        quadrant = O::add(quadrant, O::set(1.0));
+
+    V x = O::mul(r, O::set(kDegToRad));
+    V z = O::mul(x, x);
+    V s = O::mul_add(O::mul(x, z), poly<O>(z, sin_coef, 6), x);
+    V c = O::mul_add(O::mul(z, z), poly<O>(z, cos_coef, 6), O::sub(O::set(1.0), O::mul(z, O::set(0.5))));
+
+    typename O::M odd = O::or_(O::eq(quadrant, O::set(1.0)), O::eq(quadrant, O::set(3.0)));
+    typename O::M negative = O::and_(O::gt(quadrant, O::set(1.5)), O::lt(quadrant, O::set(3.5)));
+    V result = O::select(odd, c, s);
+    return O::select(negative, O::neg(result), result);
+}
+
+/* arctan in radians */
+template <class O>
+typename O::V atan_rad(typename O::V x)
+{
+    typedef typename O::V V;
+    typedef typename O::M M;
+    static const double p_coef[] = {
+        -8.750608600031904122785E-1, -1.615753718733365076637E1,
+        -7.500855792314704667340E1, -1.228866684490136173410E2,
+        -6.485021904942025371773E1,
+    };
+    static const double q_coef[] = {
+        1.0, 2.485846490142306297962E1,
+        1.650270098316988542046E2, 4.328810604912902668951E2,
+        4.853903996359136964868E2, 1.945506571482613964425E2,
+    };
+    const double more_bits = 6.123233995736765886130E-17;
+
+    M negative = O::lt(x, O::set(0.0));
+    V a = O::abs(x);
+    M big = O::gt(a, O::set(2.41421356237309504880));		// tan(3pi/8)
+    M mid = O::gt(a, O::set(0.66));
+
+    V xr = O::select(big, O::div(O::set(-1.0), a),
+                     O::select(mid, O::div(O::sub(a, O::set(1.0)), O::add(a, O::set(1.0))), a));
+    V y = O::select(big, O::set(M_PI / 2), O::select(mid, O::set(M_PI / 4), O::set(0.0)));
+    V extra = O::select(big, O::set(more_bits), O::select(mid, O::set(0.5 * more_bits), O::set(0.0)));
+
+    V z = O::mul(xr, xr);
+    z = O::div(O::mul(z, poly<O>(z, p_coef, 5)), poly<O>(z, q_coef, 6));
+    z = O::mul_add(xr, z, xr);
+    V result = O::add(y, O::add(z, extra));
+    return O::select(negative, O::neg(result), result);
+}
+
+/* arctan2 in radians; atan2(0, 0) is 0 */
+template <class O>
+typename O::V atan2_rad(typename O::V y, typename O::V x)
+{
+    typedef typename O::V V;
+    V zero = O::set(0.0);
+    V w = O::select(O::lt(x, zero), O::select(O::lt(y, zero), O::set(-M_PI), O::set(M_PI)), zero);
+    V result = O::add(w, atan_rad<O>(O::div(y, x)));
+    return O::select(O::and_(O::eq(x, zero), O::eq(y, zero)), zero, result);
+}
+
+/* sqrt(1 - x^2), NaN outside [-1, 1] */
+template <class O>
+typename O::V cofunction(typename O::V x)
+{
+    typename O::V one = O::set(1.0);
+    return O::sqrt(O::mul(O::sub(one, x), O::add(one, x)));
+}
+
+/* a - period * floor(a / period), kept non-negative */
+template <class O>
+typename O::V fix_period(typename O::V a, double period)
+{
+    typedef typename O::V V;
+    V p = O::set(period);
+    a = O::sub(a, O::mul(p, O::floor(O::div(a, p))));
+    return O::select(O::lt(a, O::set(0.0)), O::add(a, p), a);
+}
+
+/* ---------------------- Element Functions ----------------------- */
+
+template <class O> struct DSin    { static typename O::V f(typename O::V d) { return sin_deg<O, false>(d); } };
+template <class O> struct DCos    { static typename O::V f(typename O::V d) { return sin_deg<O, true>(d); } };
+template <class O> struct DTan    { static typename O::V f(typename O::V d) { return O::div(sin_deg<O, false>(d), sin_deg<O, true>(d)); } };
+template <class O> struct DArcSin { static typename O::V f(typename O::V x) { return O::mul(atan2_rad<O>(x, cofunction<O>(x)), O::set(kRadToDeg)); } };
+template <class O> struct DArcCos { static typename O::V f(typename O::V x) { return O::mul(atan2_rad<O>(cofunction<O>(x), x), O::set(kRadToDeg)); } };
+template <class O> struct DArcCot { static typename O::V f(typename O::V x) { return O::mul(atan_rad<O>(O::div(O::set(1.0), x)), O::set(kRadToDeg)); } };
+template <class O> struct FixAngle { static typename O::V f(typename O::V a) { return fix_period<O>(a, 360.0); } };
+template <class O> struct FixHour  { static typename O::V f(typename O::V a) { return fix_period<O>(a, 24.0); } };
+
+template <class O> struct DArcTan2
+{
+    static typename O::V f(typename O::V y, typename O::V x) { return O::mul(atan2_rad<O>(y, x), O::set(kRadToDeg)); }
+};
+
+/* ---------------------- Array Loops ----------------------- */
+
+template <class O, template <class> class F>
+void unary_kernel(const double* in, double* out, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + O::width <= n; i += O::width)
+        O::store(out + i, F<O>::f(O::load(in + i)));
+    for (; i < n; ++i)
+        out[i] = F<ScalarOps>::f(in[i]);
+}
+
+template <class O, template <class> class F>
+void binary_kernel(const double* a, const double* b, double* out, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + O::width <= n; i += O::width)
+        O::store(out + i, F<O>::f(O::load(a + i), O::load(b + i)));
+    for (; i < n; ++i)
+        out[i] = F<ScalarOps>::f(a[i], b[i]);
+}
+
+template <class O>
+TrigKernels make_trig_kernels(const char* name)
+{
+    TrigKernels k;
+    k.name = name;
+    k.dsin = &unary_kernel<O, DSin>;
+    k.dcos = &unary_kernel<O, DCos>;
+    k.dtan = &unary_kernel<O, DTan>;
+    k.darcsin = &unary_kernel<O, DArcSin>;
+    k.darccos = &unary_kernel<O, DArcCos>;
+    k.darctan2 = &binary_kernel<O, DArcTan2>;
+    k.darccot = &unary_kernel<O, DArcCot>;
+    k.fix_angle = &unary_kernel<O, FixAngle>;
+    k.fix_hour = &unary_kernel<O, FixHour>;
+    return k;
+}
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+﻿#include "trig_kernels.hpp"
+
+#ifdef TRIG_KERNELS_X86
+
+#include <emmintrin.h>
+
+namespace {
+
+struct Sse2Ops
+{
+    typedef __m128d V;
+    typedef __m128d M;
+    enum { width = 2 };
+
+    static V load(const double* p) { return _mm_loadu_pd(p); }
+    static void store(double* p, V v) { _mm_storeu_pd(p, v); }
+    static V set(double x) { return _mm_set1_pd(x); }
+    static V add(V a, V b) { return _mm_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm_div_pd(a, b); }
+    static V mul_add(V a, V b, V c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static V sqrt(V a) { return _mm_sqrt_pd(a); }
+    static V abs(V a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    static V neg(V a) { return _mm_xor_pd(_mm_set1_pd(-0.0), a); }
+    static M lt(V a, V b) { return _mm_cmplt_pd(a, b); }
+    static M gt(V a, V b) { return _mm_cmpgt_pd(a, b); }
+    static M eq(V a, V b) { return _mm_cmpeq_pd(a, b); }
+    static M and_(M a, M b) { return _mm_and_pd(a, b); }
+    static M or_(M a, M b) { return _mm_or_pd(a, b); }
+    static V select(M m, V a, V b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+
+    /* round to nearest through the 1.5 * 2^52 trick, valid for |a| < 2^51 */
+    static V round(V a)
+    {
+        const V magic = _mm_set1_pd(6755399441055744.0);
+        return _mm_sub_pd(_mm_add_pd(a, magic), magic);
+    }
+
+    static V floor(V a)
+    {
+        V r = round(a);
+        return _mm_sub_pd(r, _mm_and_pd(_mm_cmpgt_pd(r, a), _mm_set1_pd(1.0)));
+    }
+};
+
+}
+
+TrigKernels trig_kernels_sse2()
+{
+    return make_trig_kernels<Sse2Ops>("sse2");
+}
+
+#endif